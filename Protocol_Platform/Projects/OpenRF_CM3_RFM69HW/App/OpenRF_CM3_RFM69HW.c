@@ -11,8 +11,8 @@
 // *****************************************
 // AT Commands
 
-#define kATCommandCount	24
-const char * atCommands[kATCommandCount] = { "SL", "NA", "DL", "CN", "RE", "EK", "BD", "NB", "SB", "SS", "TE", "%V", "VR", "WS", "RR", "SP", "TL", "TT", "GS", "TP", "TS", "AR", "AT", "HT" };
+#define kATCommandCount	25
+const char * atCommands[kATCommandCount] = { "SL", "NA", "DL", "CN", "RE", "EK", "BD", "NB", "SB", "SS", "TE", "%V", "VR", "WS", "RR", "SP", "TL", "TT", "GS", "TP", "TS", "AR", "AT", "HT", "ML" };
 
 // AT Commands
 enum
@@ -41,6 +41,7 @@ enum
 	kGetSetAckRetriesCommand,
 	kGetSetAckTimeoutCommand,
 	kGetSetHopTable,
+	kGetModeLatency,
 	kNullCommand = 0xff
 };
 
@@ -66,8 +67,17 @@ U8		_transmitTriggerLevel;
 U8		_transmitTriggerTimerActive = 0;
 tPacketTypes	_packetType = kUniAckPacketType;
 U8		_packetReceived = 0;
-U8		_receivePacketDataBuffer[63];
-U8		_receivePacketCount;
+// big enough for a fragmented SDU put back together by the MAC
+U8		_receivePacketDataBuffer[kReassemblyLength];
+// UART data goes out of these buffers in turn.  Each belongs to the MAC from OpenRFSendPacket until NotifyMacPacketSent or
+// NotifyMacPacketSendError hands it back, so one can fill while the other is queued or on the air.
+#define kTransmitBufferCount 2
+U8		_transmitPacketDataBuffer[kTransmitBufferCount][kMaxSDULength];
+U8		_transmitBufferQueued[kTransmitBufferCount];
+// IO slave responses, queued the same way
+U8		_responseBuffer[16];
+U8		_responseQueued = 0;
+U16		_receivePacketCount;
 U8		_receivePacketType;
 UU32	_receivePacketSenderMAC;
 
@@ -101,6 +111,12 @@ void WriteU8ToUart(U8 val)
 	WriteCharToUart(val & 0x0F);
 }
 
+void WriteU16ToUart(U16 val)
+{
+	WriteU8ToUart(val >> 8);
+	WriteU8ToUart(val & 0xFF);
+}
+
 void WriteU32ToUart(UU32 val)
 {
 	int i;
@@ -175,6 +191,7 @@ void ATCommand(U8 commandNumber)
 	U8		retVal, bo;
 	U32		val32;
 	tOpenRFInitializer ini;
+	tModeLatency	latency;
 
 	switch (commandNumber)
 	{
@@ -286,11 +303,11 @@ void ATCommand(U8 commandNumber)
 			break;
 
 		case kGetRSSICommand:
-			WriteU8ToUart(RadioReadRSSIValue());
+			WriteU8ToUart(RadioReadRSSIValue(OpenRFGetRadio()));
 			break;
 
 		case kGetTemperatureCommand:
-			WriteU8ToUart(RadioGetTemperature());
+			WriteU8ToUart(RadioGetTemperature(OpenRFGetRadio()));
 			break;
 
 		case kGetPowerSupplyCommand:
@@ -345,7 +362,7 @@ void ATCommand(U8 commandNumber)
 			if (!IsATBufferNotEmpty())
 				WriteU8ToUart(_transmitPower);
 			else if (ReadU8FromUart(&_transmitPower))
-				RadioSetTxPower(_transmitPower);
+				RadioSetTxPower(OpenRFGetRadio(), _transmitPower);
 			break;
 
 		case kSetTimeReference:
@@ -415,6 +432,25 @@ void ATCommand(U8 commandNumber)
 			}
 			break;
 
+		case kGetModeLatency:
+			// ATML<mode> reports count,timeouts,min,max,average in uSec for transitions into that mode.  ATML clears them.
+			if (!IsATBufferNotEmpty())
+				RadioClearModeLatency(OpenRFGetRadio());
+			else if (ReadU8FromUart(&retVal) && retVal <= kReceiveMode)
+			{
+				RadioGetModeLatency(OpenRFGetRadio(), (tOperatingModes)retVal, &latency);
+				WriteU16ToUart(latency.Count);
+				WriteCharUART1(',');
+				WriteU16ToUart(latency.Timeouts);
+				WriteCharUART1(',');
+				WriteU16ToUart(latency.Minimum);
+				WriteCharUART1(',');
+				WriteU16ToUart(latency.Maximum);
+				WriteCharUART1(',');
+				WriteU16ToUart(latency.Count ? (U16)(latency.Total / latency.Count) : 0);
+			}
+			break;
+
 		case kNullCommand:
 			WriteCharUART1('O');
 			WriteCharUART1('K');
@@ -506,29 +542,58 @@ void PrintLine(const char *str)
 	WriteCharUART1('\r');
 }
 
-// Send a packet over the radio using UART1 received data
-void SendPacketFromUART1Data(void)
+// Send a packet over the radio using UART1 received data.  Returns zero, leaving the data in the UART buffer, if both
+// transmit buffers are still with the MAC.
+U8 SendPacketFromUART1Data(void)
 {
 	U8 i;
 	U8 count;
-	U8 buff[63];	// maximum size of packet is 63 bytes
+	U8 slot;
+	U8 *buffer;
+
+	for (slot = 0; slot < kTransmitBufferCount && _transmitBufferQueued[slot]; slot++)
+		;
+	if (slot == kTransmitBufferCount || !OpenRFReadyToSend())
+		return 0;
+	buffer = _transmitPacketDataBuffer[slot];
 
 	count = BufferCountUART1();
 
-	// never send more than the trigger level number of bytes
+	// never send more than the trigger level number of bytes, or more than fits in a packet
 	if (count > _transmitTriggerLevel)
 		count = _transmitTriggerLevel;
+	if (count > OpenRFMaxSDULength())
+		count = OpenRFMaxSDULength();
 
 	for (i = 0; i < count; i++)
-		buff[i] = ReadCharUART1();
-
-	// wait until we are in a state to send the packet.  We must call OpenRFLoop() continuously to update the internal state machine to ensure that
-	// ReadyToSend doesn't get stuck on a fail.
-	while (!OpenRFReadyToSend())
-		OpenRFLoop();
+		buffer[i] = ReadCharUART1();
 
 	// TODO: Set the preamable count
-	OpenRFSendPacket(_destinationAddress, _packetType, count, buff, 128);
+	_transmitBufferQueued[slot] = 1;
+	if (!OpenRFSendPacket(_destinationAddress, _packetType, count, buffer, 128, 0))
+		_transmitBufferQueued[slot] = 0;
+	return 1;
+}
+
+// Queue an IO slave response ahead of any UART data.  The flag is set first, as the response can be on the air and back
+// before OpenRFSendPacket returns.
+void SendResponse(U8 length)
+{
+	_responseQueued = 1;
+	if (!OpenRFSendPacket(_receivePacketSenderMAC, _packetType, length, _responseBuffer, 128, 1))
+		_responseQueued = 0;
+}
+
+// Hands a buffer back from the MAC
+void ReleaseTransmitBuffer(U8 *txBuffer)
+{
+	U8 i;
+
+	if (txBuffer == _responseBuffer)
+		_responseQueued = 0;
+	for (i = 0; i < kTransmitBufferCount; i++)
+		if (txBuffer == _transmitPacketDataBuffer[i])
+			_transmitBufferQueued[i] = 0;
 }
 
 /*****************************************************************************************************************************
@@ -537,8 +602,8 @@ void SendPacketFromUART1Data(void)
 int main(void)
 {
 	UU16 analogSample;
-	U8 byteCount, i;
-	U8 respBuffer[16];
+	U8 byteCount;
+	U16 i;
 	U8 digitalSample;
 
 	tOpenRFInitializer ini;
@@ -570,7 +635,8 @@ int main(void)
 		if (GpioRead(pinNetworkMode))
 		{
 			// Here, we are operating as an IO slave.  We will process requests from our master and sense/change our IO accordingly
-			if (_packetReceived)
+			// requests wait until the last response has gone out of _responseBuffer
+			if (_packetReceived && !_responseQueued)
 			{
 				_packetReceived = 0;
 				// the first byte is the command
@@ -578,21 +644,21 @@ int main(void)
 				{
 				case kReadAnalog:
 					byteCount = 1;
-					respBuffer[0] = NACK;
+					_responseBuffer[0] = NACK;
 					if ((_receivePacketDataBuffer[1] > 4) && (_receivePacketCount >= 2))
 					{
 						AnalogSetInputChannel(_receivePacketDataBuffer[1]);
 						analogSample.U16 = AnalogGet10BitResult();
-						respBuffer[0] = ACK;
-						respBuffer[1] = analogSample.U8[1];
-						respBuffer[2] = analogSample.U8[0];
+						_responseBuffer[0] = ACK;
+						_responseBuffer[1] = analogSample.U8[1];
+						_responseBuffer[2] = analogSample.U8[0];
 						byteCount = 3;
 					}
-					OpenRFSendPacket(_receivePacketSenderMAC, _packetType, byteCount, &respBuffer[0], 128);
+					SendResponse(byteCount);
 					break;
 				case kReadDigital:
 
-					respBuffer[0] = ACK;
+					_responseBuffer[0] = ACK;
 					if (_receivePacketCount >= 2)
 					{
 						byteCount = 2;
@@ -615,20 +681,20 @@ int main(void)
 							break;
 						default:
 							byteCount = 1;
-							respBuffer[0] = NACK;
+							_responseBuffer[0] = NACK;
 							break;
 						}
 					}
 					else
 					{
 						byteCount = 1;
-						respBuffer[0] = NACK;
+						_responseBuffer[0] = NACK;
 					}
-					respBuffer[1] = digitalSample;
-					OpenRFSendPacket(_receivePacketSenderMAC, _packetType, byteCount, &respBuffer[0], 128);
+					_responseBuffer[1] = digitalSample;
+					SendResponse(byteCount);
 					break;
 				case kSetDigital:
-					respBuffer[0] = ACK;
+					_responseBuffer[0] = ACK;
 					if (_receivePacketCount >= 2)
 					{
 						byteCount = 2;
@@ -651,35 +717,35 @@ int main(void)
 								break;
 							default:
 								byteCount = 1;
-								respBuffer[0] = NACK;
+								_responseBuffer[0] = NACK;
 						}
 					}
 					else
 					{
 						byteCount = 1;
-						respBuffer[0] = NACK;
+						_responseBuffer[0] = NACK;
 					}
-					respBuffer[1] = digitalSample;
-					OpenRFSendPacket(_receivePacketSenderMAC, _packetType, byteCount, &respBuffer[0], 128);
+					_responseBuffer[1] = digitalSample;
+					SendResponse(byteCount);
 					break;
 
 				case kSetDigitalTriggerCmd:
 					byteCount = 1;
 					if (_receivePacketDataBuffer[1] < 5 && _receivePacketCount >= 2)
 					{
-						respBuffer[1] = NACK;
+						_responseBuffer[1] = NACK;
 						_digitalTriggers[_receivePacketDataBuffer[1]] = _receivePacketDataBuffer[2];
 						byteCount = 2;
 					}
-					OpenRFSendPacket(_receivePacketSenderMAC, _packetType, byteCount, &respBuffer[0], 128);
+					SendResponse(byteCount);
 					break;
 
 				case kSetAnalogTriggerCmd:
 					byteCount = 1;
-					respBuffer[0] = NACK;
+					_responseBuffer[0] = NACK;
 					if (_receivePacketDataBuffer[1] < 6 && _receivePacketCount >= 2)
 					{
-						respBuffer[0] = ACK;
+						_responseBuffer[0] = ACK;
 						byteCount = 2;
 						// TODO: Check ...U8[1]
 						// _analogTriggers[_receivePacketDataBuffer[1]].U8[1] = _receivePacketDataBuffer[2];
@@ -687,11 +753,11 @@ int main(void)
 						_analogTriggers[_receivePacketDataBuffer[1]].U8[0] = _receivePacketDataBuffer[2];
 						_analogTriggers[_receivePacketDataBuffer[1]].U8[1] = _receivePacketDataBuffer[3];
 					}
-					OpenRFSendPacket(_receivePacketSenderMAC, _packetType, byteCount, &respBuffer[0], 128);
+					SendResponse(byteCount);
 					break;
 				default:
-					respBuffer[0] = NACK;
-					OpenRFSendPacket(_receivePacketSenderMAC, _packetType, 1, &respBuffer[0], 128);
+					_responseBuffer[0] = NACK;
+					SendResponse(1);
 					break;
 				}
 			}
@@ -722,9 +788,9 @@ int main(void)
 					}
 					if (_transmitTriggerTimerActive && _transmitTriggerTimer > _transmitTriggerTimeout)
 					{
-						SendPacketFromUART1Data();
-						// de-activate the timer
-						_transmitTriggerTimerActive = 0;
+						// de-activate the timer once the data is on its way
+						if (SendPacketFromUART1Data())
+							_transmitTriggerTimerActive = 0;
 					}
 				}
 			}
@@ -738,7 +804,7 @@ int main(void)
 extern void NotifyMacPacketReceived(
 	tPacketTypes packetType,
 	UU32 sourceMACAddress,
-	U8 length,
+	U16 length,
 	U8 xdata *SDU,
 	U8 rssi
 	)
@@ -760,12 +826,14 @@ void NotifyMac1Second()
 {
 }
 
-void NotifyMacPacketSent()
+void NotifyMacPacketSent(U8 *txBuffer)
 {
+	ReleaseTransmitBuffer(txBuffer);
 }
 
-void NotifyMacPacketSendError(tTransmitErrors error)
+void NotifyMacPacketSendError(U8 *txBuffer, tTransmitErrors error)
 {
+	ReleaseTransmitBuffer(txBuffer);
 }
 
 void NotifyMac1MilliSecond()
@@ -106,8 +106,8 @@ typedef enum
 // *****************************************
 // AT Commands
 
-#define kATCommandCount 24
-U8* atCommands[kATCommandCount] = {"SL","NA","DL","CN","RE","EK","BD","NB","SB","SS","TE","%V","VR","WS","RR","SP","TL","TT","GS","TP","TS","AR","AT","HT"};
+#define kATCommandCount 29
+U8* atCommands[kATCommandCount] = {"SL","NA","DL","CN","RE","EK","BD","NB","SB","SS","TE","%V","VR","WS","RR","SP","TL","TT","GS","TP","TS","AR","AT","HT","ML","HS","WN","ME","LQ"};
 // AT Commands
 enum
 {
@@ -135,6 +135,11 @@ enum
 	kGetSetAckRetriesCommand,
 	kGetSetAckTimeoutCommand,
 	kGetSetHopTable,
+	kGetModeLatency,
+	kGetHeaderSavings,
+	kGetSetWindow,
+	kGetSetMesh,
+	kGetLinkQuality,
 	kNullCommand = 0xff
 };
 
@@ -180,8 +185,17 @@ U16 _transmitTriggerTimer;
 U8 _transmitTriggerTimerActive =0;
 U8 _packetType=0;
 U8 _packetReceived = 0;
-U8 _receivePacketDataBuffer[63];
-U8 _receivePacketCount;
+// big enough for a fragmented SDU put back together by the MAC
+U8 _receivePacketDataBuffer[kReassemblyLength];
+// UART data goes out of these buffers in turn.  Each belongs to the MAC from OpenRFSendPacket until NotifyMacPacketSent or
+// NotifyMacPacketSendError hands it back, so some can fill while others are queued, on the air or waiting for a block ACK.
+#define kTransmitBufferCount 4
+U8 _transmitPacketDataBuffer[kTransmitBufferCount][kMaxSDULength];
+U8 _transmitBufferQueued[kTransmitBufferCount];
+// IO slave responses, queued the same way
+U8 _responseBuffer[16];
+U8 _responseQueued = 0;
+U16 _receivePacketCount;
 U8 _receivePacketType;
 UU32 _receivePacketSenderMAC;
 U8 _digitalTriggers[5];
@@ -193,6 +207,10 @@ U8 _quiet;
 U8 _ackRetries;
 U16 _ackTimeout;
 U8 _hopTable;
+// Selective repeat window for UART data, 0 for an ACK per packet
+U8 _arqWindow = 0;
+// non-zero while the module relays mesh frames for other nodes.  Packet type 6 sends UART data over the mesh.
+U8 _mesh = 0;
 extern UU32 _RTCDateTimeInSecs;
 // 0 = KRF-TC2
 // 1 = KRF-TCMP2
@@ -205,6 +223,13 @@ void WriteCharToUart(U8 ch)
 	else
 		WriteCharUART1(ch-10+'A');
 }
+void WriteU16ToUart(U16 val)
+{
+	WriteCharToUart(val>>12);
+	WriteCharToUart((val>>8)&0x0f);
+	WriteCharToUart((val>>4)&0x0f);
+	WriteCharToUart(val&0x0f);
+}
 void WriteU32ToUart(UU32 val)
 {
 	int i;
@@ -341,6 +366,10 @@ void ATCommand(U8 commandNumber)
 	UU32 val128[4];
 	U32 val32;
 	tOpenRFInitializer ini;
+	tModeLatency latency;
+	tHeaderStatistics headerStatistics;
+	tNeighbor neighbor;
+	UU32 uu32;
 	switch(commandNumber)
 	{
 	case kGetMACAddressCommand:
@@ -471,12 +500,14 @@ void ATCommand(U8 commandNumber)
 	case kGetSetStopBitsCommand:
 		break;
 	case kGetRSSICommand:
-		WriteCharToUart(RadioReadRSSIValue()>>4);
-		WriteCharToUart(RadioReadRSSIValue()&0xff);
+		// both characters have to come from the same reading
+		bo = RadioReadRSSIValue(OpenRFGetRadio());
+		WriteCharToUart(bo>>4);
+		WriteCharToUart(bo&0xff);
 		break;
 	case kGetTemperatureCommand:
-		WriteCharToUart(RadioGetTemperature()>>4);
-		WriteCharToUart(RadioGetTemperature()&0xff);
+		WriteCharToUart(RadioGetTemperature(OpenRFGetRadio())>>4);
+		WriteCharToUart(RadioGetTemperature(OpenRFGetRadio())&0xff);
 		break;
 	case kGetPowerSupplyCommand:
 		break;
@@ -546,7 +577,7 @@ void ATCommand(U8 commandNumber)
 		else
 		{
 			if(ReadU8FromUart(&_transmitPower))
-				RadioSetTxPower(_transmitPower);
+				RadioSetTxPower(OpenRFGetRadio(), _transmitPower);
 		}
 		break;
 	case kSetTimeReference:
@@ -635,6 +666,111 @@ void ATCommand(U8 commandNumber)
 
 		}
 		break;
+	case kGetModeLatency:
+		// ATML<mode> reports count,timeouts,min,max,average in uSec for transitions into that mode.  ATML clears them.
+		bo = IsATBufferNotEmpty();
+		if(!bo)
+		{
+			RadioClearModeLatency(OpenRFGetRadio());
+		}
+		else
+		{
+			if(ReadU8FromUart(&bo) && bo<=kReceiveMode)
+			{
+				RadioGetModeLatency(OpenRFGetRadio(), bo,&latency);
+				WriteU16ToUart(latency.Count);
+				WriteCharUART1(',');
+				WriteU16ToUart(latency.Timeouts);
+				WriteCharUART1(',');
+				WriteU16ToUart(latency.Minimum);
+				WriteCharUART1(',');
+				WriteU16ToUart(latency.Maximum);
+				WriteCharUART1(',');
+				WriteU16ToUart(latency.Count ? latency.Total/latency.Count : 0);
+			}
+		}
+		break;
+	case kGetHeaderSavings:
+		// ATHS<packet type> reports short frames,long frames,airtime saved in uSec for that type.  ATHS clears them.
+		bo = IsATBufferNotEmpty();
+		if(!bo)
+		{
+			RadioClearHeaderStatistics(OpenRFGetRadio());
+		}
+		else
+		{
+			if(ReadU8FromUart(&bo) && bo<=kAckPacketType)
+			{
+				RadioGetHeaderStatistics(OpenRFGetRadio(), (tPacketTypes)bo,&headerStatistics);
+				WriteU16ToUart(headerStatistics.ShortFrames);
+				WriteCharUART1(',');
+				WriteU16ToUart(headerStatistics.LongFrames);
+				WriteCharUART1(',');
+				uu32.U32 = headerStatistics.AirtimeSaved;
+				WriteU32ToUart(uu32);
+			}
+		}
+		break;
+	case kGetSetWindow:
+		// ATWN<n> sends UART data n packets per block ACK.  More than kTransmitBufferCount gains nothing.
+		bo = IsATBufferNotEmpty();
+		if(!bo)
+		{
+			WriteCharToUart(_arqWindow);
+		}
+		else
+		{
+			if(ReadU8FromUart(&bo) && bo<=kMaxArqWindow)
+				_arqWindow = bo;
+		}
+		break;
+	case kGetSetMesh:
+		// ATME1 joins the mesh, relaying for other nodes without involving the host, and ATME0 leaves it
+		bo = IsATBufferNotEmpty();
+		if(!bo)
+		{
+			WriteCharToUart(_mesh);
+		}
+		else
+		{
+			if(ReadU8FromUart(&bo) && bo<=1)
+			{
+				_mesh = bo;
+				OpenRFSetMesh(_mesh);
+			}
+		}
+		break;
+	case kGetLinkQuality:
+		// ATLQ reports a line per neighbour: mac,rssi,snr in dB,ACK percentage,seconds since heard (FFFFFFFF if never),
+		// frequency offset,frames heard,tries sent
+		retVal = 0;
+		for(bo=0;bo<kNeighborTableSize;bo++)
+		{
+			if(!OpenRFGetNeighbor(bo,&neighbor))
+				continue;
+			if(retVal++)
+				WriteCharUART1('\r');
+			WriteU32ToUart(neighbor.MacAddress);
+			WriteCharUART1(',');
+			WriteCharToUart(neighbor.Rssi>>4);
+			WriteCharToUart(neighbor.Rssi&0x0f);
+			WriteCharUART1(',');
+			WriteCharToUart(neighbor.Snr>>4);
+			WriteCharToUart(neighbor.Snr&0x0f);
+			WriteCharUART1(',');
+			WriteCharToUart(neighbor.AckRate>>4);
+			WriteCharToUart(neighbor.AckRate&0x0f);
+			WriteCharUART1(',');
+			uu32.U32 = neighbor.LastSeen ? _RTCDateTimeInSecs.U32 - neighbor.LastSeen : 0xFFFFFFFF;
+			WriteU32ToUart(uu32);
+			WriteCharUART1(',');
+			WriteU16ToUart((U16)neighbor.FrequencyOffset);
+			WriteCharUART1(',');
+			WriteU16ToUart(neighbor.RxCount);
+			WriteCharUART1(',');
+			WriteU16ToUart(neighbor.TxCount);
+		}
+		break;
 	case kNullCommand:
 		WriteCharUART1('O');
 		WriteCharUART1('K');
@@ -714,26 +850,56 @@ void PrintLine(U8 *str)
 	WriteCharUART1('\n');
 	WriteCharUART1('\r');
 }
-// Send a packet over the radio using UART1 received data
-void SendPacketFromUART1Data(void)
+// Send a packet over the radio using UART1 received data.  Returns zero, leaving the data in the UART buffer, if both
+// transmit buffers are still with the MAC.
+U8 SendPacketFromUART1Data(void)
 {
 	U8 i;
 	U8 count;
-	// maximum size of packet is 63 bytes
-	U8 buff[63];
+	U8 slot;
+	U8 *buffer;
 
+	for(slot=0;slot<kTransmitBufferCount && _transmitBufferQueued[slot];slot++)
+		;
+	if(slot==kTransmitBufferCount || !OpenRFReadyToSend())
+		return 0;
+	buffer = _transmitPacketDataBuffer[slot];
 	count = BufferCountUART1();
-	// never send more than the trigger level number of bytes
+	// never send more than the trigger level number of bytes, or more than fits in a packet
 	if(count>_transmitTriggerLevel)
 		count = _transmitTriggerLevel;
+	if(count>OpenRFMaxSDULength())
+		count = OpenRFMaxSDULength();
+	if(_packetType==kMeshPacketType && count>kMaxMeshSDULength)
+		count = kMaxMeshSDULength;
 	for(i=0;i<count;i++)
-		buff[i] = ReadCharUART1();
-	// wait until we are in a state to send the packet.  We must call OpenRFLoop() continuously to update the internal state machine to ensure that
-	// ReadyToSend doesn't get stuck on a fail.
-	while(!OpenRFReadyToSend())
-		OpenRFLoop();
+		buffer[i] = ReadCharUART1();
 	// TODO: Set the preamable count
-	OpenRFSendPacket(_destinationAddress,_packetType,count,buff,128);
+	_transmitBufferQueued[slot] = 1;
+	// the destination can change, and reinitializing OpenRF turns the window off
+	OpenRFSetWindow(_destinationAddress,_arqWindow);
+	if(!OpenRFSendPacket(_destinationAddress,_packetType,count,buffer,128,0))
+		_transmitBufferQueued[slot] = 0;
+	return 1;
+}
+// Queue an IO slave response ahead of any UART data.  The flag is set first, as the response can be on the air and back
+// before OpenRFSendPacket returns.
+void SendResponse(U8 length)
+{
+	_responseQueued = 1;
+	if(!OpenRFSendPacket(_receivePacketSenderMAC,_packetType,length,_responseBuffer,128,1))
+		_responseQueued = 0;
+}
+// Hands a buffer back from the MAC
+void ReleaseTransmitBuffer(U8 *txBuffer)
+{
+	U8 i;
+
+	if(txBuffer==_responseBuffer)
+		_responseQueued = 0;
+	for(i=0;i<kTransmitBufferCount;i++)
+		if(txBuffer==_transmitPacketDataBuffer[i])
+			_transmitBufferQueued[i] = 0;
 }
 
 
@@ -745,8 +911,8 @@ int main(void)
 
 	U16 ab;
 	UU16 analogSample;
-	U8 byteCount,i;
-	U8 respBuffer[16];
+	U8 byteCount;
+	U16 i;
 	U8 digitalSample;
 	U8 temp;
 	tOpenRFInitializer ini;
@@ -775,7 +941,8 @@ int main(void)
     	if(pinNetworkMode)
     	{
     		// Here, we are operating as an IO slave.  We will process requests from our master and sense/change our IO accordingly
-    		if(_packetReceived)
+    		// requests wait until the last response has gone out of _responseBuffer
+    		if(_packetReceived && !_responseQueued)
     		{
     			_packetReceived = 0;
     			// the first byte is the command
@@ -783,21 +950,21 @@ int main(void)
     			{
     			case kReadAnalog:
     				byteCount=1;
-					respBuffer[0] = NACK;
+					_responseBuffer[0] = NACK;
     				if( (_receivePacketDataBuffer[1]>4) && (_receivePacketCount>=2) )
     				{
 						AnalogSetInputChannel(_receivePacketDataBuffer[1]);
 						analogSample.U16 = AnalogGet10BitResult();
-						respBuffer[0] = ACK;
-						respBuffer[1] = analogSample.U8[1];
-						respBuffer[2] = analogSample.U8[0];
+						_responseBuffer[0] = ACK;
+						_responseBuffer[1] = analogSample.U8[1];
+						_responseBuffer[2] = analogSample.U8[0];
 						byteCount = 3;
     				}
-    				OpenRFSendPacket(_receivePacketSenderMAC,_packetType,byteCount,&respBuffer[0]);
+    				SendResponse(byteCount);
     				break;
     			case kReadDigital:
 
-    				respBuffer[0] = ACK;
+    				_responseBuffer[0] = ACK;
     				if( _receivePacketCount>=2)
     				{
     					byteCount = 2;
@@ -820,20 +987,20 @@ int main(void)
 							break;
 						default:
 							byteCount = 1;
-							respBuffer[0] = NACK;
+							_responseBuffer[0] = NACK;
 							break;
 						}
     				}
     				else
     				{
     					byteCount = 1;
-    					respBuffer[0] = NACK;
+    					_responseBuffer[0] = NACK;
     				}
-    				respBuffer[1] = digitalSample;
-    				OpenRFSendPacket(_receivePacketSenderMAC,_packetType,byteCount,&respBuffer[0]);
+    				_responseBuffer[1] = digitalSample;
+    				SendResponse(byteCount);
     				break;
     			case kSetDigital:
-    				respBuffer[0] = ACK;
+    				_responseBuffer[0] = ACK;
     				if( _receivePacketCount>=2)
     				{
     					byteCount = 2;
@@ -871,42 +1038,42 @@ int main(void)
 							break;
 						default:
 							byteCount = 1;
-							respBuffer[0] = NACK;
+							_responseBuffer[0] = NACK;
 						}
     				}
     				else
     				{
     					byteCount = 1;
-    					respBuffer[0] = NACK;
+    					_responseBuffer[0] = NACK;
     				}
-    				respBuffer[1] = digitalSample;
-    				OpenRFSendPacket(_receivePacketSenderMAC,_packetType,byteCount,&respBuffer[0]);
+    				_responseBuffer[1] = digitalSample;
+    				SendResponse(byteCount);
     				break;
     			case kSetDigitalTriggerCmd:
     				byteCount=1;
 					if( (_receivePacketDataBuffer[1]<5) && (_receivePacketCount>=2) )
 					{
-						respBuffer[1] = NACK;
+						_responseBuffer[1] = NACK;
 						_digitalTriggers[_receivePacketDataBuffer[1]] = _receivePacketDataBuffer[2];
 						byteCount = 2;
 					}
-    				OpenRFSendPacket(_receivePacketSenderMAC,_packetType,byteCount,&respBuffer[0]);
+    				SendResponse(byteCount);
     				break;
     			case kSetAnalogTriggerCmd:
     				byteCount=1;
-					respBuffer[0] = NACK;
+					_responseBuffer[0] = NACK;
 					if( (_receivePacketDataBuffer[1]<6) && (_receivePacketCount>=2) )
 					{
-						respBuffer[0] = ACK;
+						_responseBuffer[0] = ACK;
 						byteCount = 2;
 						_analogTriggers[_receivePacketDataBuffer[1]].U8[1] = _receivePacketDataBuffer[2];
 						_analogTriggers[_receivePacketDataBuffer[1]].U8[2] = _receivePacketDataBuffer[3];
 					}
-    				OpenRFSendPacket(_receivePacketSenderMAC,_packetType,byteCount,&respBuffer[0]);
+    				SendResponse(byteCount);
     				break;
     			default:
-					respBuffer[0] = NACK;
-    				OpenRFSendPacket(_receivePacketSenderMAC,_packetType,1,&respBuffer[0]);
+					_responseBuffer[0] = NACK;
+    				SendResponse(1);
     				break;
     			}
     		}
@@ -943,10 +1110,9 @@ int main(void)
     				if(_transmitTriggerTimerActive)
     					if(_transmitTriggerTimer>_transmitTriggerTimeout)
     					{
-    						SendPacketFromUART1Data();
-
-    						// de-activate the timer
-    						_transmitTriggerTimerActive = 0;
+    						// de-activate the timer once the data is on its way
+    						if(SendPacketFromUART1Data())
+    							_transmitTriggerTimerActive = 0;
     					}
     			}
     		}
@@ -960,7 +1126,7 @@ int main(void)
 /*****************************************************************************************************************************
  ** 		EVENT HANDLERS																									**
  *****************************************************************************************************************************/
-extern void NotifyMacPacketReceived(tPacketTypes packetType,UU32 sourceMACAddress,U8 length, U8 xdata *SDU, U8 rssi)
+extern void NotifyMacPacketReceived(tPacketTypes packetType,UU32 sourceMACAddress,U16 length, U8 xdata *SDU, U8 rssi)
 {
 	int i;
 	for(i=0;i<length;i++)
@@ -977,13 +1143,13 @@ extern void NotifyMacReceiveError()
 extern void NotifyMac1Second()
 {
 }
-extern void NotifyMacPacketSent()
+extern void NotifyMacPacketSent(U8 *txBuffer)
 {
-
+	ReleaseTransmitBuffer(txBuffer);
 }
-extern void NotifyMacPacketSendError(tTransmitErrors error)
+extern void NotifyMacPacketSendError(U8 *txBuffer, tTransmitErrors error)
 {
-
+	ReleaseTransmitBuffer(txBuffer);
 }
 extern void NotifyMac1MilliSecond()
 {
@@ -1,4 +1,5 @@
 #include "microapi.h"
+#include "em_device.h"
 #include "../../Radio/SX1231/radioapi.h"
 
 // Global Variables
@@ -136,7 +137,7 @@ void WriteCharSPI(U8 reg, U8 value)
 	}
 	GpioSet(NSSpin);
 }
-void WriteCharSPIMultiple (U8 count, U8 reg,  U8 *addr)
+void WriteCharSPIMultiple(U8 reg, U8 count, U8 *buffer)
 {
 	U8 waitTime = 0xFF;
 	// make sure MSB is high for write
@@ -151,7 +152,7 @@ void WriteCharSPIMultiple (U8 count, U8 reg,  U8 *addr)
 	// CSIIF00 = 0U;	/* clear INTCSI00 interrupt flag */
 	while(count-- != 0)
 	{
-		// SIO00 = *(addr++);
+		// SIO00 = *(buffer++);
 		waitTime = 0xff;
 		while (0)	// !CSIIF00)
 		{
@@ -337,13 +338,36 @@ void AnalogSetInputChannel(U8 channel)
 
 void StartIntervalTimer()
 {
-	// Enable the timer and set interval to 1 msec
+	// SysTick runs from the core clock and interrupts every msec.  GetMicroseconds reads it between interrupts.
+	SysTick->LOAD = SystemCoreClockGet() / 1000 - 1;
+	SysTick->VAL = 0;
+	SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk;
 }
 
 void StopIntervalTimer()
 {
-	// disable the interrupt
-	// disable the timer
+	SysTick->CTRL = 0;
+}
+
+// Counted by SysTick_Handler
+U32 _milliseconds = 0;
+
+U32 GetMicroseconds(void)
+{
+	U32 milliseconds, count, load;
+
+	load = SysTick->LOAD;
+	// the msec count can change under us if SysTick fires, so read until we get a consistent pair
+	do
+	{
+		milliseconds = _milliseconds;
+		count = SysTick->VAL;
+	} while (milliseconds != _milliseconds);
+	// the counter reloaded but SysTick has not been serviced yet (interrupts are off or we are in another ISR)
+	if ((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) && count > load / 2)
+		milliseconds++;
+	// SysTick counts down from LOAD to 0 once per msec
+	return milliseconds * 1000 + (load - count) * 1000 / (load + 1);
 }
 
 // *****************************************************************************
@@ -465,6 +489,18 @@ void DisableIntP1()
 {
 	// TODO:  Set the correct flag
 }
+void EnableIntP3()
+{
+}
+void DisableIntP3()
+{
+}
+void EnableIntP5()
+{
+}
+void DisableIntP5()
+{
+}
 
 UU32 _RTCDateTimeInSecs;
 U8 _RTCSeconds = 0;
@@ -508,5 +544,6 @@ void GPIO_EVEN_IRQHandler(void)
 
 void SysTick_Handler(void)
 {
+	_milliseconds++;
 	Handle1MsInterrupt();
 }
@@ -209,6 +209,11 @@ void StartIntervalTimer(void);
  */
 void StopIntervalTimer(void);
 
+/*! \details Gets the free running microsecond counter.  Only differences between two readings are meaningful.
+ *  \return Microseconds
+ */
+U32 GetMicroseconds(void);
+
 /*! \details Resets the radio by bringing the reset pin high for a period and then low
  *
  */
@@ -333,6 +338,26 @@ void EnableIntP1(void);
  */
 void DisableIntP1(void);
 
+/*! \details Enables INTP3
+ *
+ */
+void EnableIntP3(void);
+
+/*! \details Disables INTP3
+ *
+ */
+void DisableIntP3(void);
+
+/*! \details Enables INTP5
+ *
+ */
+void EnableIntP5(void);
+
+/*! \details Disables INTP5
+ *
+ */
+void DisableIntP5(void);
+
 #define INITIALIZEDVALUE 0x55
 
 #define NOP()	__nop()
@@ -195,7 +195,12 @@ void INT_IICA0 (void) { }
 /*
  * INT_TM00 (0x2C)
  */
-void INT_TM00 (void) { }
+// upper 16 bits of the microsecond counter returned by GetMicroseconds()
+U16 _microsecondOverflows = 0;
+void INT_TM00 (void)
+{
+	_microsecondOverflows++;
+}
 
 /*
  * INT_TM01 (0x2E)
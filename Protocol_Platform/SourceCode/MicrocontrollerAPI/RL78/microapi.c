@@ -68,6 +68,22 @@ void InitializeTimers()
     RTCPR1 = 0U;
     RTCPR0 = 0U;
     RTCC0 = 0x01;
+
+    // Setup TAU0 channel 0 as a free running microsecond counter.  CK00 = fCLK/8 = 1MHz and the channel counts down from
+    // 0xFFFF, so INTTM00 fires every 65.536 mSec and is used to extend the count to 32 bits.
+    TAU0EN = 1U;
+    TPS0 = (TPS0 & 0xFFF0) | 0x0003;
+    TT0 |= 0x0001;
+    TMMK00 = 1U;
+    TMIF00 = 0U;
+    /* Set INTTM00 low priority */
+    TMPR100 = 1U;
+    TMPR000 = 1U;
+    TMR00 = 0x0000;
+    TDR00 = 0xFFFF;
+    TMIF00 = 0U;
+    TMMK00 = 0U;
+    TS0 |= 0x0001;
 }
 void InitializePorts()
 {
@@ -311,11 +327,17 @@ void InitializeInterrupts()
     /* Set INTP2 low priority */
     PPR12 = 1U;
     PPR02 = 1U;
-    /* Set INTP3 low priority */
-    PPR13 = 1U;
-    PPR03 = 1U;
+    // INTP3 timestamps the radio's sync word, so it goes first when it is pending alongside the others
+    PPR13 = 0U;
+    PPR03 = 0U;
+    /* Set INTP5 low priority */
+    PPR15 = 1U;
+    PPR05 = 1U;
     EGP0 = _01_INTP0_EDGE_RISING_SEL | _02_INTP1_EDGE_RISING_SEL | _04_INTP2_EDGE_RISING_SEL |
-           _08_INTP3_EDGE_RISING_SEL;
+           _08_INTP3_EDGE_RISING_SEL | _20_INTP5_EDGE_RISING_SEL;
+    // INTP1 carries the radio's FifoLevel while a long frame is streamed.  It is refilled on the falling edge and drained on the
+    // rising edge, so both are needed.
+    EGN0 = _02_INTP1_EDGE_FALLING_SEL;
     // Set INTP0 pin
 
     /* Set INTP1 pin */
@@ -470,7 +492,9 @@ U8 InitializeMicroAPI(void)
 	InitializePorts();
 	InitializeClock();
 	InitializeSPI();
-	//InitializeSPI2();
+#ifdef RADIO_SPI2
+	InitializeSPI2();
+#endif
 	/*
 	InitializeIIC();
 	InitializeInterrupts();
@@ -560,29 +584,34 @@ void WriteCharSPI(U8 reg, U8 value)
    DisableSPI();
    NSSpin = HIGH;
 }
-void WriteCharSPIMultiple (U8 count, U8 reg,  U8 *addr)
+void WriteCharSPIMultiple(U8 reg, U8 count, U8 *buffer)
 {
-   U8 waitTime = 0xff;
+   U16 waitTime = 0xffff;
    // make sure MSB is high for write
    reg|=0x80;
+   // NSS stays low for the address byte and every data byte so the radio auto-increments (or streams the FIFO)
    NSSpin = LOW;
+   EnableSPI();
    SIO00 = reg;
    while(!CSIIF00)
    {
-	   while(waitTime--)
-		   return;
+	   waitTime--;
+	   if(waitTime==0)
+		   break;
    }
-   CSIIF00 = 0U;    /* clear INTCSI00 interrupt flag */
-   while(count--)
+   DisableSPI();
+   while(count-- && waitTime)
    {
-	   SIO00 = *(addr++);
-	   waitTime = 0xff;
+	   EnableSPI();
+	   SIO00 = *(buffer++);
+	   waitTime = 0xffff;
 	   while(!CSIIF00)
 	   {
-		   while(waitTime--)
-			   return;
+		   waitTime--;
+		   if(waitTime==0)
+			   break;
 	   }
-	    CSIIF00 = 0U;    /* clear INTCSI00 interrupt flag */
+	   DisableSPI();
    }
    NSSpin = HIGH;
 }
@@ -591,25 +620,30 @@ void ReadCharSPIMultiple(U8 address, U8 count, U8 *receiveBuffer)
 	U8 waitTime = 0xff;
 	// make sure MSB is low for read
 	address&=0x7f;
+	// NSS stays low for the address byte and every data byte so the radio auto-increments (or streams the FIFO)
 	NSSpin = LOW;
+	EnableSPI();
 	SIO00 = address;
 	while(!CSIIF00)
 	{
-	   while(waitTime--)
-		   return;
+		waitTime--;
+		if(waitTime==0)
+			break;
 	}
-    CSIIF00 = 0U;    /* clear INTCSI00 interrupt flag */
-	while(count--)
+	DisableSPI();
+	while(count-- && waitTime)
 	{
+		EnableSPI();
 		SIO00 = 0x55;
 		waitTime = 0xff;
 		while(!CSIIF00)
 		{
-		   while(waitTime--)
-			   return;
+			waitTime--;
+			if(waitTime==0)
+				break;
 		}
-	    CSIIF00 = 0U;    /* clear INTCSI00 interrupt flag */
-		*(receiveBuffer++) = SIO20;
+		DisableSPI();
+		*(receiveBuffer++) = SIO00;
 	}
 	NSSpin = HIGH;
 }
@@ -683,60 +717,68 @@ void WriteCharSPI2(U8 reg, U8 value)
    // Put nothing else here.  No checks, no extra code, nothing.  It will interfere with the modes.
    return;
 }
-void WriteCharSPI2Multiple (U8 count, U8 reg,  U8 *addr)
+void WriteCharSPIMultiple2(U8 reg, U8 count, U8 *buffer)
 {
-   U8 waitTime = 0xff;
+   U16 waitTime = 0xffff;
    // make sure MSB is high for write
    reg|=0x80;
-   NSSpin = LOW;
+   // NSS stays low for the address byte and every data byte so the radio auto-increments (or streams the FIFO)
+   NSS2pin = LOW;
+   EnableSPI2();
    SIO20 = reg;
    while(!CSIIF20)
    {
-	   while(waitTime--)
-		   return;
+	   waitTime--;
+	   if(waitTime==0)
+		   break;
    }
-   CSIIF20 = 0U;    /* clear INTCSI00 interrupt flag */
-   while(count--)
+   DisableSPI2();
+   while(count-- && waitTime)
    {
-	   SIO20 = *(addr++);
-	   waitTime = 0xff;
+	   EnableSPI2();
+	   SIO20 = *(buffer++);
+	   waitTime = 0xffff;
 	   while(!CSIIF20)
 	   {
-		   while(waitTime--)
-			   return;
+		   waitTime--;
+		   if(waitTime==0)
+			   break;
 	   }
-	    CSIIF20 = 0U;    /* clear INTCSI00 interrupt flag */
+	   DisableSPI2();
    }
-   NSSpin = HIGH;
-   return;
+   NSS2pin = HIGH;
 }
-void ReadSPI2Multiple(U8 address, U8 count, U8 *receiveBuffer)
+void ReadCharSPIMultiple2(U8 address, U8 count, U8 *receiveBuffer)
 {
 	U8 waitTime = 0xff;
 	// make sure MSB is low for read
 	address&=0x7f;
-	NSSpin = LOW;
+	// NSS stays low for the address byte and every data byte so the radio auto-increments (or streams the FIFO)
+	NSS2pin = LOW;
+	EnableSPI2();
 	SIO20 = address;
 	while(!CSIIF20)
 	{
-	   while(waitTime--)
-		   return;
+		waitTime--;
+		if(waitTime==0)
+			break;
 	}
-    CSIIF20 = 0U;    /* clear INTCSI00 interrupt flag */
-	while(count--)
+	DisableSPI2();
+	while(count-- && waitTime)
 	{
+		EnableSPI2();
 		SIO20 = 0x55;
 		waitTime = 0xff;
 		while(!CSIIF20)
 		{
-		   while(waitTime--)
-			   return;
+			waitTime--;
+			if(waitTime==0)
+				break;
 		}
-	    CSIIF20 = 0U;    /* clear INTCSI00 interrupt flag */
+		DisableSPI2();
 		*(receiveBuffer++) = SIO20;
 	}
-	NSSpin = HIGH;
-	return;
+	NSS2pin = HIGH;
 }
 // *****************************************************************************
 // ** UART0
@@ -1122,6 +1164,25 @@ void StopIntervalTimer()
 	// disable the timer
 	ITMC &= 0x8000;
 }
+// Maintained by INT_TM00 each time TAU0 channel 0 wraps
+extern U16 _microsecondOverflows;
+U32 GetMicroseconds()
+{
+	U16 high, count;
+	U8 pending;
+
+	// the overflow count can change under us if INTTM00 fires, so read until we get a consistent pair
+	do
+	{
+		high = _microsecondOverflows;
+		count = TCR00;
+		pending = TMIF00;
+	} while (high != _microsecondOverflows);
+	// the counter wrapped but INTTM00 has not been serviced yet (interrupts are off or we are in another ISR)
+	if (pending && count > 0x8000)
+		high++;
+	return ((U32)high << 16) | (U16)(0xFFFF - count);
+}
 // *****************************************************************************
 // ** Radio IO
 
@@ -1317,11 +1378,25 @@ void DisableIntP0()
 }
 void EnableIntP1()
 {
-	// TODO:  Clear the correct flag
-	PMK0 = 0;
+	PMK1 = 0;
 }
 void DisableIntP1()
 {
-	// TODO:  Set the correct flag
-	PMK0 = 1;
+	PMK1 = 1;
+}
+void EnableIntP3()
+{
+	PMK3 = 0;
+}
+void DisableIntP3()
+{
+	PMK3 = 1;
+}
+void EnableIntP5()
+{
+	PMK5 = 0;
+}
+void DisableIntP5()
+{
+	PMK5 = 1;
 }
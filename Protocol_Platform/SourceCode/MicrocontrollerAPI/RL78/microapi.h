@@ -236,6 +236,11 @@ void StartIntervalTimer();
  * \return none
  */
 void StopIntervalTimer();
+/*! \details Gets the free running microsecond counter.  The count wraps roughly every 71 minutes, so only differences
+ *  between two readings are meaningful.  Safe to call from an ISR.
+ *  \return Microseconds
+ */
+U32 GetMicroseconds();
 /*! \details Resets the radio by bringing the reset pin high for a period and then low
  *
  */
@@ -338,6 +343,22 @@ void EnableIntP1();
  *
  */
 void DisableIntP1();
+/*! \details Enables INTP3
+ *
+ */
+void EnableIntP3();
+/*! \details Disables INTP3
+ *
+ */
+void DisableIntP3();
+/*! \details Enables INTP5
+ *
+ */
+void EnableIntP5();
+/*! \details Disables INTP5
+ *
+ */
+void DisableIntP5();
 
 
 
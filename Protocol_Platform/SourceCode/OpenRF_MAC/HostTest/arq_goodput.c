@@ -0,0 +1,204 @@
+// Goodput of UniAck transfers between two nodes against the selective repeat window, over a link that drops frames at
+// random.  Node 0 keeps kBuffers packets of kSduLength bytes queued for node 1, which checks they arrive whole, once
+// each and in order.  Window 0 is an ACK per packet.  The radio is the frame level stand-in of simradio.c: 38.4kbps,
+// 600uSec to get to TX, AES off, and every frame, ACKs included, lost with the same probability.
+//
+// Build and run from this directory:
+//		gcc -Wall -o arq_goodput arq_goodput.c simradio.c ../../Radio/SX1231/HostTest/hostapi.c && ./arq_goodput
+// Returns non zero if a packet is delivered twice, out of order or damaged, a packet is reported sent but never arrives
+// or never comes back at all, anything fails on a clean link, or windowing does not beat an ACK per packet on a clean
+// link.
+
+#include <stdio.h>
+#include "simradio.h"
+
+#define kPackets		1000
+#define kBuffers		kMaxMessageQueueSize
+#define kSduLength		60
+#define kAckTimeout		15
+#define kAckRetries		5
+// Give up on a run that has not finished by then, in uSec
+#define kRunLimit		600000000UL
+
+U8 _buffers[kBuffers][kSduLength];
+U8 _busy[kBuffers];
+U16 _queued;
+U16 _delivered;
+U16 _sent;
+U16 _failed;
+U16 _expected;
+U16 _damaged;
+U16 _disordered;
+int _failures;
+
+void FillPacket(U8 *buffer, U16 number)
+{
+	U8 i;
+
+	buffer[0] = (U8)number;
+	buffer[1] = (U8)(number >> 8);
+	for (i = 2; i < kSduLength; i++)
+		buffer[i] = (U8)(number * 7 + i);
+}
+
+void ReleaseBuffer(U8 *txBuffer)
+{
+	U8 i;
+
+	for (i = 0; i < kBuffers; i++)
+		if (txBuffer == _buffers[i])
+			_busy[i] = 0;
+}
+
+U8 SimInRange(U8 from, U8 to)
+{
+	return 1;
+}
+
+// Node 0 queues packets as fast as the MAC takes them
+void SimApplication(U8 node)
+{
+	U8 i;
+
+	if (node != 0)
+		return;
+	for (i = 0; i < kBuffers && _queued < kPackets; i++)
+	{
+		if (_busy[i])
+			continue;
+		FillPacket(_buffers[i], _queued);
+		if (!OpenRFSendPacket(SimMacAddress(1), kUniAckPacketType, kSduLength, _buffers[i], 4 << 8, 0))
+			break;
+		_busy[i] = 1;
+		_queued++;
+	}
+	if (_sent + _failed == kPackets)
+		SimStop();
+}
+
+void NotifyMacPacketReceived(tPacketTypes packetType, UU32 sourceMACAddress, U16 length, U8 *SDU, U8 rssi)
+{
+	U16 number;
+	U8 i;
+
+	if (_simNode != 1)
+		return;
+	number = SDU[0] | (SDU[1] << 8);
+	for (i = 2; i < kSduLength; i++)
+		if (SDU[i] != (U8)(number * 7 + i))
+			break;
+	if (length != kSduLength || i < kSduLength)
+		_damaged++;
+	// packets that failed leave gaps, but nothing comes twice or goes backwards
+	if (number < _expected)
+		_disordered++;
+	_expected = number + 1;
+	_delivered++;
+	// the radio sleeps to hand a packet up, and it is up to the application to listen again
+	OpenRFListenForPacket(kContinuous, 0);
+}
+
+void NotifyMacPacketSent(U8 *txBuffer)
+{
+	ReleaseBuffer(txBuffer);
+	_sent++;
+}
+
+void NotifyMacPacketSendError(U8 *txBuffer, tTransmitErrors error)
+{
+	ReleaseBuffer(txBuffer);
+	_failed++;
+}
+
+void NotifyMacReceiveError(void)
+{
+}
+
+void NotifyMac1Second(void)
+{
+}
+
+void NotifyMac1MilliSecond(void)
+{
+}
+
+void Check(int condition, const char *what, U8 window, U8 lossPercent)
+{
+	if (condition)
+		return;
+	printf("FAIL: %s, window %u, %u%% loss\n", what, window, lossPercent);
+	_failures++;
+}
+
+// Sends kPackets packets and returns the goodput in kbps
+double Transfer(U8 window, U8 lossPercent)
+{
+	tOpenRFInitializer ini = { 0 };
+	U8 i, node;
+
+	ini.AckTimeout = kAckTimeout;
+	ini.AckRetries = kAckRetries;
+	ini.DataRate = k38400BPS;
+	SimInitialize(2, &ini, (U16)(lossPercent * 65536UL / 100), 1);
+	for (node = 0; node < 2; node++)
+	{
+		SimSelect(node);
+		RadioSetEncryption(OpenRFGetRadio(), 0);
+		OpenRFListenForPacket(kContinuous, 0);
+	}
+	SimSelect(0);
+	OpenRFSetWindow(SimMacAddress(1), window);
+	for (i = 0; i < kBuffers; i++)
+		_busy[i] = 0;
+	_queued = 0;
+	_delivered = 0;
+	_sent = 0;
+	_failed = 0;
+	_expected = 0;
+	_damaged = 0;
+	_disordered = 0;
+
+	SimRun(kRunLimit);
+
+	// a window given up on may still have reached the receiver, with only its block ACKs lost
+	Check(_sent + _failed == kPackets, "packets never handed back", window, lossPercent);
+	Check(_delivered >= _sent, "packets reported sent that never arrived", window, lossPercent);
+	Check(_damaged == 0, "damaged packets delivered", window, lossPercent);
+	Check(_disordered == 0, "packets delivered twice or out of order", window, lossPercent);
+	Check(lossPercent || _failed == 0, "packets failed on a clean link", window, lossPercent);
+	return _delivered * kSduLength * 8.0 / (SimTime() / 1000.0);
+}
+
+int main(void)
+{
+	const U8 windows[] = { 0, 1, 2, 4, 8 };
+	const U8 losses[] = { 0, 10, 30 };
+	double goodput[sizeof(losses)][sizeof(windows)];
+	U16 failed[sizeof(windows)];
+	U8 l, w;
+
+	printf("%d packets of %d bytes at 38.4kbps, goodput in kbps\n", kPackets, kSduLength);
+	printf("loss  ");
+	for (w = 0; w < sizeof(windows); w++)
+		printf(windows[w] ? "  window %u" : "  ACK each", windows[w]);
+	printf("\n");
+	for (l = 0; l < sizeof(losses); l++)
+	{
+		printf("%3u%%  ", losses[l]);
+		for (w = 0; w < sizeof(windows); w++)
+		{
+			goodput[l][w] = Transfer(windows[w], losses[l]);
+			failed[w] = _failed;
+			printf("  %8.1f", goodput[l][w]);
+		}
+		printf("\n failed");
+		for (w = 0; w < sizeof(windows); w++)
+			printf("  %8u", failed[w]);
+		printf("\n");
+	}
+	for (w = 2; w < sizeof(windows); w++)
+		Check(goodput[0][w] > goodput[0][0], "window slower than an ACK per packet", windows[w], 0);
+
+	printf(_failures ? "%d checks failed\n" : "all checks passed\n", _failures);
+	return _failures ? 1 : 0;
+}
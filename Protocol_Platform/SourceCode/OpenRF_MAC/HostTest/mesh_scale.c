@@ -0,0 +1,227 @@
+// Delivery and latency of mesh packets across a grid of nodes all reporting to one sink.  Nodes sit one unit apart
+// and hear the eight around them, so node 0 in the corner is as many hops from a node as the node's row or column,
+// whichever is further.  Every other node sends a kSduLength byte kMeshPacketType packet to node 0 about every
+// kReportPeriod seconds, at random, and stops kDrainTime seconds before the end so the last ones can arrive.  Routes
+// are found by the MAC, and the route tables are smaller than the network.  The radio is the frame level stand-in of
+// simradio.c at 38.4kbps, with every frame a node hears dropped with the probability given.
+//
+// Build and run from this directory:
+//		gcc -Wall -O2 -o mesh_scale mesh_scale.c simradio.c ../../Radio/SX1231/HostTest/hostapi.c && ./mesh_scale
+// Optional arguments: width height loss% seconds.  The default is 11 by 10 nodes, 5% loss, 300 seconds.
+// Returns non zero if the sink gets a packet twice or damaged, a packet is never handed back to its sender, or fewer
+// than kMinDelivery percent of the packets sent arrive.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "simradio.h"
+
+#define kSduLength		20
+#define kReportPeriod	30
+#define kDrainTime		20
+#define kMinDelivery	75
+#define kMaxHops		16
+
+U8 _width;
+U8 _height;
+U32 _end;
+U32 _nextReport[kSimMaxNodes];
+U8 _buffers[kSimMaxNodes][kSduLength];
+U8 _busy[kSimMaxNodes];
+U16 _sequence[kSimMaxNodes];
+S32 _lastHeard[kSimMaxNodes];
+U32 _sent[kMaxHops];
+U32 _delivered[kMaxHops];
+U32 _failed[kMaxHops];
+U32 _forwarded;
+U32 _refused;
+U32 _skipped;
+U32 _damaged;
+U32 _repeated;
+U32 _errors[kUndefined + 1];
+double _latency[kMaxHops];
+double _maxLatency[kMaxHops];
+int _failures;
+
+U8 Hops(U8 node)
+{
+	U8 x, y;
+
+	x = node % _width;
+	y = node / _width;
+	return (x > y) ? x : y;
+}
+
+U8 SimInRange(U8 from, U8 to)
+{
+	return abs(from % _width - to % _width) <= 1 && abs(from / _width - to / _width) <= 1;
+}
+
+// Gets the next report ready: [sequence:16][send time:32][pattern]
+void SimApplication(U8 node)
+{
+	U8 *buffer, i;
+	U32 now;
+
+	now = SimTime();
+	if (node == 0 || now < _nextReport[node] || now >= _end - kDrainTime * 1000000UL)
+		return;
+	_nextReport[node] += (U32)kReportPeriod * 1000000UL / 2
+		+ (U32)(((unsigned long long)kReportPeriod * 1000000UL * SimRandom()) >> 16);
+	if (_busy[node])
+	{
+		_skipped++;
+		return;
+	}
+	buffer = _buffers[node];
+	_sequence[node]++;
+	buffer[0] = (U8)_sequence[node];
+	buffer[1] = (U8)(_sequence[node] >> 8);
+	for (i = 0; i < 4; i++)
+		buffer[2 + i] = (U8)(now >> (8 * i));
+	for (i = 6; i < kSduLength; i++)
+		buffer[i] = (U8)(node + i);
+	if (!OpenRFSendPacket(SimMacAddress(0), kMeshPacketType, kSduLength, buffer, 4 << 8, 0))
+	{
+		_refused++;
+		return;
+	}
+	_busy[node] = 1;
+	_sent[Hops(node)]++;
+}
+
+void NotifyMacPacketReceived(tPacketTypes packetType, UU32 sourceMACAddress, U16 length, U8 *SDU, U8 rssi)
+{
+	U8 origin, hops, i;
+	U16 sequence;
+	U32 sent;
+	double latency;
+
+	OpenRFListenForPacket(kContinuous, 0);
+	origin = SimNodeOf(sourceMACAddress);
+	if (_simNode != 0 || packetType != kMeshPacketType || origin >= kSimMaxNodes)
+		return;
+	for (i = 6; i < kSduLength; i++)
+		if (SDU[i] != (U8)(origin + i))
+			break;
+	if (length != kSduLength || i < kSduLength)
+	{
+		_damaged++;
+		return;
+	}
+	sequence = SDU[0] | (SDU[1] << 8);
+	if (sequence <= _lastHeard[origin])
+	{
+		_repeated++;
+		return;
+	}
+	_lastHeard[origin] = sequence;
+	sent = SDU[2] | (SDU[3] << 8) | ((U32)SDU[4] << 16) | ((U32)SDU[5] << 24);
+	hops = Hops(origin);
+	latency = (SimTime() - sent) / 1000.0;
+	_delivered[hops]++;
+	_latency[hops] += latency;
+	if (latency > _maxLatency[hops])
+		_maxLatency[hops] = latency;
+}
+
+// A mesh packet comes back once the first hop has ACKed it.  Anything lost further on is not reported.
+void NotifyMacPacketSent(U8 *txBuffer)
+{
+	_busy[_simNode] = 0;
+	_forwarded++;
+}
+
+void NotifyMacPacketSendError(U8 *txBuffer, tTransmitErrors error)
+{
+	_busy[_simNode] = 0;
+	_failed[Hops(_simNode)]++;
+	_errors[error]++;
+}
+
+void NotifyMacReceiveError(void)
+{
+}
+
+void NotifyMac1Second(void)
+{
+}
+
+void NotifyMac1MilliSecond(void)
+{
+}
+
+void Check(int condition, const char *what)
+{
+	if (condition)
+		return;
+	printf("FAIL: %s\n", what);
+	_failures++;
+}
+
+int main(int argc, char **argv)
+{
+	tOpenRFInitializer ini = { 0 };
+	U32 sent, delivered, failed, busy, seconds;
+	U8 node, hops, lossPercent;
+
+	_width = (argc > 1) ? atoi(argv[1]) : 11;
+	_height = (argc > 2) ? atoi(argv[2]) : 10;
+	lossPercent = (argc > 3) ? atoi(argv[3]) : 5;
+	seconds = (argc > 4) ? atoi(argv[4]) : 300;
+	if (_width * _height > kSimMaxNodes || _width * _height < 2 || seconds <= kDrainTime)
+	{
+		printf("up to %d nodes, and more than %d seconds\n", kSimMaxNodes, kDrainTime);
+		return 1;
+	}
+	_end = seconds * 1000000UL;
+
+	ini.AckTimeout = 20;
+	ini.AckRetries = 4;
+	ini.DataRate = k38400BPS;
+	SimInitialize(_width * _height, &ini, (U16)(lossPercent * 65536UL / 100), 7);
+	for (node = 0; node < _width * _height; node++)
+	{
+		SimSelect(node);
+		OpenRFSetMesh(1);
+		OpenRFListenForPacket(kContinuous, 0);
+		_nextReport[node] = (U32)(((unsigned long long)kReportPeriod * 1000000UL * SimRandom()) >> 16);
+		_lastHeard[node] = -1;
+	}
+
+	SimRun(_end);
+
+	// the packets still on their way when the run ended are those whose buffers have not come back
+	busy = 0;
+	for (node = 1; node < _width * _height; node++)
+		busy += _busy[node];
+	printf("%u nodes (%u by %u), %u%% loss, %u seconds: %u frames, %u ACKs, %u collisions, %u lost, %u missed\n",
+		_width * _height, _width, _height, lossPercent, seconds, _simStatistics.Frames, _simStatistics.Acks,
+		_simStatistics.Collisions, _simStatistics.Lost, _simStatistics.Missed);
+	printf("hops    sent  delivered  failed  delivery  mean ms   max ms\n");
+	sent = 0;
+	delivered = 0;
+	failed = 0;
+	for (hops = 1; hops < kMaxHops; hops++)
+	{
+		if (!_sent[hops])
+			continue;
+		printf("%4u  %6u  %9u  %6u  %7.1f%%  %7.0f  %7.0f\n", hops, _sent[hops], _delivered[hops], _failed[hops],
+			100.0 * _delivered[hops] / _sent[hops], _delivered[hops] ? _latency[hops] / _delivered[hops] : 0,
+			_maxLatency[hops]);
+		sent += _sent[hops];
+		delivered += _delivered[hops];
+		failed += _failed[hops];
+	}
+	printf(" all  %6u  %9u  %6u  %7.1f%%\n", sent, delivered, failed, sent ? 100.0 * delivered / sent : 0);
+	printf("failed: %u no ACK, %u no route, %u channel busy.  %u lost past the first hop, %u still on their way.\n",
+		_errors[kNoAck], _errors[kNoRoute], _errors[kChannelBusy],
+		(_forwarded > delivered) ? _forwarded - delivered : 0, busy);
+	printf("%u reports skipped behind one still on its way, %u refused by a full queue\n", _skipped, _refused);
+
+	Check(_damaged == 0, "damaged packets delivered");
+	Check(_repeated == 0, "packets delivered twice");
+	Check(_forwarded + failed + busy == sent, "packets never handed back");
+	Check(sent && delivered * 100 >= sent * kMinDelivery, "delivery below the minimum");
+	printf(_failures ? "%d checks failed\n" : "all checks passed\n", _failures);
+	return _failures ? 1 : 0;
+}
@@ -0,0 +1,589 @@
+#include <string.h>
+#include "simradio.h"
+
+// Every node runs the same MAC code on its own copy of the private data
+#define openRFPrivateData (*macState)
+#include "../openrf_mac.c"
+#undef openRFPrivateData
+
+// *** Stand-in for RadioAPI on a simulated channel ***
+
+// Sync word bytes, CRC bytes and the preamble of an ACK, as RadioAPI sends them
+#define kSimSyncLength		4
+#define kSimCrcLength		2
+#define kSimAckPreamble		3
+// RSSI values the channel check sees on a busy and a quiet channel, either side of kCcaThreshold
+#define kSimBusyRssi		0x60
+#define kSimQuietRssi		0xD0
+// Packet type bits, as RadioAPI masks them
+#define kSimPacketTypeMask	0x07
+
+// What one node's radio is doing.  A node hears a frame only if it listened from before the frame's first preamble bit
+// until its last CRC bit.  Each node's mSec tick comes TickPhase uSec into the mSec, as the boards' clocks are not in
+// step.  A channel check is answered the way RadioAPI answers it: the first tick after it is asked for measures RSSI,
+// and the one after that hands the reading over.
+typedef struct
+{
+	U8 Listening;
+	U32 ListeningSince;
+	U8 Transmitting;
+	U16 TickPhase;
+	U16 Ticks;
+	U8 CcaRequested;
+	U8 CcaPending;
+	U8 CcaReady;
+	U8 CcaRssi;
+	U8 AutoAck;
+	U8 AesEnabled;
+	U8 ShortAddress;
+	U8 Sequence[2];
+	U32 BitsPerSecond;
+	U32 TxTimestamp;
+} tSimRadio;
+
+// One frame on the air, from Start (first preamble bit) to End (last CRC bit).  SDU is what the receiver's RadioAPI
+// passes up, sequence bytes included.  An ACK the radio sends on its own carries the frame it acknowledges, which its
+// node gets once the ACK has gone.  Ended frames are kept while anything still on the air overlaps them.
+typedef struct
+{
+	U8 Used;
+	U8 Ended;
+	U8 From;
+	UU32 Destination;
+	tPacketTypes PacketType;
+	U32 Start;
+	U32 End;
+	U8 Length;
+	U8 SDU[kMaxFrameLength];
+	U8 IsAck;
+	UU32 AckedSource;
+	tPacketTypes AckedType;
+	U8 AckedLength;
+	U8 AckedSDU[kMaxFrameLength];
+} tSimFrame;
+
+// Bits per second of each tDataRates
+const U32 kSimBitRates[] = {
+	1200, 2400, 4800, 9600, 19200, 38400, 57600, 76800, 153600,
+	12500, 25000, 50000, 100000, 150000, 200000, 250000, 300000
+};
+
+const tRadioBus kRadioBusSPI;
+UU32 _RTCDateTimeInSecs;
+U8 _simNode;
+tSimStatistics _simStatistics;
+
+static typeof(*macState) _simMacs[kSimMaxNodes];
+tSimRadio _simRadios[kSimMaxNodes];
+tSimFrame _simFrames[kSimMaxFrames];
+// Frame on the air that ends first, 0 if none is
+tSimFrame *_simNextEnd;
+// Nodes in the order their ticks come in each mSec, the next to tick and the start of its mSec
+U8 _simTickOrder[kSimMaxNodes];
+U8 _simTickIndex;
+U32 _simTickBase;
+U8 _simNodeCount;
+U16 _simLoss;
+U32 _simRandom;
+U8 _simStopped;
+
+U8 SimHasDestination(U8 packetType)
+{
+	return packetType != kMulticastPacketType && packetType != kBeaconPacketType
+		&& packetType != kRouteRequestPacketType;
+}
+
+U8 SimIsAcknowledged(U8 packetType)
+{
+	return packetType == kUniAckPacketType || packetType == kMeshPacketType;
+}
+
+// Radio of a handle, and the other way round
+tSimRadio *SimRadioOf(tRadioHandle radio)
+{
+	return (tSimRadio *)radio;
+}
+
+U8 SimNodeOfRadio(tRadioHandle radio)
+{
+	return (U8)(SimRadioOf(radio) - _simRadios);
+}
+
+tRadioHandle SimHandle(U8 node)
+{
+	return (tRadioHandle)&_simRadios[node];
+}
+
+// uSec 'bytes' take on the air
+U32 SimByteTimes(tSimRadio *radio, U16 bytes)
+{
+	return (U32)((bytes * 8000000ULL + radio->BitsPerSecond / 2) / radio->BitsPerSecond);
+}
+
+U16 SimRandom(void)
+{
+	// xorshift32
+	_simRandom ^= _simRandom << 13;
+	_simRandom ^= _simRandom >> 17;
+	_simRandom ^= _simRandom << 5;
+	return (U16)(_simRandom >> 8);
+}
+
+U32 SimTime(void)
+{
+	return _hostMicroseconds;
+}
+
+void SimSelect(U8 node)
+{
+	_simNode = node;
+	macState = &_simMacs[node];
+}
+
+UU32 SimMacAddress(U8 node)
+{
+	UU32 mac;
+
+	mac.U32 = 0x5EED0000UL + node;
+	return mac;
+}
+
+U8 SimNodeOf(UU32 mac)
+{
+	U32 node;
+
+	node = mac.U32 - 0x5EED0000UL;
+	return (node < _simNodeCount) ? (U8)node : kSimMaxNodes;
+}
+
+void SimStop(void)
+{
+	_simStopped = 1;
+}
+
+// Puts a frame on the air from 'node', starting once the radio has got to TX.  Returns the frame, 0 if there is no
+// room.
+tSimFrame *StartFrame(U8 node, UU32 destination, tPacketTypes packetType, U16 airBytes, U8 length, U8 *SDU)
+{
+	tSimRadio *radio;
+	tSimFrame *frame;
+	U32 oldest;
+	U16 i;
+
+	// an ended frame is free once everything still on the air started after it ended
+	oldest = 0xFFFFFFFFUL;
+	for (i = 0; i < kSimMaxFrames; i++)
+		if (_simFrames[i].Used && !_simFrames[i].Ended && _simFrames[i].Start < oldest)
+			oldest = _simFrames[i].Start;
+	for (i = 0; i < kSimMaxFrames; i++)
+		if (!_simFrames[i].Used || (_simFrames[i].Ended && _simFrames[i].End <= oldest))
+			break;
+	if (i == kSimMaxFrames)
+		return 0;
+	radio = &_simRadios[node];
+	frame = &_simFrames[i];
+	memset(frame, 0, sizeof(*frame));
+	frame->Used = 1;
+	frame->From = node;
+	frame->Destination = destination;
+	frame->PacketType = packetType;
+	frame->Start = _hostMicroseconds + kSimTxStartup;
+	frame->End = frame->Start + SimByteTimes(radio, airBytes);
+	frame->Length = length;
+	memcpy(frame->SDU, SDU, length);
+	radio->Listening = 0;
+	radio->Transmitting = 1;
+	_simStatistics.Frames++;
+	if (!_simNextEnd || frame->End < _simNextEnd->End)
+		_simNextEnd = frame;
+	return frame;
+}
+
+// Non-zero if a frame 'node' can hear, other than 'frame', is on the air while it is
+U8 Overlapped(tSimFrame *frame, U8 node)
+{
+	tSimFrame *other;
+	U16 i;
+
+	for (i = 0; i < kSimMaxFrames; i++)
+	{
+		other = &_simFrames[i];
+		if (other->Used && other != frame && other->Start < frame->End && other->End > frame->Start
+			&& other->From != node && SimInRange(other->From, node))
+			return 1;
+	}
+	return 0;
+}
+
+// RSSI a node measures now: busy while a frame it can hear is on the air
+U8 ChannelRssi(U8 node)
+{
+	U16 i;
+
+	for (i = 0; i < kSimMaxFrames; i++)
+		if (_simFrames[i].Used && !_simFrames[i].Ended && _simFrames[i].Start <= _hostMicroseconds
+			&& SimInRange(_simFrames[i].From, node))
+			return kSimBusyRssi;
+	return kSimQuietRssi;
+}
+
+// One node's mSec tick: the RSSI sampler, then the MAC's tick, the application and the MAC's loop
+void Tick(U8 node)
+{
+	tSimRadio *radio;
+
+	radio = &_simRadios[node];
+	if (!radio->Listening)
+	{
+		radio->CcaPending = 0;
+		radio->CcaRequested = 0;
+	}
+	else if (radio->CcaPending)
+	{
+		radio->CcaPending = 0;
+		radio->CcaReady = 1;
+	}
+	else if (radio->CcaRequested)
+	{
+		radio->CcaRequested = 0;
+		radio->CcaPending = 1;
+		radio->CcaRssi = ChannelRssi(node);
+	}
+	SimSelect(node);
+	NotifyRadio1MilliSecond();
+	if (++radio->Ticks == 1000)
+	{
+		radio->Ticks = 0;
+		NotifyRadio1Second();
+	}
+	SimApplication(node);
+	OpenRFLoop();
+}
+
+void RunLoops(void)
+{
+	U8 node;
+
+	for (node = 0; node < _simNodeCount; node++)
+	{
+		SimSelect(node);
+		OpenRFLoop();
+	}
+}
+
+// The frame's last bit has gone.  The sender hears PacketSent, or for an ACK its node gets the frame it acknowledged,
+// and every node that heard the whole frame gets it.
+void EndFrame(tSimFrame *ended)
+{
+	tSimFrame frame, *ack;
+	tSimRadio *radio;
+	tPacketMetadata metadata;
+	U16 i;
+	U8 node, offset;
+
+	frame = *ended;
+	ended->Ended = 1;
+	_simNextEnd = 0;
+	for (i = 0; i < kSimMaxFrames; i++)
+		if (_simFrames[i].Used && !_simFrames[i].Ended && (!_simNextEnd || _simFrames[i].End < _simNextEnd->End))
+			_simNextEnd = &_simFrames[i];
+	_simRadios[frame.From].Transmitting = 0;
+	SimSelect(frame.From);
+	if (frame.IsAck)
+	{
+		memset(&metadata, 0, sizeof(metadata));
+		NotifyRadioPacketReceived(SimHandle(frame.From), frame.AckedType, frame.AckedSource, frame.AckedLength,
+			frame.AckedSDU, &metadata);
+	}
+	else
+		NotifyRadioPacketSent(SimHandle(frame.From));
+
+	for (node = 0; node < _simNodeCount; node++)
+	{
+		radio = &_simRadios[node];
+		if (node == frame.From || !SimInRange(frame.From, node))
+			continue;
+		if (!radio->Listening || radio->ListeningSince > frame.Start)
+		{
+			_simStatistics.Missed++;
+			continue;
+		}
+		if (Overlapped(ended, node))
+		{
+			_simStatistics.Collisions++;
+			continue;
+		}
+		if (SimRandom() < _simLoss)
+		{
+			_simStatistics.Lost++;
+			continue;
+		}
+		// frames for someone else are dropped by RadioAPI, which goes on listening
+		if (SimHasDestination(frame.PacketType & kSimPacketTypeMask)
+			&& frame.Destination.U32 != SimMacAddress(node).U32)
+			continue;
+		radio->Listening = 0;
+		memset(&metadata, 0, sizeof(metadata));
+		metadata.Timestamp = frame.End;
+		metadata.SyncTimestamp = frame.End;
+		metadata.Rssi = 0x80;
+		if (radio->AutoAck && !(frame.PacketType & kBlockAckFlag)
+			&& SimIsAcknowledged(frame.PacketType & kSimPacketTypeMask))
+		{
+			// ACKed straight from PayloadReady, and passed up once the ACK has gone
+			offset = 0;
+			ack = StartFrame(node, SimMacAddress(frame.From), kAckPacketType,
+				kSimAckPreamble + kSimSyncLength + 10 + kSimCrcLength, 0, &offset);
+			if (!ack)
+				continue;
+			_simStatistics.Acks++;
+			ack->IsAck = 1;
+			ack->AckedSource = SimMacAddress(frame.From);
+			ack->AckedType = frame.PacketType;
+			ack->AckedLength = frame.Length;
+			memcpy(ack->AckedSDU, frame.SDU, frame.Length);
+			continue;
+		}
+		SimSelect(node);
+		NotifyRadioPacketReceived(SimHandle(node), frame.PacketType, SimMacAddress(frame.From), frame.Length, frame.SDU,
+			&metadata);
+	}
+}
+
+void SimInitialize(U8 nodeCount, const tOpenRFInitializer *ini, U16 loss, U32 seed)
+{
+	tOpenRFInitializer nodeIni;
+	U8 node, i;
+
+	memset(_simFrames, 0, sizeof(_simFrames));
+	memset(&_simStatistics, 0, sizeof(_simStatistics));
+	_simNodeCount = nodeCount;
+	_simLoss = loss;
+	_simRandom = seed ? seed : 1;
+	_simStopped = 0;
+	_simNextEnd = 0;
+	_hostMicroseconds = 0;
+	_RTCDateTimeInSecs.U32 = 0;
+	for (node = 0; node < nodeCount; node++)
+	{
+		SimSelect(node);
+		nodeIni = *ini;
+		nodeIni.MacAddress = SimMacAddress(node);
+		OpenRFInitialize(nodeIni);
+		_simRadios[node].TickPhase = SimRandom() % 1000;
+	}
+	// sort the nodes by when they tick
+	for (node = 0; node < nodeCount; node++)
+	{
+		for (i = node; i > 0 && _simRadios[_simTickOrder[i - 1]].TickPhase > _simRadios[node].TickPhase; i--)
+			_simTickOrder[i] = _simTickOrder[i - 1];
+		_simTickOrder[i] = node;
+	}
+	_simTickIndex = 0;
+	_simTickBase = 0;
+}
+
+void SimRun(U32 until)
+{
+	U32 tick;
+	U8 node;
+
+	_simStopped = 0;
+	while (!_simStopped && _hostMicroseconds < until)
+	{
+		node = _simTickOrder[_simTickIndex];
+		tick = _simTickBase + _simRadios[node].TickPhase;
+		if (_simNextEnd && _simNextEnd->End <= tick)
+		{
+			_hostMicroseconds = _simNextEnd->End;
+			EndFrame(_simNextEnd);
+			RunLoops();
+			continue;
+		}
+		_hostMicroseconds = tick;
+		_RTCDateTimeInSecs.U32 = tick / 1000000UL;
+		if (++_simTickIndex == _simNodeCount)
+		{
+			_simTickIndex = 0;
+			_simTickBase += 1000;
+		}
+		Tick(node);
+	}
+}
+
+// *************************************************************************************************
+// RadioAPI
+
+tRadioHandle RadioInitialize(tRadioInitialization ini)
+{
+	tSimRadio *radio;
+
+	// the MAC always asks for radio 0, so the node being initialized says which radio it is
+	radio = &_simRadios[_simNode];
+	memset(radio, 0, sizeof(*radio));
+	radio->AesEnabled = 1;
+	radio->BitsPerSecond = kSimBitRates[k38400BPS];
+	return SimHandle(_simNode);
+}
+
+void RadioSetDataRate(tRadioHandle radio, tDataRates dataRate)
+{
+	if (dataRate < sizeof(kSimBitRates) / sizeof(kSimBitRates[0]))
+		SimRadioOf(radio)->BitsPerSecond = kSimBitRates[dataRate];
+}
+
+void RadioSetEncryptionKey(tRadioHandle radio, U8 *key, U8 length)
+{
+}
+
+void RadioSetEncryption(tRadioHandle radio, U8 enable)
+{
+	SimRadioOf(radio)->AesEnabled = enable;
+}
+
+void RadioSetFSPretune(tRadioHandle radio, U8 enable)
+{
+}
+
+void RadioSetAddressFiltering(tRadioHandle radio, U8 enable)
+{
+}
+
+void RadioSetAutoAck(tRadioHandle radio, U8 enable)
+{
+	SimRadioOf(radio)->AutoAck = enable;
+}
+
+void RadioExpectPeer(tRadioHandle radio, UU32 peer)
+{
+}
+
+void RadioSetSequence(tRadioHandle radio, U8 sequence, U8 base)
+{
+	SimRadioOf(radio)->Sequence[0] = sequence;
+	SimRadioOf(radio)->Sequence[1] = base;
+}
+
+void RadioSetShortAddress(tRadioHandle radio, U8 shortAddress)
+{
+	SimRadioOf(radio)->ShortAddress = shortAddress;
+}
+
+U8 RadioGetShortAddress(tRadioHandle radio)
+{
+	return SimRadioOf(radio)->ShortAddress;
+}
+
+// Frames always carry full MACs, so no peer's short address is known
+U8 RadioSetShortPeer(tRadioHandle radio, UU32 peer, U8 shortAddress)
+{
+	return 1;
+}
+
+U8 RadioGetShortPeer(tRadioHandle radio, UU32 peer)
+{
+	return kNoShortAddress;
+}
+
+U8 RadioGetPeerOffset(tRadioHandle radio, UU32 peer, S16 *offset)
+{
+	return 0;
+}
+
+U8 RadioGetMaxFrameLength(tRadioHandle radio)
+{
+	return SimRadioOf(radio)->AesEnabled ? kMaxAesFrameLength : kMaxFrameLength;
+}
+
+U8 RadioGetRFICMode(tRadioHandle radio)
+{
+	if (SimRadioOf(radio)->Transmitting)
+		return kTransmitMode;
+	return SimRadioOf(radio)->Listening ? kReceiveMode : kSleepMode;
+}
+
+void RadioGetModeLatency(tRadioHandle radio, tOperatingModes mode, tModeLatency *latency)
+{
+	memset(latency, 0, sizeof(*latency));
+	if (mode != kTransmitMode)
+		return;
+	latency->Count = 1;
+	latency->Minimum = kSimTxStartup;
+	latency->Maximum = kSimTxStartup;
+	latency->Total = kSimTxStartup;
+}
+
+U32 RadioGetAirtime(tRadioHandle radio, U8 length, U16 preambleCount)
+{
+	return SimByteTimes(SimRadioOf(radio),
+		(preambleCount >> 8) + kSimSyncLength + 1 + kMaxHeaderLength - 1 + length + kSimCrcLength);
+}
+
+U32 RadioGetTxTimestamp(tRadioHandle radio)
+{
+	return SimRadioOf(radio)->TxTimestamp;
+}
+
+void RadioReceivePacket(tRadioHandle radio, tListenModes listenMode, U16 period)
+{
+	tSimRadio *simRadio;
+
+	simRadio = SimRadioOf(radio);
+	if (simRadio->Transmitting || simRadio->Listening)
+		return;
+	simRadio->Listening = 1;
+	simRadio->ListeningSince = _hostMicroseconds;
+	simRadio->CcaReady = 0;
+}
+
+// The reading is taken by the tick, as RadioAPI takes it
+U8 RadioReadChannelRSSI(tRadioHandle radio, U8 *rssi)
+{
+	tSimRadio *simRadio;
+
+	simRadio = SimRadioOf(radio);
+	if (!simRadio->Listening)
+		return 0;
+	if (!simRadio->CcaReady)
+	{
+		simRadio->CcaRequested = 1;
+		return 0;
+	}
+	simRadio->CcaReady = 0;
+	*rssi = simRadio->CcaRssi;
+	return 1;
+}
+
+// Frames are laid out as RadioAPI lays them out with full MACs: preamble, sync word, length, packet type, destination
+// MAC, source MAC, the sequence bytes of acknowledged frames, SDU and CRC
+U8 RadioSendPacket(tRadioHandle radio, UU32 destAddress, tPacketTypes packetType, U8 length, U8 *SDU,
+	U16 preambleCount, U8 blocking)
+{
+	tSimRadio *simRadio;
+	tSimFrame *frame;
+	U8 sdu[kMaxFrameLength], header, base, offset;
+
+	simRadio = SimRadioOf(radio);
+	if (simRadio->Transmitting)
+		return 0;
+	base = packetType & kSimPacketTypeMask;
+	if (base == kAckPacketType && !(packetType & kBlockAckFlag))
+		length = 0;
+	header = 2 + (SimHasDestination(base) ? 4 : 0) + 4;
+	offset = 0;
+	if (SimIsAcknowledged(base))
+	{
+		sdu[offset++] = simRadio->Sequence[0];
+		if (packetType & kBlockAckFlag)
+			sdu[offset++] = simRadio->Sequence[1];
+	}
+	if (header - 1 + offset + length > RadioGetMaxFrameLength(radio))
+		return 0;
+	memcpy(&sdu[offset], SDU, length);
+	frame = StartFrame(SimNodeOfRadio(radio), destAddress, packetType,
+		(preambleCount >> 8) + kSimSyncLength + header + offset + length + kSimCrcLength, offset + length, sdu);
+	if (!frame)
+		return 0;
+	simRadio->TxTimestamp = frame->Start + SimByteTimes(simRadio, (preambleCount >> 8) + kSimSyncLength);
+	return 1;
+}
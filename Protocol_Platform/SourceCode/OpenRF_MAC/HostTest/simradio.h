@@ -0,0 +1,87 @@
+#ifndef SIMRADIO_H
+#define SIMRADIO_H
+
+// Runs several copies of the MAC on a PC over a simulated channel.  simradio.c builds openrf_mac.c with its private
+// data made per node, and stands in for RadioAPI with a radio that only knows about frames: how long they are on the
+// air, who can hear them, and which of them overlap.  Each node gets its own radio handle, so the MAC's checks on the
+// handle see the same thing they do on a board.
+//
+// Time only moves inside SimRun.  Every mSec each node gets the RadioAPI tick, then SimApplication, then OpenRFLoop,
+// each node at its own random point in the mSec.  OpenRFLoop also runs for every node whenever a frame ends.  Call the
+// MAC for a node only once SimSelect has picked it.  The NotifyMac callbacks, which the test provides, are called with
+// their node already picked.
+
+#include "../../Radio/SX1231/HostTest/hostapi.h"
+#include "../openrf_mac.h"
+
+// Nodes a simulation can run
+#ifndef kSimMaxNodes
+#define kSimMaxNodes 128
+#endif
+// uSec from RadioSendPacket or PayloadReady to the first preamble bit, the time the radio takes to get to TX
+#ifndef kSimTxStartup
+#define kSimTxStartup 600
+#endif
+// Frames that can be on the air at once, counting the ones kept for a while after they end
+#define kSimMaxFrames 256
+
+// Node whose MAC is running, set by SimSelect and before every callback
+extern U8 _simNode;
+
+/*! \details Counts of what happened on the air, summed over all nodes.
+ */
+typedef struct
+{
+	U32 Frames;			/*! Frames sent, ACKs included */
+	U32 Acks;			/*! ACKs the radios sent on their own */
+	U32 Collisions;		/*! Frames a node could hear but lost to another frame it could hear at the same time */
+	U32 Lost;			/*! Frames a node could hear but dropped at random */
+	U32 Missed;			/*! Frames a node could hear but was not listening for */
+} tSimStatistics;
+
+extern tSimStatistics _simStatistics;
+
+/*! \details Sets up the channel for 'nodeCount' nodes, each node dropping a frame it hears with probability 'loss'
+ *  (in 1/65536ths), and starts the clock at zero.  Every node then gets OpenRFInitialize with 'ini' and its own MAC
+ *  address.
+ */
+void SimInitialize(U8 nodeCount, const tOpenRFInitializer *ini, U16 loss, U32 seed);
+
+/*! \details Makes 'node' the one the MAC API works on.
+ */
+void SimSelect(U8 node);
+
+/*! \details Gets the MAC address SimInitialize gave a node.
+ */
+UU32 SimMacAddress(U8 node);
+
+/*! \details Gets the node a MAC address belongs to.
+ *  \return Node, kSimMaxNodes if no node has it
+ */
+U8 SimNodeOf(UU32 mac);
+
+/*! \details Runs the simulation until the clock gets to 'until' uSec, or SimStop is called.
+ */
+void SimRun(U32 until);
+
+/*! \details Makes SimRun return at the end of the current mSec.
+ */
+void SimStop(void);
+
+/*! \details Gets the simulation clock.
+ *  \return uSec since SimInitialize
+ */
+U32 SimTime(void);
+
+/*! \details Gets a random number from the simulation's own generator, so runs do not depend on the C library.
+ *  \return 16 random bits
+ */
+U16 SimRandom(void);
+
+// Provided by the test: non-zero if 'to' can hear 'from' at all.  Frames from nodes out of range neither arrive nor
+// collide, and do not make the channel busy.
+extern U8 SimInRange(U8 from, U8 to);
+// Provided by the test: called for every node every mSec, with the node picked, before its OpenRFLoop
+extern void SimApplication(U8 node);
+
+#endif
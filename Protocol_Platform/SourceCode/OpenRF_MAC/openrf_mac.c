@@ -5,171 +5,1918 @@ enum
 {
 	kAckTimer,
 	kSyncTimer,
-	kLockTimer
+	kLockTimer,
+	kBackoffTimer,
+	kReassemblyTimer,
+	kTimerCount
 } timerDefs;
 
+// Association response payload: [assigned short address][coordinator short address].  A request has no payload.
+#define kAssociateResponseLength 2
+
+// Selective repeat sequence numbers are 7 bits.  The top bit of the sequence byte asks the receiver for a block ACK.
+#define kSequenceMask		0x7F
+#define kBlockAckRequest	0x80
+#define kNoSequence			0xFF
+// Sequence offsets from here up are behind the receive window rather than ahead of it
+#define kSequenceHalf		64
+// Block ACK payload: [next sequence expected][bitmap of the frames held from there on, bit 0 being the next one]
+#define kBlockAckLength		2
+#define kNoPacket			0xFF
+// Beacon payload: [slot count][slot length in mSec][sequence][master's sync time of the beacon before:32][master's RTC
+// seconds:32].  A beacon's own sync time is only known once it has gone, so it comes with the next one.
+#define kBeaconLength		11
+// Clock skews are in units of 2^-24, and anything beyond 500ppm is taken to be a bad fit
+#define kMaxClockSkew		8389
+// Offsets that move more than this many uSec between beacons in the fit are taken to be the master restarting
+#define kMaxSyncDeviation	0x100000UL
+// Fragment header: [tag][index:4 | fragment count less one:4].  The tag tells one message's fragments from the next.
+#define kFragmentHeaderLength	2
+#define kMaxFragments		16
+// Mesh frame payload: [kind][destination MAC:32][origin MAC:32][hops so far][SDU].  Route request payload: [request id]
+// [target MAC:32][origin MAC:32][hops so far].  The target answers a request with a route reply, a mesh frame with no SDU.
+#define kMeshHeaderLength	10
+#define kRouteRequestLength	10
+#define kMeshData			0
+#define kMeshRouteReply		1
+#define kNoMetric			0xFF
+// States of a mesh buffer
+#define kMeshFree			0
+#define kMeshQueued			1
+#define kMeshWaiting		2
+// Polynomial of the LFSR that picks backoff slots.  Any non-zero seed goes through all 65535 states.
+#define kBackoffPolynomial	0xB400
+
+// A packet waiting to go out.  TxBuffer belongs to the MAC until the packet is sent or fails.  UniAck packets get a
+// Sequence the first time they go out and keep it when they are sent again.  Plain ones stay queued until they are ACKed,
+// and Windowed ones until a block ACK covers them.  Aggregated packets have been copied into the aggregate frame, which
+// goes out in place of the first of them.  QueuedTime is when the packet was queued, by the mSec tick.  Packets too long
+// for one frame go out as fragments, Fragment being the one on its way, and UniAck ones get a new Sequence for each.
+typedef struct
+{
+	UU32 DestAddress;
+	tPacketTypes PacketType;
+	U16 Length;
+	U8 *TxBuffer;
+	U16 PreambleCount;
+	U8 Priority;
+	U8 Sequence;
+	U8 Windowed;
+	U8 Aggregated;
+	U8 Fragment;
+	U8 Tag;
+	U16 QueuedTime;
+} tQueuedPacket;
+
+// Last sequence number heard from a peer, for spotting repeats of UniAck frames whose ACK was lost
+typedef struct
+{
+	UU32 Source;
+	U8 Sequence;
+} tSequenceCache;
+
+// Next hop towards a mesh destination, Metric hops away.  Entries with kNoMetric are free.  Age counts seconds since the
+// route was last used or heard from.
+typedef struct
+{
+	UU32 Destination;
+	UU32 NextHop;
+	U8 Metric;
+	U8 Age;
+} tRoute;
+
+// A mesh frame on its way or waiting for a route.  Owner is the application buffer it was copied from, none for frames
+// forwarded for other nodes and for route requests and replies.  Since is when it started waiting, by the mSec tick, and
+// Requests counts the route requests sent for it.
+typedef struct
+{
+	U8 State;
+	U8 Length;
+	U8 Priority;
+	U8 Requests;
+	U16 Since;
+	U8 *Owner;
+	U8 Frame[kMeshFrameLength];
+} tMeshBuffer;
+
+// A route request already passed on
+typedef struct
+{
+	UU32 Origin;
+	U8 Id;
+} tRouteRequestCache;
+
+// Link quality to a neighbour.  Rssi is an average of SX1231 RSSI values, Snr one of signal to noise ratios in half dB
+// and AckRate one of percentages, all kept in eighths.  Entries with no Used are free.
+typedef struct
+{
+	UU32 MacAddress;
+	U16 Rssi;
+	U16 Snr;
+	U16 AckRate;
+	S16 FrequencyOffset;
+	U32 LastSeen;
+	U16 RxCount;
+	U16 TxCount;
+	U8 Used;
+} tNeighborEntry;
+
 // ***********************************************************************************
 // ** Private variables
 // ***********************************************************************************
 struct
 {
-	tOpenRFStates macState;
-	tPacketTypes txPacketType;
-	tPacketTypes rxPacketType;
-	U16 timers[4];
-	U16 ackTimeout;
-	U8 ackRetries;
-	U8 ackRetryCounter;
-	UU32 rxSourceMAC;
-	UU32 rxDestinationMAC;
-	UU32 networkId;
-	UU32 macAddress;
-	U8 operatingMode;
-	U8 isLocked;
-	U16 frameLength;
-	U8 alreadyHopped;
-	U8 gfskEnabled;
-	U16 listenPeriod;
-	tListenModes listenMode;
-}  openRFPrivateData;
+	tRadioHandle radio;
+	tOpenRFStates macState;
+	tPacketTypes txPacketType;
+	tPacketTypes rxPacketType;
+	U16 timers[kTimerCount];
+	U16 ackTimeout;
+	U8 ackRetries;
+	U8 ackRetryCounter;
+	UU32 rxSourceMAC;
+	UU32 rxDestinationMAC;
+	UU32 networkId;
+	UU32 macAddress;
+	U8 operatingMode;
+	// TDMA superframe of tdmaSlotCount slots, frameLength mSec in all.  It starts at superframeStart, which is when the sync
+	// word of the beacon ended by our GetMicroseconds() clock.  The next beacon comes once the master's superframe is over,
+	// so slaves measure beaconPeriod, in uSec of the master's clock, to bridge a missed one.  kLockTimer times out the lock.
+	U8 isLocked;
+	U16 frameLength;
+	U32 beaconPeriod;
+	U32 superframeStart;
+	U8 alreadyHopped;
+	U8 tdmaSlotCount;
+	U8 tdmaSlotLength;
+	U8 beaconSending;
+	U8 beaconSequence;
+	U32 beaconSync;
+	U8 beacon[kBeaconLength];
+	// Clock sync.  Each beacon is paired with the master's time for it when the next one arrives, and the master's time
+	// less ours at syncLocal[i] goes in syncOffsets[i], syncHead being the next to replace.  Fitting a line through them
+	// gives syncOffset at syncReference and syncSkew, the slope in units of 2^-24.  beaconLocal is when the sync word of the
+	// last beacon heard ended and pairedSequence/pairedMaster the last beacon paired, for measuring beaconPeriod.
+	U32 syncLocal[kTimeSyncPoints];
+	S32 syncOffsets[kTimeSyncPoints];
+	U8 syncHead;
+	U8 syncCount;
+	U32 syncReference;
+	S32 syncOffset;
+	S32 syncSkew;
+	U16 syncResidual;
+	U8 beaconHeard;
+	U32 beaconLocal;
+	U8 pairedSequence;
+	U32 pairedMaster;
+	U8 gfskEnabled;
+	U16 listenPeriod;
+	tListenModes listenMode;
+	tPacketMetadata rxMetadata;
+	U8 isCoordinator;
+	U8 nextShortAddress;
+	U8 associateResponse[kAssociateResponseLength];
+	U8 isListening;
+	// Transmit queue, highest priority first.  txSending is the index of the packet on the air.  Windowed packets that have
+	// a sequence number stay at the front, and the first txSentCount of them have gone out since the last block ACK.
+	// While awaitingAck is set, nothing else goes out until the packet at ackIndex is ACKed or times out.
+	tQueuedPacket txQueue[kMaxMessageQueueSize];
+	U8 txQueueCount;
+	U8 txSending;
+	U8 txSentCount;
+	U8 txRequested;
+	U8 txNextSequence;
+	U8 awaitingAck;
+	U8 ackIndex;
+	// Aggregation.  aggregate holds the [length][SDU] records of the packets marked Aggregated, aggregateLength bytes of
+	// them, and is free while aggregateLength is zero.  msTicks counts mSec for timing how long packets have waited.
+	U8 aggregateMax;
+	U8 aggregateDelay;
+	U8 aggregateLength;
+	U8 aggregate[kAggregateLength];
+	U16 msTicks;
+	// Fragmentation.  fragment holds the SDU of the fragment on the air, fragmentLength bytes of it, and fragmentFollowing
+	// is set while it follows straight on from the one before.  nextTag is the tag of the next packet queued.  A message
+	// from reassemblySource is put back together in reassembly, reassemblyNext of its reassemblyCount fragments coming
+	// next, and none is under way while reassemblyCount is zero.
+	U8 fragment[kMaxSDULength];
+	U8 fragmentLength;
+	U8 fragmentFollowing;
+	U8 nextTag;
+	UU32 reassemblySource;
+	U8 reassemblyTag;
+	U8 reassemblyNext;
+	U8 reassemblyCount;
+	U16 reassemblyLength;
+	U8 reassembly[kReassemblyLength];
+	// Mesh.  requestCache holds the route requests heard lately, requestCacheHead being the next to replace.
+	U8 meshEnabled;
+	tRoute routes[kRouteTableSize];
+	tMeshBuffer meshBuffers[kMeshBufferCount];
+	tRouteRequestCache requestCache[kRouteRequestCacheSize];
+	U8 requestCacheCount;
+	U8 requestCacheHead;
+	U8 nextRequestId;
+	// Neighbour table, hashed on the MAC.  noiseFloor is the average of the channel checks that found the channel clear,
+	// in eighths of an RSSI value, and zero until there has been one.
+	tNeighborEntry neighbors[kNeighborTableSize];
+	U16 noiseFloor;
+	// Receive side of plain UniAck sequence numbers, most recently heard peer first
+	tSequenceCache sequenceCache[kSequenceCacheSize];
+	U8 sequenceCacheCount;
+	// Selective repeat sender.  UniAck packets to arqPeer are windowed while arqWindow is non-zero.
+	UU32 arqPeer;
+	U8 arqWindow;
+	U8 arqNextSequence;
+	U8 arqProbe;
+	// Selective repeat receiver.  arqRxHeld has a bit set for each frame after arqRxNext held for reordering.
+	UU32 arqRxPeer;
+	U8 arqRxActive;
+	U8 arqRxNext;
+	U8 arqRxHeld;
+	U8 arqHeldSequence[kArqHeldFrames];
+	U8 arqHeldLength[kArqHeldFrames];
+	U8 arqHeld[kArqHeldFrames][kMaxSDULength];
+	U8 arqBlockAck[kBlockAckLength];
+	U8 arqBlockAckQueued;
+	// Channel access.  While csmaBackoff is non-zero the packet at txSending waits that many mSec before the channel is
+	// checked again.  csmaAttempts counts the checks that found it busy.  csmaWarmup says the receiver has been turned on
+	// for this packet, and csmaWait is how many mSec the current check has waited for its RSSI reading.
+	U8 ccaThreshold;
+	U8 csmaMaxAttempts;
+	U8 csmaAttempts;
+	U8 csmaWarmup;
+	U8 csmaWait;
+	U8 csmaBackoff;
+	U16 csmaRandom;
+	tChannelAccessStatistics channelStatistics;
+}  openRFPrivateData;
+
+U8 _rssi;
+U16 counterA,x,y;
+// Amount of time to queue a packet before transmitting it
+#define TXQUEUETIME 7
+extern UU32 _RTCDateTimeInSecs;
+
+// ***********************************************************************************
+// ** Internal functions
+// ***********************************************************************************
+// a windowed frame that cannot get the channel is passed on as if it had been sent
+void TransmitDone(U8 sent);
+
+void ClearOpenRFTimer(U8 timerNumber)
+{
+	DisableInterrupts;
+	openRFPrivateData.timers[timerNumber] = 0;
+	EnableInterrupts;
+}
+
+// Short address for 'node', handing out the next free one if it has none yet.  kNoShortAddress once they run out.
+U8 AssignShortAddress(UU32 node)
+{
+	U8 shortAddress;
+
+	shortAddress = RadioGetShortPeer(openRFPrivateData.radio, node);
+	if (shortAddress != kNoShortAddress || openRFPrivateData.nextShortAddress > kMaxShortAddress)
+		return shortAddress;
+	if (!RadioSetShortPeer(openRFPrivateData.radio, node, openRFPrivateData.nextShortAddress))
+		return kNoShortAddress;
+	return openRFPrivateData.nextShortAddress++;
+}
+
+// Adds a packet to the transmit queue behind any of the same or higher priority.  Returns zero if the queue is full.
+U8 QueuePacket(UU32 destAddress, tPacketTypes packetType, U16 length, U8 *txBuffer, U16 preambleCount, U8 priority)
+{
+	tQueuedPacket *packet;
+	U8 i;
+
+	DisableInterrupts;
+	i = openRFPrivateData.txQueueCount;
+	if (i == kMaxMessageQueueSize)
+	{
+		EnableInterrupts;
+		return 0;
+	}
+	// the packet on the air and packets that have already been sent, even in part, keep their place
+	for (; i > 0; i--)
+	{
+		packet = &openRFPrivateData.txQueue[i - 1];
+		if (packet->Priority >= priority || packet->Sequence != kNoSequence || packet->Fragment
+			|| openRFPrivateData.txSending == i - 1)
+			break;
+		openRFPrivateData.txQueue[i] = *packet;
+	}
+	packet = &openRFPrivateData.txQueue[i];
+	packet->DestAddress = destAddress;
+	packet->PacketType = packetType;
+	packet->Length = length;
+	packet->TxBuffer = txBuffer;
+	packet->PreambleCount = preambleCount;
+	packet->Priority = priority;
+	packet->Sequence = kNoSequence;
+	packet->Windowed = 0;
+	packet->Aggregated = 0;
+	packet->Fragment = 0;
+	packet->Tag = openRFPrivateData.nextTag++;
+	packet->QueuedTime = openRFPrivateData.msTicks;
+	openRFPrivateData.txQueueCount++;
+	EnableInterrupts;
+	return 1;
+}
+
+// Takes a packet off the queue.  Returns its buffer.
+U8 *RemovePacket(U8 index)
+{
+	U8 *txBuffer, i;
+
+	DisableInterrupts;
+	txBuffer = openRFPrivateData.txQueue[index].TxBuffer;
+	openRFPrivateData.txQueueCount--;
+	for (i = index; i < openRFPrivateData.txQueueCount; i++)
+		openRFPrivateData.txQueue[i] = openRFPrivateData.txQueue[i + 1];
+	if (index < openRFPrivateData.txSentCount)
+		openRFPrivateData.txSentCount--;
+	EnableInterrupts;
+	return txBuffer;
+}
+
+// MAC address stored in a frame at 'bytes'
+UU32 ReadMac(U8 *bytes)
+{
+	UU32 mac;
+	U8 i;
+
+	for (i = 0; i < 4; i++)
+		mac.U8[i] = bytes[i];
+	return mac;
+}
+void WriteMac(U8 *bytes, UU32 mac)
+{
+	U8 i;
+
+	for (i = 0; i < 4; i++)
+		bytes[i] = mac.U8[i];
+}
+
+// Live route to 'destination', zero if there is none
+tRoute *FindRoute(UU32 destination)
+{
+	U8 i;
+
+	for (i = 0; i < kRouteTableSize; i++)
+		if (openRFPrivateData.routes[i].Metric != kNoMetric && openRFPrivateData.routes[i].Age < kRouteLifetime
+			&& openRFPrivateData.routes[i].Destination.U32 == destination.U32)
+			return &openRFPrivateData.routes[i];
+	return 0;
+}
+
+// Forgets every route through 'nextHop'
+void DropRoutesVia(UU32 nextHop)
+{
+	U8 i;
+
+	for (i = 0; i < kRouteTableSize; i++)
+		if (openRFPrivateData.routes[i].NextHop.U32 == nextHop.U32)
+			openRFPrivateData.routes[i].Metric = kNoMetric;
+}
+
+// Mesh buffer 'txBuffer' is the frame of, kNoPacket if it is not one
+U8 FindMeshBuffer(U8 *txBuffer)
+{
+	U8 i;
+
+	for (i = 0; i < kMeshBufferCount; i++)
+		if (txBuffer == openRFPrivateData.meshBuffers[i].Frame)
+			return i;
+	return kNoPacket;
+}
+
+// Free mesh buffer, kNoPacket if they are all in use
+U8 FreeMeshBuffer(void)
+{
+	U8 i;
+
+	for (i = 0; i < kMeshBufferCount; i++)
+		if (openRFPrivateData.meshBuffers[i].State == kMeshFree)
+			return i;
+	return kNoPacket;
+}
+
+// Queues the mesh frame in buffer 'index' to the next hop towards its destination.  Returns zero if there is no route or
+// the queue is full.
+U8 QueueMeshBuffer(U8 index)
+{
+	tMeshBuffer *buffer;
+	tRoute *route;
+
+	buffer = &openRFPrivateData.meshBuffers[index];
+	route = FindRoute(ReadMac(&buffer->Frame[1]));
+	if (!route || !QueuePacket(route->NextHop, kMeshPacketType, buffer->Length, buffer->Frame, 0, buffer->Priority))
+		return 0;
+	buffer->State = kMeshQueued;
+	return 1;
+}
+
+// Floods a request for a route to 'target'.  It waits for the next time round if there is no buffer free.
+void SendRouteRequest(UU32 target)
+{
+	tMeshBuffer *buffer;
+	UU32 everyone;
+	U8 i;
+
+	i = FreeMeshBuffer();
+	if (i == kNoPacket)
+		return;
+	buffer = &openRFPrivateData.meshBuffers[i];
+	buffer->Frame[0] = openRFPrivateData.nextRequestId++;
+	WriteMac(&buffer->Frame[1], target);
+	WriteMac(&buffer->Frame[5], openRFPrivateData.macAddress);
+	buffer->Frame[9] = 0;
+	buffer->Length = kRouteRequestLength;
+	buffer->Owner = 0;
+	everyone.U32 = 0xFFFFFFFF;
+	if (QueuePacket(everyone, kRouteRequestPacketType, kRouteRequestLength, buffer->Frame, 0, 0))
+		buffer->State = kMeshQueued;
+}
+
+// Queues the frames that were waiting for a route to 'destination'.  Any that do not fit in the queue wait on.
+void ReleaseWaiting(UU32 destination)
+{
+	U8 i;
+
+	for (i = 0; i < kMeshBufferCount; i++)
+		if (openRFPrivateData.meshBuffers[i].State == kMeshWaiting
+			&& ReadMac(&openRFPrivateData.meshBuffers[i].Frame[1]).U32 == destination.U32)
+			QueueMeshBuffer(i);
+}
+
+// Takes note that 'destination' is 'metric' hops away through 'nextHop', starting it at 'age' seconds old.  A live route
+// is only replaced by a shorter one or one through the same next hop, and a new one takes a free entry or the oldest.
+void LearnRoute(UU32 destination, UU32 nextHop, U8 metric, U8 age)
+{
+	tRoute *route;
+	U8 i;
+
+	if (destination.U32 == openRFPrivateData.macAddress.U32)
+		return;
+	route = FindRoute(destination);
+	if (route && metric > route->Metric && nextHop.U32 != route->NextHop.U32)
+		return;
+	if (!route)
+	{
+		route = &openRFPrivateData.routes[0];
+		for (i = 0; i < kRouteTableSize; i++)
+		{
+			if (openRFPrivateData.routes[i].Metric == kNoMetric || openRFPrivateData.routes[i].Age >= kRouteLifetime)
+			{
+				route = &openRFPrivateData.routes[i];
+				break;
+			}
+			if (openRFPrivateData.routes[i].Age > route->Age)
+				route = &openRFPrivateData.routes[i];
+		}
+		route->Age = age;
+	}
+	else if (age < route->Age)
+		route->Age = age;
+	route->Destination = destination;
+	route->NextHop = nextHop;
+	route->Metric = metric;
+	ReleaseWaiting(destination);
+}
+
+// Sends the mesh frame in buffer 'index', or floods a route request first if there is no route to its destination yet.
+// Returns zero if there is a route but the queue is full.
+U8 SendMeshBuffer(U8 index)
+{
+	tMeshBuffer *buffer;
+	UU32 destination;
+
+	if (QueueMeshBuffer(index))
+		return 1;
+	buffer = &openRFPrivateData.meshBuffers[index];
+	destination = ReadMac(&buffer->Frame[1]);
+	if (FindRoute(destination))
+		return 0;
+	DisableInterrupts;
+	buffer->Since = openRFPrivateData.msTicks;
+	EnableInterrupts;
+	buffer->Requests = 1;
+	buffer->State = kMeshWaiting;
+	SendRouteRequest(destination);
+	return 1;
+}
+
+// Copies an SDU for 'destination' into a mesh buffer behind its header and sends it.  Returns zero if there is no buffer
+// free, the SDU does not fit or the queue is full.
+U8 SendMeshPacket(UU32 destination, U16 length, U8 *txBuffer, U8 priority)
+{
+	tMeshBuffer *buffer;
+	U8 i, j;
+
+	if (!openRFPrivateData.meshEnabled || length > kMaxMeshSDULength
+		|| length + kMeshHeaderLength > OpenRFMaxSDULength())
+		return 0;
+	i = FreeMeshBuffer();
+	if (i == kNoPacket)
+		return 0;
+	buffer = &openRFPrivateData.meshBuffers[i];
+	buffer->Frame[0] = kMeshData;
+	WriteMac(&buffer->Frame[1], destination);
+	WriteMac(&buffer->Frame[5], openRFPrivateData.macAddress);
+	buffer->Frame[9] = 0;
+	for (j = 0; j < length; j++)
+		buffer->Frame[kMeshHeaderLength + j] = txBuffer[j];
+	buffer->Length = kMeshHeaderLength + length;
+	buffer->Priority = priority;
+	buffer->Owner = txBuffer;
+	return SendMeshBuffer(i);
+}
+
+// Moves an average kept in eighths an eighth of the way to 'sample'
+U16 MovingAverage(U16 average, U16 sample)
+{
+	return average - (average >> 3) + sample;
+}
+
+// Neighbour table entry 'mac' hashes to.  MACs are often handed out in sequence, so all of the bytes are folded in.
+U8 NeighborHash(UU32 mac)
+{
+	U8 hash;
+
+	hash = mac.U8[0] ^ mac.U8[1] ^ mac.U8[2] ^ mac.U8[3];
+	return (hash ^ (hash >> 4)) & (kNeighborTableSize - 1);
+}
+
+// Entry for 'mac', taking one for it if 'add' is set and it has none.  Entries are replaced but never freed, so the
+// search stops at the first free one.  With all kNeighborProbeLength entries taken, the one heard from longest ago
+// makes way.  Zero if 'mac' has no entry and 'add' is clear.
+tNeighborEntry *FindNeighbor(UU32 mac, U8 add)
+{
+	tNeighborEntry *entry, *oldest;
+	U8 i, slot;
+
+	slot = NeighborHash(mac);
+	oldest = 0;
+	for (i = 0; i < kNeighborProbeLength; i++)
+	{
+		entry = &openRFPrivateData.neighbors[(slot + i) & (kNeighborTableSize - 1)];
+		if (!entry->Used)
+			break;
+		if (entry->MacAddress.U32 == mac.U32)
+			return entry;
+		if (!oldest || entry->LastSeen < oldest->LastSeen)
+			oldest = entry;
+	}
+	if (!add)
+		return 0;
+	if (i == kNeighborProbeLength)
+		entry = oldest;
+	entry->MacAddress = mac;
+	entry->Rssi = 0;
+	entry->Snr = 0;
+	entry->AckRate = 0;
+	entry->FrequencyOffset = 0;
+	entry->LastSeen = 0;
+	entry->RxCount = 0;
+	entry->TxCount = 0;
+	entry->Used = 1;
+	return entry;
+}
+
+// Folds a frame heard from 'source' into its link quality.  SX1231 RSSI is -value/2 dBm, so the signal to noise ratio
+// in half dB is the noise floor's value less the frame's.
+void HeardNeighbor(UU32 source, tPacketMetadata *metadata)
+{
+	tNeighborEntry *entry;
+	U8 noise, snr;
+
+	entry = FindNeighbor(source, 1);
+	noise = (openRFPrivateData.noiseFloor + 4) >> 3;
+	snr = openRFPrivateData.noiseFloor && noise > metadata->Rssi ? noise - metadata->Rssi : 0;
+	if (!entry->RxCount)
+	{
+		entry->Rssi = metadata->Rssi << 3;
+		entry->Snr = snr << 3;
+	}
+	else
+	{
+		entry->Rssi = MovingAverage(entry->Rssi, metadata->Rssi);
+		entry->Snr = MovingAverage(entry->Snr, snr);
+	}
+	// RadioAPI has folded this frame into the peer's offset already
+	RadioGetPeerOffset(openRFPrivateData.radio, source, &entry->FrequencyOffset);
+	entry->LastSeen = _RTCDateTimeInSecs.U32;
+	if (entry->RxCount < 0xFFFF)
+		entry->RxCount++;
+}
+
+// Counts a try of an acknowledged frame to 'peer', which its ACK or block ACK either answered or did not
+void TriedNeighbor(UU32 peer, U8 acked)
+{
+	tNeighborEntry *entry;
+
+	entry = FindNeighbor(peer, 1);
+	if (!entry->TxCount)
+		entry->AckRate = acked ? 100 << 3 : 0;
+	else
+		entry->AckRate = MovingAverage(entry->AckRate, acked ? 100 : 0);
+	if (entry->TxCount < 0xFFFF)
+		entry->TxCount++;
+}
+
+// Public copy of a neighbour table entry, the averages rounded
+void CopyNeighbor(tNeighborEntry *entry, tNeighbor *neighbor)
+{
+	neighbor->MacAddress = entry->MacAddress;
+	neighbor->Rssi = (entry->Rssi + 4) >> 3;
+	// in dB rather than half dB
+	neighbor->Snr = (entry->Snr + 8) >> 4;
+	neighbor->AckRate = (entry->AckRate + 4) >> 3;
+	neighbor->FrequencyOffset = entry->FrequencyOffset;
+	neighbor->LastSeen = entry->LastSeen;
+	neighbor->RxCount = entry->RxCount;
+	neighbor->TxCount = entry->TxCount;
+}
+
+// Hands a buffer back to whoever queued it.  The MAC's own association frames and block ACKs are not reported to the
+// application, and mesh buffers are freed, reporting the application buffer they were copied from, if any.
+void ReportPacket(U8 *txBuffer, U8 sent, tTransmitErrors error)
+{
+	U8 i;
+
+	i = FindMeshBuffer(txBuffer);
+	if (i != kNoPacket)
+	{
+		openRFPrivateData.meshBuffers[i].State = kMeshFree;
+		txBuffer = openRFPrivateData.meshBuffers[i].Owner;
+		if (!txBuffer)
+			return;
+	}
+	if (txBuffer == openRFPrivateData.associateResponse)
+		return;
+	if (txBuffer == openRFPrivateData.arqBlockAck)
+	{
+		openRFPrivateData.arqBlockAckQueued = 0;
+		return;
+	}
+	if (sent)
+		NotifyMacPacketSent(txBuffer);
+	else
+		NotifyMacPacketSendError(txBuffer, error);
+}
+
+// Takes a packet off the queue and reports it.  Every packet in an aggregate frame goes the same way, and all of them
+// leave the queue before any is reported, so nothing queued from a notification can be mistaken for one of them.
+void CompletePacket(U8 index, U8 sent, tTransmitErrors error)
+{
+	tQueuedPacket *packet;
+	tRoute *route;
+	U8 *done[kMaxMessageQueueSize];
+	U8 count, i;
+
+	count = 0;
+	if (openRFPrivateData.txQueue[index].Aggregated)
+	{
+		i = 0;
+		while (i < openRFPrivateData.txQueueCount)
+			if (openRFPrivateData.txQueue[i].Aggregated)
+				done[count++] = RemovePacket(i);
+			else
+				i++;
+		openRFPrivateData.aggregateLength = 0;
+	}
+	else
+	{
+		packet = &openRFPrivateData.txQueue[index];
+		// a next hop that has stopped ACKing takes its routes with it, and one that ACKs keeps the route alive
+		if (packet->PacketType == kMeshPacketType)
+		{
+			if (!sent && error == kNoAck)
+				DropRoutesVia(packet->DestAddress);
+			else if (sent && (route = FindRoute(ReadMac(&packet->TxBuffer[1]))) != 0)
+				route->Age = 0;
+		}
+		done[count++] = RemovePacket(index);
+	}
+	for (i = 0; i < count; i++)
+		ReportPacket(done[i], sent, error);
+}
+
+// SDU bytes each fragment carries
+U8 FragmentSize(void)
+{
+	return OpenRFMaxSDULength() - kFragmentHeaderLength;
+}
+
+// Fragments an SDU of 'length' bytes goes out in
+U16 FragmentCount(U16 length)
+{
+	return (length + FragmentSize() - 1) / FragmentSize();
+}
+
+// Non-zero if 'packet' is too long for one frame
+U8 IsFragmented(tQueuedPacket *packet)
+{
+	return packet->Length > OpenRFMaxSDULength();
+}
+
+// Non-zero if 'packet' has fragments left after the one on its way
+U8 MoreFragments(tQueuedPacket *packet)
+{
+	return IsFragmented(packet) && (U16)(packet->Fragment + 1) < FragmentCount(packet->Length);
+}
+
+// Copies the fragment of 'packet' on its way into fragment, behind its header
+void LoadFragment(tQueuedPacket *packet)
+{
+	U16 offset;
+	U8 size, i;
+
+	size = FragmentSize();
+	offset = (U16)packet->Fragment * size;
+	if (packet->Length - offset < size)
+		size = packet->Length - offset;
+	openRFPrivateData.fragment[0] = packet->Tag;
+	openRFPrivateData.fragment[1] = (packet->Fragment << 4) | (U8)(FragmentCount(packet->Length) - 1);
+	for (i = 0; i < size; i++)
+		openRFPrivateData.fragment[kFragmentHeaderLength + i] = packet->TxBuffer[offset + i];
+	openRFPrivateData.fragmentLength = kFragmentHeaderLength + size;
+}
+
+// Non-zero if 'packet' goes out as a selective repeat frame.  Fragmented packets never do.
+U8 IsWindowed(tQueuedPacket *packet)
+{
+	return packet->Windowed || (packet->Sequence == kNoSequence && openRFPrivateData.arqWindow
+		&& packet->PacketType == kUniAckPacketType && packet->DestAddress.U32 == openRFPrivateData.arqPeer.U32
+		&& !IsFragmented(packet));
+}
+
+// Non-zero if the packet at 'index' can go out now.  A new windowed frame has to fall within arqWindow of the oldest one
+// still waiting for a block ACK.
+U8 CanSend(U8 index)
+{
+	tQueuedPacket *oldest;
+
+	if (index >= openRFPrivateData.txQueueCount)
+		return 0;
+	if (!IsWindowed(&openRFPrivateData.txQueue[index]) || openRFPrivateData.txQueue[index].Windowed)
+		return 1;
+	oldest = &openRFPrivateData.txQueue[0];
+	if (!oldest->Windowed)
+		return 1;
+	return ((openRFPrivateData.arqNextSequence - oldest->Sequence) & kSequenceMask) < openRFPrivateData.arqWindow;
+}
+
+// Non-zero if 'packet' could go out in an aggregate frame.  Only packets that have never been sent qualify, so a UniAck
+// packet already on its way keeps the frame it was first sent in.
+U8 CanAggregate(tQueuedPacket *packet)
+{
+	return openRFPrivateData.aggregateMax && packet->Sequence == kNoSequence && !IsWindowed(packet)
+		&& packet->Length < openRFPrivateData.aggregateMax
+		&& (packet->PacketType == kUniAckPacketType || packet->PacketType == kUniNoAckPacketType
+			|| packet->PacketType == kMulticastPacketType);
+}
+
+// Non-zero if the packet at 'index' should wait for more to join it.  It waits until aggregateDelay is up or the packets
+// queued for the same destination would fill an aggregate frame.
+U8 HoldForAggregate(U8 index)
+{
+	tQueuedPacket *first, *packet;
+	U16 waited, length;
+	U8 i;
+
+	first = &openRFPrivateData.txQueue[index];
+	if (!openRFPrivateData.aggregateDelay || openRFPrivateData.aggregateLength || !CanAggregate(first))
+		return 0;
+	DisableInterrupts;
+	waited = openRFPrivateData.msTicks - first->QueuedTime;
+	EnableInterrupts;
+	if (waited >= openRFPrivateData.aggregateDelay)
+		return 0;
+	length = 0;
+	for (i = index; i < openRFPrivateData.txQueueCount; i++)
+	{
+		packet = &openRFPrivateData.txQueue[i];
+		if (CanAggregate(packet) && packet->PacketType == first->PacketType
+			&& packet->DestAddress.U32 == first->DestAddress.U32)
+			length += packet->Length + 1;
+	}
+	return length < openRFPrivateData.aggregateMax;
+}
+
+// Copies the packet at 'index' and those queued behind it for the same destination into the aggregate frame, as many as
+// fit.  A packet with nothing to join it goes out on its own.
+void BuildAggregate(U8 index)
+{
+	tQueuedPacket *first, *packet;
+	U8 i, j, length, count;
+
+	first = &openRFPrivateData.txQueue[index];
+	if (first->Aggregated || openRFPrivateData.aggregateLength || !CanAggregate(first))
+		return;
+	length = 0;
+	count = 0;
+	for (i = index; i < openRFPrivateData.txQueueCount; i++)
+	{
+		packet = &openRFPrivateData.txQueue[i];
+		if (!CanAggregate(packet) || packet->PacketType != first->PacketType
+			|| packet->DestAddress.U32 != first->DestAddress.U32
+			|| length + 1 + packet->Length > openRFPrivateData.aggregateMax)
+			continue;
+		openRFPrivateData.aggregate[length++] = packet->Length;
+		for (j = 0; j < packet->Length; j++)
+			openRFPrivateData.aggregate[length++] = packet->TxBuffer[j];
+		packet->Aggregated = 1;
+		count++;
+	}
+	if (count > 1)
+		openRFPrivateData.aggregateLength = length;
+	else
+		first->Aggregated = 0;
+}
+
+// SDU 'packet' goes out with, the aggregate frame if it is the first packet of one or the fragment on its way if it is
+// fragmented
+U8 *SendBuffer(tQueuedPacket *packet)
+{
+	if (packet->Aggregated)
+		return openRFPrivateData.aggregate;
+	return IsFragmented(packet) ? openRFPrivateData.fragment : packet->TxBuffer;
+}
+U8 SendLength(tQueuedPacket *packet)
+{
+	if (packet->Aggregated)
+		return openRFPrivateData.aggregateLength;
+	return IsFragmented(packet) ? openRFPrivateData.fragmentLength : (U8)packet->Length;
+}
+
+// Goes back to listening the way the application asked, unless something is on the air or waiting for an ACK
+void ResumeListening(void)
+{
+	if (openRFPrivateData.isListening && openRFPrivateData.txSending == kNoPacket && !openRFPrivateData.awaitingAck
+		&& !openRFPrivateData.beaconSending)
+		RadioReceivePacket(openRFPrivateData.radio, openRFPrivateData.listenMode, openRFPrivateData.listenPeriod);
+}
+
+// mSec without a beacon before a slave unlocks.  The timers are 16 bits, so it has to come before they wrap.
+U16 LockLossTime(void)
+{
+	U32 time;
+
+	time = (U32)openRFPrivateData.frameLength * kTdmaLockLoss;
+	return (time > 0xFFFF) ? 0xFFFF : (U16)time;
+}
+
+// numerator * 2^bits / denominator without overflowing.  The fractional bits come one at a time by long division, and a
+// quotient that would not fit saturates.
+S32 ScaledRatio(S32 numerator, U32 denominator, U8 bits)
+{
+	U32 quotient, remainder;
+
+	quotient = (numerator < 0) ? 0 - (U32)numerator : (U32)numerator;
+	remainder = quotient % denominator;
+	quotient /= denominator;
+	while (bits--)
+	{
+		if (quotient & 0x40000000UL)
+			return (numerator < 0) ? -0x7FFFFFFFL : 0x7FFFFFFFL;
+		quotient <<= 1;
+		remainder <<= 1;
+		if (remainder >= denominator)
+		{
+			quotient++;
+			remainder -= denominator;
+		}
+	}
+	return (numerator < 0) ? -(S32)quotient : (S32)quotient;
+}
+
+// uSec a clock running 'skew' faster gains over 'interval' uSec.  skew is within kMaxClockSkew, so splitting the interval
+// into 16 bit halves keeps both products inside 32 bits.
+S32 SkewCorrection(S32 skew, U32 interval)
+{
+	U32 magnitude, high, low, correction;
+
+	magnitude = (skew < 0) ? 0 - (U32)skew : (U32)skew;
+	high = magnitude * (interval >> 16);
+	low = magnitude * (interval & 0xFFFF);
+	correction = (high >> 8) + ((((high & 0xFF) << 16) + low) >> 24);
+	return (skew < 0) ? -(S32)correction : (S32)correction;
+}
+
+// Fits a line through the offsets in syncOffsets by least squares.  Everything is taken relative to the newest point, and
+// the times are scaled down until the sums fit in 32 bits.  A fit that comes out implausible starts again from the newest
+// point alone.
+void FitClock(void)
+{
+	U32 span, deviation, interval, meanInterval;
+	S32 x[kTimeSyncPoints], y[kTimeSyncPoints], meanX, meanY, sumX, sumY, sumXY, skew, intercept, error;
+	U32 sumXX;
+	U8 newest, count, i, yBits, xBits, shift;
+
+	count = openRFPrivateData.syncCount;
+	newest = (openRFPrivateData.syncHead + kTimeSyncPoints - 1) % kTimeSyncPoints;
+	openRFPrivateData.syncReference = openRFPrivateData.syncLocal[newest];
+	openRFPrivateData.syncOffset = openRFPrivateData.syncOffsets[newest];
+	openRFPrivateData.syncSkew = 0;
+	openRFPrivateData.syncResidual = 0;
+	if (count < 2)
+		return;
+	span = 0;
+	deviation = 0;
+	for (i = 0; i < count; i++)
+	{
+		interval = openRFPrivateData.syncReference - openRFPrivateData.syncLocal[i];
+		if (interval > span)
+			span = interval;
+		y[i] = openRFPrivateData.syncOffsets[i] - openRFPrivateData.syncOffset;
+		interval = (y[i] < 0) ? 0 - (U32)y[i] : (U32)y[i];
+		if (interval > deviation)
+			deviation = interval;
+	}
+	if (deviation >= kMaxSyncDeviation)
+	{
+		openRFPrivateData.syncLocal[0] = openRFPrivateData.syncReference;
+		openRFPrivateData.syncOffsets[0] = openRFPrivateData.syncOffset;
+		openRFPrivateData.syncHead = 1;
+		openRFPrivateData.syncCount = 1;
+		return;
+	}
+	// Each x(i) * y(i) term has to fit kTimeSyncPoints times over, so x gets whatever y leaves of 31 bits
+	for (yBits = 1; deviation >> yBits; yBits++)
+		;
+	xBits = 26 - yBits;
+	if (xBits > 12)
+		xBits = 12;
+	for (shift = 0; (span >> shift) >> xBits; shift++)
+		;
+	sumX = 0;
+	sumY = 0;
+	for (i = 0; i < count; i++)
+	{
+		x[i] = -(S32)((openRFPrivateData.syncReference - openRFPrivateData.syncLocal[i]) >> shift);
+		sumX += x[i];
+		sumY += y[i];
+	}
+	meanX = sumX / count;
+	meanY = sumY / count;
+	sumXX = 0;
+	sumXY = 0;
+	for (i = 0; i < count; i++)
+	{
+		sumXX += (U32)((x[i] - meanX) * (x[i] - meanX));
+		sumXY += (x[i] - meanX) * (y[i] - meanY);
+	}
+	if (!sumXX)
+		return;
+	// the slope is sumXY / sumXX per 2^shift uSec
+	if (shift > 24)
+		skew = ScaledRatio(sumXY, sumXX << (shift - 24), 0);
+	else
+		skew = ScaledRatio(sumXY, sumXX, 24 - shift);
+	if (skew > kMaxClockSkew || skew < -kMaxClockSkew)
+	{
+		openRFPrivateData.syncLocal[0] = openRFPrivateData.syncReference;
+		openRFPrivateData.syncOffsets[0] = openRFPrivateData.syncOffset;
+		openRFPrivateData.syncHead = 1;
+		openRFPrivateData.syncCount = 1;
+		return;
+	}
+	// the line goes through the means, so carry that forward to the newest point
+	meanInterval = (U32)-meanX << shift;
+	intercept = meanY + SkewCorrection(skew, meanInterval);
+	for (i = 0; i < count; i++)
+	{
+		error = y[i] - intercept + SkewCorrection(skew, openRFPrivateData.syncReference - openRFPrivateData.syncLocal[i]);
+		if (error < 0)
+			error = -error;
+		if (error > openRFPrivateData.syncResidual)
+			openRFPrivateData.syncResidual = (error > 0xFFFF) ? 0xFFFF : (U16)error;
+	}
+	openRFPrivateData.syncOffset += intercept;
+	openRFPrivateData.syncSkew = skew;
+}
+
+// Adds the master's time less ours at 'local' to the fit, replacing the oldest point once there are kTimeSyncPoints
+void AddSyncPoint(U32 local, S32 offset)
+{
+	openRFPrivateData.syncLocal[openRFPrivateData.syncHead] = local;
+	openRFPrivateData.syncOffsets[openRFPrivateData.syncHead] = offset;
+	openRFPrivateData.syncHead = (openRFPrivateData.syncHead + 1) % kTimeSyncPoints;
+	if (openRFPrivateData.syncCount < kTimeSyncPoints)
+		openRFPrivateData.syncCount++;
+	FitClock();
+}
+
+// uSec into the superframe by the master's clock.  Slaves correct their own clock by the measured skew, and bridge a
+// missed beacon by assuming the superframe went on with the period of the last ones.
+U32 SuperframeElapsed(void)
+{
+	U32 elapsed;
+
+	DisableInterrupts;
+	elapsed = GetMicroseconds() - openRFPrivateData.superframeStart;
+	EnableInterrupts;
+	if (openRFPrivateData.isCoordinator)
+		return elapsed;
+	elapsed += SkewCorrection(openRFPrivateData.syncSkew, elapsed);
+	return elapsed % openRFPrivateData.beaconPeriod;
+}
+
+// uSec from a frame being started to it going on the air, the slowest the radio has taken to get to TX so far
+U32 TxStartup(void)
+{
+	tModeLatency latency;
+
+	RadioGetModeLatency(openRFPrivateData.radio, kTransmitMode, &latency);
+	return latency.Maximum;
+}
+
+// Non-zero if 'packet' can start now.  Under a superframe, nodes only start frames in their own slot, once kTdmaGuardTime
+// into it, and only if the frame and its ACK end kTdmaGuardTime before the slot does.  The receiver takes about as long
+// to switch to TX for the ACK as we do.  Slaves without a slot hold their packets.  Block ACKs answer a frame sent in the
+// other node's slot, and association requests come from nodes that have no slot yet, so neither waits.
+U8 SlotHasRoom(tQueuedPacket *packet)
+{
+	U32 elapsed, start, airtime;
+	U8 slot, shortAddress;
+
+	if (packet->PacketType == (kAckPacketType | kBlockAckFlag) || packet->PacketType == kAssociatePacketType)
+		return 1;
+	if (openRFPrivateData.isCoordinator && openRFPrivateData.tdmaSlotCount)
+		slot = 0;
+	else if (openRFPrivateData.isLocked)
+	{
+		shortAddress = RadioGetShortAddress(openRFPrivateData.radio);
+		if (shortAddress == kNoShortAddress || shortAddress > openRFPrivateData.tdmaSlotCount)
+			return 0;
+		slot = shortAddress - kCoordinatorShortAddress;
+	}
+	else
+		return 1;
+	elapsed = SuperframeElapsed();
+	start = (U32)slot * openRFPrivateData.tdmaSlotLength * 1000;
+	if (elapsed < start + kTdmaGuardTime)
+		return 0;
+	airtime = TxStartup() + RadioGetAirtime(openRFPrivateData.radio, SendLength(packet), packet->PreambleCount);
+	if (packet->PacketType == kUniAckPacketType || packet->PacketType == kMeshPacketType)
+		airtime += TxStartup() + RadioGetAirtime(openRFPrivateData.radio, kBlockAckLength, 0);
+	return elapsed + airtime + kTdmaGuardTime <= start + (U32)openRFPrivateData.tdmaSlotLength * 1000;
+}
+
+// Starts the master's next superframe.  Nodes that are not locked yet send whenever they like, so the beacon waits for
+// them to finish.  A beacon the radio turns down is tried again a superframe later.
+void SendBeacon(void)
+{
+	UU32 everyone, sync;
+	U8 i, rssi;
+
+	if (openRFPrivateData.ccaThreshold && RadioReadChannelRSSI(openRFPrivateData.radio, &rssi)
+		&& rssi < openRFPrivateData.ccaThreshold)
+		return;
+	openRFPrivateData.beacon[0] = openRFPrivateData.tdmaSlotCount;
+	openRFPrivateData.beacon[1] = openRFPrivateData.tdmaSlotLength;
+	openRFPrivateData.beacon[2] = openRFPrivateData.beaconSequence;
+	sync.U32 = openRFPrivateData.beaconSync;
+	for (i = 0; i < 4; i++)
+	{
+		openRFPrivateData.beacon[3 + i] = sync.U8[i];
+		openRFPrivateData.beacon[7 + i] = _RTCDateTimeInSecs.U8[i];
+	}
+	everyone.U32 = 0xFFFFFFFF;
+	openRFPrivateData.beaconSending = 1;
+	if (RadioSendPacket(openRFPrivateData.radio, everyone, kBeaconPacketType, kBeaconLength, openRFPrivateData.beacon, 0,
+			0))
+		return;
+	openRFPrivateData.beaconSending = 0;
+	openRFPrivateData.superframeStart = GetMicroseconds();
+}
+
+// Next backoff slot from the LFSR
+U16 NextRandom(void)
+{
+	U16 lfsr;
+
+	lfsr = openRFPrivateData.csmaRandom;
+	lfsr = (lfsr >> 1) ^ ((lfsr & 1) ? kBackoffPolynomial : 0);
+	openRFPrivateData.csmaRandom = lfsr;
+	return lfsr;
+}
+
+// Waits before looking at the channel again.  The window doubles with each busy check, from 2^kCsmaMinBackoffExponent
+// mSec up to 2^kCsmaMaxBackoffExponent.
+void StartBackoff(void)
+{
+	U8 exponent;
+
+	exponent = kCsmaMinBackoffExponent + openRFPrivateData.csmaAttempts - 1;
+	if (exponent > kCsmaMaxBackoffExponent)
+		exponent = kCsmaMaxBackoffExponent;
+	openRFPrivateData.channelStatistics.Backoffs++;
+	ClearOpenRFTimer(kBackoffTimer);
+	openRFPrivateData.csmaBackoff = (NextRandom() & ((1 << exponent) - 1)) + 1;
+	openRFPrivateData.channelStatistics.BackoffTime += openRFPrivateData.csmaBackoff;
+}
+
+// Puts the packet at txSending on the air once the channel is clear.  Returns zero if it failed instead, having taken it
+// off the queue; otherwise it is on the air, waiting out a backoff, or handed on as lost.  A fragment that follows straight
+// on from the one before goes without looking, as the channel is still ours.
+U8 TransmitQueued(void)
+{
+	tQueuedPacket *packet;
+	U8 i, rssi;
+
+	i = openRFPrivateData.txSending;
+	packet = &openRFPrivateData.txQueue[i];
+	if (openRFPrivateData.ccaThreshold && !openRFPrivateData.fragmentFollowing)
+	{
+		if (RadioReadChannelRSSI(openRFPrivateData.radio, &rssi))
+			openRFPrivateData.csmaWait = 0;
+		else if (openRFPrivateData.csmaWait < kCsmaReadingTimeout)
+		{
+			// The receiver has to be on to hear anyone, and the tick takes the reading, so look again a mSec later.  This
+			// runs from the radio callbacks, so it must not wait here.
+			if (!openRFPrivateData.csmaWarmup)
+			{
+				openRFPrivateData.csmaWarmup = 1;
+				RadioReceivePacket(openRFPrivateData.radio, kContinuous, 0);
+			}
+			openRFPrivateData.csmaWait++;
+			ClearOpenRFTimer(kBackoffTimer);
+			openRFPrivateData.csmaBackoff = 1;
+			return 1;
+		}
+		else
+		{
+			// still no reading, which says nothing about the channel, so it counts as busy
+			openRFPrivateData.csmaWait = 0;
+			rssi = 0;
+		}
+		// SX1231 RSSI is -value/2 dBm, so a lower value is a stronger signal
+		if (rssi < openRFPrivateData.ccaThreshold)
+		{
+			openRFPrivateData.channelStatistics.BusyChecks++;
+			if (++openRFPrivateData.csmaAttempts < openRFPrivateData.csmaMaxAttempts)
+			{
+				StartBackoff();
+				return 1;
+			}
+			openRFPrivateData.channelStatistics.AccessFailures++;
+			// a windowed frame is left to the block ACK to report missing, like one lost on the air
+			if (packet->Windowed)
+			{
+				TransmitDone(0);
+				return 1;
+			}
+			openRFPrivateData.txSending = kNoPacket;
+			CompletePacket(i, 0, kChannelBusy);
+			return 0;
+		}
+		openRFPrivateData.channelStatistics.ClearChecks++;
+		openRFPrivateData.noiseFloor = openRFPrivateData.noiseFloor
+			? MovingAverage(openRFPrivateData.noiseFloor, rssi) : (U16)(rssi << 3);
+	}
+	if (RadioSendPacket(openRFPrivateData.radio, packet->DestAddress, openRFPrivateData.txPacketType, SendLength(packet),
+			SendBuffer(packet), packet->PreambleCount, 0))
+		return 1;
+	openRFPrivateData.txSending = kNoPacket;
+	CompletePacket(i, 0, kFifoOverflow);
+	return 0;
+}
+
+// Puts the next packet on the air if nothing else is.  Plain UniAck frames wait for their ACK.  Windowed frames go out
+// back to back, and the last one the window allows asks for a block ACK.  When no new frame can go, the oldest frame
+// still waiting is sent again to ask for one.
+// Packets the radio turns down straight away fail and the next one is tried.  Returns zero if nothing was started.
+U8 ServiceTxQueue(void)
+{
+	tQueuedPacket *packet;
+	tPacketTypes packetType;
+	U8 i, sequence;
+
+	for (;;)
+	{
+		DisableInterrupts;
+		if (openRFPrivateData.txSending != kNoPacket || openRFPrivateData.awaitingAck || openRFPrivateData.beaconSending)
+		{
+			EnableInterrupts;
+			return 0;
+		}
+		i = openRFPrivateData.txSentCount;
+		if (openRFPrivateData.arqProbe || !CanSend(i))
+		{
+			openRFPrivateData.arqProbe = 0;
+			if (!i)
+			{
+				EnableInterrupts;
+				return 0;
+			}
+			i = 0;
+		}
+		openRFPrivateData.txSending = i;
+		EnableInterrupts;
+		packet = &openRFPrivateData.txQueue[i];
+		if (HoldForAggregate(i))
+		{
+			openRFPrivateData.txSending = kNoPacket;
+			return 0;
+		}
+		BuildAggregate(i);
+		if (IsFragmented(packet))
+			LoadFragment(packet);
+		if (!SlotHasRoom(packet))
+		{
+			openRFPrivateData.txSending = kNoPacket;
+			return 0;
+		}
+		packetType = packet->PacketType;
+		openRFPrivateData.txRequested = 0;
+		if (IsWindowed(packet))
+		{
+			if (!packet->Windowed)
+			{
+				packet->Windowed = 1;
+				packet->Sequence = openRFPrivateData.arqNextSequence;
+				openRFPrivateData.arqNextSequence = (openRFPrivateData.arqNextSequence + 1) & kSequenceMask;
+			}
+			sequence = packet->Sequence;
+			if (i < openRFPrivateData.txSentCount || !CanSend(i + 1) || !IsWindowed(&openRFPrivateData.txQueue[i + 1]))
+			{
+				sequence |= kBlockAckRequest;
+				openRFPrivateData.txRequested = 1;
+			}
+			// the oldest frame still waiting tells the receiver it can stop waiting for anything older
+			RadioSetSequence(openRFPrivateData.radio, sequence, openRFPrivateData.txQueue[0].Sequence);
+			packetType = (tPacketTypes)(kUniAckPacketType | kBlockAckFlag);
+		}
+		else if (packetType == kUniAckPacketType || packetType == kMeshPacketType)
+		{
+			if (packet->Sequence == kNoSequence)
+			{
+				packet->Sequence = openRFPrivateData.txNextSequence;
+				openRFPrivateData.txNextSequence = (openRFPrivateData.txNextSequence + 1) & kSequenceMask;
+			}
+			RadioSetSequence(openRFPrivateData.radio, packet->Sequence, 0);
+			openRFPrivateData.txRequested = 1;
+		}
+		if (packet->Aggregated)
+			packetType = (tPacketTypes)(packetType | kAggregateFlag);
+		if (IsFragmented(packet))
+			packetType = (tPacketTypes)(packetType | kFragmentFlag);
+		openRFPrivateData.txPacketType = packetType;
+		openRFPrivateData.csmaAttempts = 0;
+		openRFPrivateData.csmaWarmup = 0;
+		openRFPrivateData.csmaWait = 0;
+		openRFPrivateData.fragmentFollowing = 0;
+		// every neighbour that hears a route request passes it on straight away, so they each back off first, over the
+		// widest window
+		if (packetType == kRouteRequestPacketType)
+		{
+			openRFPrivateData.csmaAttempts = kCsmaMaxBackoffExponent - kCsmaMinBackoffExponent + 1;
+			StartBackoff();
+			openRFPrivateData.csmaAttempts = 0;
+			return 1;
+		}
+		if (TransmitQueued())
+			return 1;
+	}
+}
+
+// Sends the next fragment of the packet at 'index' once the one before has gone, or been ACKed, without contending for
+// the channel again.  UniAck fragments each get a sequence number of their own.  Under a superframe a fragment that does
+// not fit in what is left of the slot waits for the next one, and the channel is checked again then.
+void SendNextFragment(U8 index)
+{
+	tQueuedPacket *packet;
+
+	packet = &openRFPrivateData.txQueue[index];
+	packet->Fragment++;
+	LoadFragment(packet);
+	openRFPrivateData.txRequested = 0;
+	if (packet->PacketType == kUniAckPacketType)
+	{
+		packet->Sequence = openRFPrivateData.txNextSequence;
+		openRFPrivateData.txNextSequence = (openRFPrivateData.txNextSequence + 1) & kSequenceMask;
+		RadioSetSequence(openRFPrivateData.radio, packet->Sequence, 0);
+		openRFPrivateData.txRequested = 1;
+	}
+	if (!SlotHasRoom(packet))
+	{
+		ResumeListening();
+		return;
+	}
+	openRFPrivateData.txSending = index;
+	openRFPrivateData.csmaAttempts = 0;
+	openRFPrivateData.fragmentFollowing = 1;
+	if (!TransmitQueued() && !ServiceTxQueue())
+		ResumeListening();
+}
+
+// Called once the packet on the air has gone, or failed to.  UniAck frames stay queued either way, as the ACK says
+// whether they arrived.
+void TransmitDone(U8 sent)
+{
+	U8 i;
+
+	i = openRFPrivateData.txSending;
+	if (i == kNoPacket)
+		return;
+	openRFPrivateData.txSending = kNoPacket;
+	if (openRFPrivateData.txQueue[i].Sequence == kNoSequence)
+	{
+		if (sent && MoreFragments(&openRFPrivateData.txQueue[i]))
+		{
+			SendNextFragment(i);
+			return;
+		}
+		// the only send error RadioAPI reports is the FIFO running dry part way through a streamed frame
+		CompletePacket(i, sent, kFifoUnderflow);
+	}
+	else
+	{
+		if (openRFPrivateData.txQueue[i].Windowed && i == openRFPrivateData.txSentCount)
+			openRFPrivateData.txSentCount++;
+		if (openRFPrivateData.txRequested)
+		{
+			openRFPrivateData.awaitingAck = 1;
+			openRFPrivateData.ackIndex = i;
+			ClearOpenRFTimer(kAckTimer);
+			RadioReceivePacket(openRFPrivateData.radio, kContinuous, 0);
+			return;
+		}
+	}
+	if (!ServiceTxQueue())
+		ResumeListening();
+}
+
+// Called once the beacon has gone, or failed to.  The superframe starts as the sync word ends, which is also when the
+// slaves that heard it start theirs.  A beacon that failed was heard by no one, so its sequence number is used again.
+void BeaconDone(U8 sent)
+{
+	openRFPrivateData.beaconSending = 0;
+	if (sent)
+	{
+		openRFPrivateData.superframeStart = RadioGetTxTimestamp(openRFPrivateData.radio);
+		openRFPrivateData.beaconSync = openRFPrivateData.superframeStart;
+		openRFPrivateData.beaconSequence++;
+	}
+	else
+		openRFPrivateData.superframeStart = GetMicroseconds();
+	if (!ServiceTxQueue())
+		ResumeListening();
+}
+
+// Locks on to the master's superframe and takes the time from it.  The master's time for the beacon before this one is
+// paired with when we heard that one, and the gap between consecutive pairs is the beacon period.
+void HandleBeacon(U8 length, U8 *SDU)
+{
+	UU32 master;
+	U32 local, frameTime, period;
+	U8 i;
 
-U8 _rssi;
-U16 counterA,x,y;
-// Amount of time to queue a packet before transmitting it
-#define TXQUEUETIME 7
-U8 syncQueued = 0;
-U8 syncTransmitted = 0;
-extern UU32 _RTCDateTimeInSecs;
+	if (length >= kBeaconLength && SDU[0] && SDU[1] && !openRFPrivateData.isCoordinator)
+	{
+		local = openRFPrivateData.rxMetadata.SyncTimestamp;
+		ClearOpenRFTimer(kLockTimer);
+		openRFPrivateData.tdmaSlotCount = SDU[0];
+		openRFPrivateData.tdmaSlotLength = SDU[1];
+		openRFPrivateData.frameLength = (U16)SDU[0] * SDU[1];
+		frameTime = (U32)openRFPrivateData.frameLength * 1000;
+		for (i = 0; i < 4; i++)
+		{
+			master.U8[i] = SDU[3 + i];
+			_RTCDateTimeInSecs.U8[i] = SDU[7 + i];
+		}
+		if (!openRFPrivateData.isLocked)
+		{
+			openRFPrivateData.syncCount = 0;
+			openRFPrivateData.syncHead = 0;
+			// until two beacons in a row have been paired, the period is the superframe and the beacon's own airtime
+			openRFPrivateData.beaconPeriod = frameTime + RadioGetAirtime(openRFPrivateData.radio, kBeaconLength, 0);
+		}
+		else if (SDU[2] == (U8)(openRFPrivateData.beaconHeard + 1))
+		{
+			period = master.U32 - openRFPrivateData.pairedMaster;
+			if (openRFPrivateData.syncCount && openRFPrivateData.pairedSequence == (U8)(openRFPrivateData.beaconHeard - 1)
+				&& period > frameTime && period < frameTime + frameTime / 2)
+				openRFPrivateData.beaconPeriod = period;
+			openRFPrivateData.pairedSequence = openRFPrivateData.beaconHeard;
+			openRFPrivateData.pairedMaster = master.U32;
+			AddSyncPoint(openRFPrivateData.beaconLocal, (S32)(master.U32 - openRFPrivateData.beaconLocal));
+		}
+		openRFPrivateData.beaconHeard = SDU[2];
+		openRFPrivateData.beaconLocal = local;
+		openRFPrivateData.superframeStart = local;
+		openRFPrivateData.isLocked = 1;
+		openRFPrivateData.alreadyHopped = 0;
+	}
+	ResumeListening();
+}
+
+// Completes the plain UniAck frame an ACK is for, or sends its next fragment
+void HandleAck(UU32 source)
+{
+	U8 i;
+
+	i = openRFPrivateData.ackIndex;
+	if (!openRFPrivateData.awaitingAck || openRFPrivateData.txQueue[i].Windowed
+		|| source.U32 != openRFPrivateData.txQueue[i].DestAddress.U32)
+		return;
+	openRFPrivateData.awaitingAck = 0;
+	openRFPrivateData.ackRetryCounter = 0;
+	TriedNeighbor(source, 1);
+	if (MoreFragments(&openRFPrivateData.txQueue[i]))
+	{
+		SendNextFragment(i);
+		return;
+	}
+	CompletePacket(i, 1, kUndefined);
+	if (!ServiceTxQueue())
+		ResumeListening();
+}
+
+// Non-zero if a UniAck frame from 'source' repeats the last one heard from it.  The most recently heard peers are kept at
+// the front, and the one heard from longest ago drops off the end to make room.
+U8 IsDuplicate(UU32 source, U8 sequence)
+{
+	U8 i, duplicate;
+
+	for (i = 0; i < openRFPrivateData.sequenceCacheCount; i++)
+		if (openRFPrivateData.sequenceCache[i].Source.U32 == source.U32)
+			break;
+	duplicate = i < openRFPrivateData.sequenceCacheCount && openRFPrivateData.sequenceCache[i].Sequence == sequence;
+	if (i == openRFPrivateData.sequenceCacheCount && i < kSequenceCacheSize)
+		openRFPrivateData.sequenceCacheCount++;
+	if (i == kSequenceCacheSize)
+		i--;
+	for (; i > 0; i--)
+		openRFPrivateData.sequenceCache[i] = openRFPrivateData.sequenceCache[i - 1];
+	openRFPrivateData.sequenceCache[0].Source = source;
+	openRFPrivateData.sequenceCache[0].Sequence = sequence;
+	return duplicate;
+}
+
+// Fails every windowed frame still waiting for a block ACK
+void FailWindow(void)
+{
+	while (openRFPrivateData.txQueueCount && openRFPrivateData.txQueue[0].Windowed)
+		CompletePacket(0, 0, kNoAck);
+	openRFPrivateData.ackRetryCounter = 0;
+}
+
+// Completes the windowed frames a block ACK covers.  The rest go out again, oldest first.
+void HandleBlockAck(UU32 source, U8 length, U8 *SDU)
+{
+	tQueuedPacket *packet;
+	U8 i, offset;
+
+	if (!openRFPrivateData.awaitingAck || length != kBlockAckLength || !openRFPrivateData.txQueueCount
+		|| !openRFPrivateData.txQueue[0].Windowed || source.U32 != openRFPrivateData.txQueue[0].DestAddress.U32)
+		return;
+	openRFPrivateData.awaitingAck = 0;
+	openRFPrivateData.ackRetryCounter = 0;
+	TriedNeighbor(source, 1);
+	i = 0;
+	while (i < openRFPrivateData.txQueueCount && openRFPrivateData.txQueue[i].Windowed)
+	{
+		packet = &openRFPrivateData.txQueue[i];
+		offset = (packet->Sequence - SDU[0]) & kSequenceMask;
+		// behind the receiver's next sequence, or held by it
+		if (offset >= kSequenceHalf || (offset < 8 && (SDU[1] & (1 << offset))))
+			CompletePacket(i, 1, kUndefined);
+		else
+			i++;
+	}
+	openRFPrivateData.txSentCount = 0;
+	if (!ServiceTxQueue())
+		ResumeListening();
+}
+
+// Delivers the held frames that are now next in sequence
+void DeliverHeldFrames(UU32 source)
+{
+	U8 i;
+
+	while (openRFPrivateData.arqRxHeld & 0x01)
+	{
+		for (i = 0; i < kArqHeldFrames && openRFPrivateData.arqHeldSequence[i] != openRFPrivateData.arqRxNext; i++)
+			;
+		if (i < kArqHeldFrames)
+		{
+			NotifyMacPacketReceived(kUniAckPacketType, source, openRFPrivateData.arqHeldLength[i], openRFPrivateData.arqHeld[i],
+				_rssi);
+			openRFPrivateData.arqHeldSequence[i] = kNoSequence;
+		}
+		openRFPrivateData.arqRxNext = (openRFPrivateData.arqRxNext + 1) & kSequenceMask;
+		openRFPrivateData.arqRxHeld >>= 1;
+	}
+}
+
+// Moves the receive window on by one frame, whether or not it arrived
+void AdvanceReceiveWindow(UU32 source)
+{
+	openRFPrivateData.arqRxNext = (openRFPrivateData.arqRxNext + 1) & kSequenceMask;
+	openRFPrivateData.arqRxHeld >>= 1;
+	DeliverHeldFrames(source);
+}
+
+// Keeps a frame that arrived ahead of one still missing.  Frames there is no room for are dropped and sent again.
+void HoldFrame(U8 sequence, U8 offset, U8 length, U8 *SDU)
+{
+	U8 i, j;
+
+	for (i = 0; i < kArqHeldFrames && openRFPrivateData.arqHeldSequence[i] != kNoSequence; i++)
+		;
+	if (i == kArqHeldFrames)
+		return;
+	openRFPrivateData.arqHeldSequence[i] = sequence;
+	openRFPrivateData.arqHeldLength[i] = length;
+	for (j = 0; j < length; j++)
+		openRFPrivateData.arqHeld[i][j] = SDU[j];
+	openRFPrivateData.arqRxHeld |= 1 << offset;
+}
+
+// Receives a windowed frame: [sequence][base][SDU].  Frames go up in sequence order, and a block ACK goes back when the
+// sender asks for one.
+void HandleWindowedFrame(UU32 source, U8 length, U8 *SDU)
+{
+	U8 sequence, base, offset, i;
+
+	if (length < 2)
+		return;
+	sequence = SDU[0] & kSequenceMask;
+	base = SDU[1] & kSequenceMask;
+	if (!openRFPrivateData.arqRxActive || source.U32 != openRFPrivateData.arqRxPeer.U32)
+	{
+		// a new sender starts the window at its oldest frame
+		openRFPrivateData.arqRxActive = 1;
+		openRFPrivateData.arqRxPeer = source;
+		openRFPrivateData.arqRxNext = base;
+		openRFPrivateData.arqRxHeld = 0;
+		for (i = 0; i < kArqHeldFrames; i++)
+			openRFPrivateData.arqHeldSequence[i] = kNoSequence;
+	}
+	// the sender has finished with everything before base, delivered or not
+	offset = (base - openRFPrivateData.arqRxNext) & kSequenceMask;
+	if (offset < kSequenceHalf)
+		while (offset--)
+			AdvanceReceiveWindow(source);
+	offset = (sequence - openRFPrivateData.arqRxNext) & kSequenceMask;
+	if (!offset)
+	{
+		NotifyMacPacketReceived(kUniAckPacketType, source, length - 2, SDU + 2, _rssi);
+		AdvanceReceiveWindow(source);
+	}
+	else if (offset < 8 && !(openRFPrivateData.arqRxHeld & (1 << offset)))
+		HoldFrame(sequence, offset, length - 2, SDU + 2);
+	// anything else has been delivered already, or is too far ahead to hold
+	if (!(SDU[0] & kBlockAckRequest))
+	{
+		ResumeListening();
+		return;
+	}
+	openRFPrivateData.arqBlockAck[0] = openRFPrivateData.arqRxNext;
+	openRFPrivateData.arqBlockAck[1] = openRFPrivateData.arqRxHeld;
+	// a block ACK still in the queue just goes out with the new bitmap
+	if (!openRFPrivateData.arqBlockAckQueued)
+		openRFPrivateData.arqBlockAckQueued = QueuePacket(source, (tPacketTypes)(kAckPacketType | kBlockAckFlag), kBlockAckLength,
+			openRFPrivateData.arqBlockAck, 0, 0xFF);
+	if (!ServiceTxQueue())
+		ResumeListening();
+}
+
+// Coordinators answer association requests, nodes take the short addresses from the answers
+void HandleAssociation(UU32 source, U8 length, U8 *SDU)
+{
+	if (openRFPrivateData.isCoordinator && !length)
+	{
+		openRFPrivateData.associateResponse[0] = AssignShortAddress(source);
+		openRFPrivateData.associateResponse[1] = kCoordinatorShortAddress;
+		// ahead of anything the application has queued, so the node gets it while it is still listening
+		if (QueuePacket(source, kAssociatePacketType, kAssociateResponseLength, openRFPrivateData.associateResponse, 0, 0xFF))
+			ServiceTxQueue();
+	}
+	else if (!openRFPrivateData.isCoordinator && length == kAssociateResponseLength && SDU[0] != kNoShortAddress)
+	{
+		// frames to the coordinator can now go short
+		RadioSetShortPeer(openRFPrivateData.radio, source, SDU[1]);
+		RadioSetShortAddress(openRFPrivateData.radio, SDU[0]);
+	}
+}
+
+// Passes each SDU of an aggregate frame up in turn.  A record that runs past the end of the frame ends it.
+void DeliverAggregate(tPacketTypes packetType, UU32 source, U8 length, U8 *SDU)
+{
+	U8 size;
+
+	while (length)
+	{
+		size = SDU[0];
+		if (size >= length)
+			return;
+		NotifyMacPacketReceived(packetType, source, size, SDU + 1, _rssi);
+		SDU += size + 1;
+		length -= size + 1;
+	}
+}
+
+// Puts a fragmented SDU back together: [tag][index:4 | count less one:4][fragment].  One message is reassembled at a
+// time.  Fragments have to come in order, so one going missing loses the message, and a first fragment starts a new one.
+void HandleFragment(tPacketTypes packetType, UU32 source, U8 length, U8 *SDU)
+{
+	U8 index, count, i;
+
+	if (length < kFragmentHeaderLength)
+	{
+		ResumeListening();
+		return;
+	}
+	index = SDU[1] >> 4;
+	count = (SDU[1] & 0x0F) + 1;
+	if (!index)
+	{
+		openRFPrivateData.reassemblySource = source;
+		openRFPrivateData.reassemblyTag = SDU[0];
+		openRFPrivateData.reassemblyCount = count;
+		openRFPrivateData.reassemblyNext = 0;
+		openRFPrivateData.reassemblyLength = 0;
+	}
+	else if (!openRFPrivateData.reassemblyCount || source.U32 != openRFPrivateData.reassemblySource.U32
+		|| SDU[0] != openRFPrivateData.reassemblyTag)
+	{
+		ResumeListening();
+		return;
+	}
+	length -= kFragmentHeaderLength;
+	if (index != openRFPrivateData.reassemblyNext || count != openRFPrivateData.reassemblyCount
+		|| openRFPrivateData.reassemblyLength + length > kReassemblyLength)
+	{
+		openRFPrivateData.reassemblyCount = 0;
+		ResumeListening();
+		return;
+	}
+	for (i = 0; i < length; i++)
+		openRFPrivateData.reassembly[openRFPrivateData.reassemblyLength++] = SDU[kFragmentHeaderLength + i];
+	ClearOpenRFTimer(kReassemblyTimer);
+	if (++openRFPrivateData.reassemblyNext < count)
+	{
+		ResumeListening();
+		return;
+	}
+	openRFPrivateData.reassemblyCount = 0;
+	NotifyMacPacketReceived(packetType, source, openRFPrivateData.reassemblyLength, openRFPrivateData.reassembly, _rssi);
+}
+
+// Passes a route request on, learning the way back to whoever sent it.  The target answers instead, with a route reply
+// along that way.  Only the target answers, as routes have no sequence numbers to tell a stale one that could loop.  A
+// request is only handled the first time it is heard.
+void HandleRouteRequest(UU32 source, U8 length, U8 *SDU)
+{
+	tMeshBuffer *buffer;
+	UU32 origin, target, everyone;
+	U8 i;
+
+	if (!openRFPrivateData.meshEnabled || length < kRouteRequestLength)
+	{
+		ResumeListening();
+		return;
+	}
+	origin = ReadMac(&SDU[5]);
+	target = ReadMac(&SDU[1]);
+	for (i = 0; i < openRFPrivateData.requestCacheCount; i++)
+		if (openRFPrivateData.requestCache[i].Origin.U32 == origin.U32 && openRFPrivateData.requestCache[i].Id == SDU[0])
+			break;
+	if (origin.U32 == openRFPrivateData.macAddress.U32 || i < openRFPrivateData.requestCacheCount)
+	{
+		ResumeListening();
+		return;
+	}
+	i = openRFPrivateData.requestCacheHead;
+	openRFPrivateData.requestCache[i].Origin = origin;
+	openRFPrivateData.requestCache[i].Id = SDU[0];
+	openRFPrivateData.requestCacheHead = (i + 1) % kRouteRequestCacheSize;
+	if (openRFPrivateData.requestCacheCount < kRouteRequestCacheSize)
+		openRFPrivateData.requestCacheCount++;
+	// every node hears every request, so the routes back only last until the reply has had time to come, unless the reply
+	// uses them.  That keeps them from pushing the routes in use out of the table.
+	LearnRoute(source, source, 1, kRouteLifetime - 2);
+	LearnRoute(origin, source, SDU[9] + 1, kRouteLifetime - 2);
+	i = FreeMeshBuffer();
+	if (i != kNoPacket)
+	{
+		buffer = &openRFPrivateData.meshBuffers[i];
+		buffer->Owner = 0;
+		buffer->Priority = 0;
+		if (target.U32 == openRFPrivateData.macAddress.U32)
+		{
+			buffer->Frame[0] = kMeshRouteReply;
+			WriteMac(&buffer->Frame[1], origin);
+			WriteMac(&buffer->Frame[5], target);
+			buffer->Frame[9] = 0;
+			buffer->Length = kMeshHeaderLength;
+			QueueMeshBuffer(i);
+		}
+		else if (SDU[9] + 1 < kMeshMaxHops)
+		{
+			for (i = 0; i < kRouteRequestLength; i++)
+				buffer->Frame[i] = SDU[i];
+			buffer->Frame[9]++;
+			buffer->Length = kRouteRequestLength;
+			everyone.U32 = 0xFFFFFFFF;
+			if (QueuePacket(everyone, kRouteRequestPacketType, kRouteRequestLength, buffer->Frame, 0, 0))
+				buffer->State = kMeshQueued;
+		}
+	}
+	if (!ServiceTxQueue())
+		ResumeListening();
+}
+
+// Receives a mesh frame, learning the way back to the node that sent it.  Frames for us go up to the application, and the
+// rest are passed on to the next hop without it, finding a route first if the one there was has broken.  Frames that have
+// run out of hops, or find no buffer free, are dropped.
+void HandleMeshFrame(UU32 source, U8 length, U8 *SDU)
+{
+	tMeshBuffer *buffer;
+	UU32 origin;
+	U8 i, j;
+
+	if (!openRFPrivateData.meshEnabled || length < kMeshHeaderLength)
+	{
+		ResumeListening();
+		return;
+	}
+	origin = ReadMac(&SDU[5]);
+	LearnRoute(source, source, 1, 0);
+	LearnRoute(origin, source, SDU[9] + 1, 0);
+	if (ReadMac(&SDU[1]).U32 == openRFPrivateData.macAddress.U32)
+	{
+		if (SDU[0] == kMeshData)
+		{
+			NotifyMacPacketReceived(kMeshPacketType, origin, length - kMeshHeaderLength, SDU + kMeshHeaderLength, _rssi);
+			return;
+		}
+	}
+	else if (SDU[9] + 1 < kMeshMaxHops && length <= kMeshFrameLength && (i = FreeMeshBuffer()) != kNoPacket)
+	{
+		buffer = &openRFPrivateData.meshBuffers[i];
+		for (j = 0; j < length; j++)
+			buffer->Frame[j] = SDU[j];
+		buffer->Frame[9]++;
+		buffer->Length = length;
+		buffer->Priority = 0;
+		buffer->Owner = 0;
+		SendMeshBuffer(i);
+	}
+	if (!ServiceTxQueue())
+		ResumeListening();
+}
+
+// Asks again for the routes packets are still waiting for, and fails the packets that have asked kRouteRequestRetries
+// more times without an answer
+void ServiceMeshBuffers(void)
+{
+	tMeshBuffer *buffer;
+	U16 waited;
+	U8 i;
+
+	for (i = 0; i < kMeshBufferCount; i++)
+	{
+		buffer = &openRFPrivateData.meshBuffers[i];
+		if (buffer->State != kMeshWaiting)
+			continue;
+		DisableInterrupts;
+		waited = openRFPrivateData.msTicks - buffer->Since;
+		EnableInterrupts;
+		if (waited < kRouteDiscoveryTime)
+			continue;
+		if (buffer->Requests > kRouteRequestRetries)
+		{
+			ReportPacket(buffer->Frame, 0, kNoRoute);
+			continue;
+		}
+		buffer->Requests++;
+		DisableInterrupts;
+		buffer->Since = openRFPrivateData.msTicks;
+		EnableInterrupts;
+		SendRouteRequest(ReadMac(&buffer->Frame[1]));
+	}
+}
 
 // ***********************************************************************************
 // ** Event Handlers 
 // ***********************************************************************************
-void NotifyRadioPacketReceived(tPacketTypes packetType, U8 length, U8 *SDU)
+void NotifyRadioPacketReceived(tRadioHandle radio, tPacketTypes packetType, UU32 source, U8 length, U8 *SDU, tPacketMetadata *metadata)
 {
-	/*
-	UU32 sourceMACAddress, destMACAddress;
-	UU32 timeStamp;
+	U8 aggregated, fragmented;
 
-	if(packetType == kSyncPacketType)
+	// the MAC runs one radio.  Events from any other are not ours to act on.
+	if (radio != openRFPrivateData.radio)
+		return;
+	aggregated = packetType & kAggregateFlag;
+	fragmented = packetType & kFragmentFlag;
+	packetType = (tPacketTypes)(packetType & ~(kAggregateFlag | kFragmentFlag));
+	openRFPrivateData.rxMetadata = *metadata;
+	_rssi = metadata->Rssi;
+	openRFPrivateData.rxPacketType = packetType;
+	// RadioAPI has already checked the destination and worked out the sender, short address or not
+	openRFPrivateData.rxSourceMAC = source;
+	HeardNeighbor(source, metadata);
+	if (packetType == kAckPacketType)
 	{
-		// if we receive a sync packet, we know it is from our master because it passed the sync word and CRC match. Therefore, we consider ourselves locked now.
-		openRFPrivateData.isLocked = 1;
-		// reset the timer.  This puts us in sync with the master timewise.  We use this timer to get the time
-		// left in the frame.
-		openRFPrivateData.timers[kLockTimer] = 0;
-		openRFPrivateData.alreadyHopped = 0;
-		timeStamp.U8[0]=SDU[0];
-		timeStamp.U8[1]=SDU[1];
-		timeStamp.U8[2]=SDU[2];
-		timeStamp.U8[3]=SDU[3];
-
-		_RTCDateTimeInSecs.U32 = timeStamp.U32;
-
-	}
-	else if(packetType>=kMasterUniAckPacketType)
-	{
-		// The first four bytes of the FIFO should be the MAC address of the dest
-		destMACAddress.U8[0] = SDU[0];
-		destMACAddress.U8[1] = SDU[1];
-		destMACAddress.U8[2] = SDU[2];
-		destMACAddress.U8[3] = SDU[3];
-		length-=4;
-		if(destMACAddress.U32 == openRFPrivateData.macAddress.U32)
-			NotifyMacPacketReceived(packetType,sourceMACAddress,length,SDU,_rssi);
-	}
-	else if(packetType<=kSlaveMulticastPacketType)
-	{
-		// The first four bytes of the FIFO should be the MAC address of the dest
-		destMACAddress.U8[0] = SDU[0];
-		destMACAddress.U8[1] = SDU[1];
-		destMACAddress.U8[2] = SDU[2];
-		destMACAddress.U8[3] = SDU[3];
-		// The next four bytes of the FIFO should be the MAC address of the sender
-		sourceMACAddress.U8[0] = SDU[4];
-		sourceMACAddress.U8[1] = SDU[5];
-		sourceMACAddress.U8[2] = SDU[6];
-		sourceMACAddress.U8[3] = SDU[7];
-		length-=8;
-		openRFPrivateData.rxSourceMAC = sourceMACAddress;
-		if(destMACAddress.U32 == openRFPrivateData.macAddress.U32)
-			NotifyMacPacketReceived(packetType,sourceMACAddress,length,SDU,_rssi);
-	}
-	else if(packetType==kAckPacketType)
-	{
-		// The first four bytes of the FIFO should be the MAC address of the dest
-		destMACAddress.U8[0] = SDU[0];
-		destMACAddress.U8[1] = SDU[1];
-		destMACAddress.U8[2] = SDU[2];
-		destMACAddress.U8[3] = SDU[3];
-		// The next four bytes of the FIFO should be the MAC address of the sender
-		sourceMACAddress.U8[0] = SDU[4];
-		sourceMACAddress.U8[1] = SDU[5];
-		sourceMACAddress.U8[2] = SDU[6];
-		sourceMACAddress.U8[3] = SDU[7];
-		length-=8;
-		openRFPrivateData.rxSourceMAC = sourceMACAddress;
-		// if the ACK is for our last transmission, record the transmission as complete.  Otherwise ignore it.
-		if(sourceMACAddress.U32 == openRFPrivateData.rxDestinationMAC.U32)
-			NotifyMacPacketSent();
-	}
-
-	if((packetType == kSlaveUniAckPacketType)||(packetType == kMasterUniAckPacketType))
-	{
-		openRFPrivateData.macState = kAckRequired;
+		HandleAck(source);
+		return;
 	}
-	openRFPrivateData.rxPacketType = packetType;
-	*/
+	if (packetType == kAssociatePacketType)
+	{
+		HandleAssociation(source, length, SDU);
+		return;
+	}
+	if (packetType == kBeaconPacketType)
+	{
+		HandleBeacon(length, SDU);
+		return;
+	}
+	if (packetType == (kAckPacketType | kBlockAckFlag))
+	{
+		HandleBlockAck(source, length, SDU);
+		return;
+	}
+	if (packetType == (kUniAckPacketType | kBlockAckFlag))
+	{
+		HandleWindowedFrame(source, length, SDU);
+		return;
+	}
+	if (packetType == kRouteRequestPacketType)
+	{
+		HandleRouteRequest(source, length, SDU);
+		return;
+	}
+	if (packetType == kUniAckPacketType || packetType == kMeshPacketType)
+	{
+		// RadioAPI has ACKed it already.  A repeat means that ACK was lost, so it is not passed up again.
+		if (!length || IsDuplicate(source, SDU[0]))
+		{
+			ResumeListening();
+			return;
+		}
+		SDU++;
+		length--;
+	}
+	if (packetType == kMeshPacketType)
+		HandleMeshFrame(source, length, SDU);
+	else if (fragmented)
+		HandleFragment(packetType, source, length, SDU);
+	else if (aggregated)
+		DeliverAggregate(packetType, source, length, SDU);
+	else
+		NotifyMacPacketReceived(packetType, source, length, SDU, _rssi);
 }
-extern void NotifyRadioReceiveError()
+extern void NotifyRadioReceiveError(tRadioHandle radio)
 {
+	if (radio != openRFPrivateData.radio)
+		return;
 	openRFPrivateData.macState = kIdle;
 	NotifyMacReceiveError();
 }
-extern void NotifyRadioPacketSent()
+extern void NotifyRadioPacketSent(tRadioHandle radio)
 {
+	if (radio != openRFPrivateData.radio)
+		return;
 	//LEDTX = EXTINGUISH;
-	/*
-	if(openRFPrivateData.txPacketType == kSyncPacketType)
-	{
-		// the frame period starts once the sync packet is sent.  All slaves will start their timer here as well, so they should be in sync
-		openRFPrivateData.timers[kSyncTimer] = 0;
-		openRFPrivateData.macState = kSyncTransmitted;
-	}
-	else if((openRFPrivateData.txPacketType == kMasterUniAckPacketType)||(openRFPrivateData.txPacketType == kSlaveUniAckPacketType))
-		openRFPrivateData.macState = kPacketTransmitted;
+	if (openRFPrivateData.beaconSending)
+		BeaconDone(1);
 	else
-	{	
-		NotifyMacPacketSent();
-	}
-	*/
+		TransmitDone(1);
 }
-extern void NotifyRadioPacketSendError()
+extern void NotifyRadioPacketSendError(tRadioHandle radio)
 {
-	NotifyMacPacketSendError(kUndefined);
+	if (radio != openRFPrivateData.radio)
+		return;
+	if (openRFPrivateData.beaconSending)
+		BeaconDone(0);
+	else
+		TransmitDone(0);
 }
 extern void NotifyRadio1Second()
 {
+	U8 i;
+
+	for (i = 0; i < kRouteTableSize; i++)
+		if (openRFPrivateData.routes[i].Age < 0xFF)
+			openRFPrivateData.routes[i].Age++;
 	NotifyMac1Second();
 }
 extern void NotifyRadio1MilliSecond()
 {
 	U8 i;
 	NotifyMac1MilliSecond();
-	for(i=0;i<4;i++)
+	for(i=0;i<kTimerCount;i++)
 		openRFPrivateData.timers[i]++;
+	openRFPrivateData.msTicks++;
 
 		
 }
-// ***********************************************************************************
-// ** Internal functions
-// ***********************************************************************************
-void ClearOpenRFTimer(U8 timerNumber)
-{
-	DisableInterrupts;
-	openRFPrivateData.timers[timerNumber] = 0;
-	EnableInterrupts;
-}
-
 // ***********************************************************************************
 // ** Public API
 // ***********************************************************************************
@@ -177,36 +1924,105 @@ U16 timeLeft;
 U16 timeRequired;
 U16 lockTime;
 
-void OpenRFSendPacket(UU32 destAddress, tPacketTypes packetType, U8 length, U8 *txBuffer, U16 preambleCount)
+U8 OpenRFSendPacket(UU32 destAddress, tPacketTypes packetType, U16 length, U8 *txBuffer, U16 preambleCount, U8 priority)
 {
-	// send the packet and do not block until complete.
-	RadioSendPacket(destAddress, packetType, length, txBuffer, preambleCount, 0);
+	if (packetType == kMeshPacketType)
+	{
+		if (!SendMeshPacket(destAddress, length, txBuffer, priority))
+			return 0;
+	}
+	else if (length > kReassemblyLength || FragmentCount(length) > kMaxFragments
+		|| !QueuePacket(destAddress, packetType, length, txBuffer, preambleCount, priority))
+		return 0;
+	// goes straight out if the queue was idle
+	ServiceTxQueue();
+	return 1;
 }
 
 void OpenRFInitialize(tOpenRFInitializer ini)
 {
 	tRadioInitialization rini;
+	U8 i;
 	//ResetRadio();
 	//X69
 	openRFPrivateData.gfskEnabled = ini.GfskModifier;
 
-	rini.HopTable = 0;
+	rini.HopTable = ini.HopTable;
+	rini.ChannelCount = ini.ChannelCount;
 	rini.MacAddress = ini.MacAddress;
 	rini.NetworkId = ini.NetworkId;
 	rini.GausianEnabled = ini.GfskModifier;
-	rini.FhssStepSize = 100;
+	// use the band plan's own channel spacing
+	rini.FhssStepSize = 0;
+	rini.BandPlan = OPENRF_BAND_PLAN;
 
-	RadioInitialize(rini);
+	// the MAC runs the radio on SPI
+	rini.Radio = 0;
+	rini.Bus = &kRadioBusSPI;
+	openRFPrivateData.radio = RadioInitialize(rini);
 	//openRFPrivateData.macAddress.U32 = macAddress.U32;
 	//SetMACAddress(macAddress);
-	RadioSetDataRate(ini.DataRate);
-	RadioSetEncryptionKey(&ini.EncryptionKey.U8[0],16);
+	RadioSetDataRate(openRFPrivateData.radio, ini.DataRate);
+	RadioSetEncryptionKey(openRFPrivateData.radio, &ini.EncryptionKey.U8[0],16);
+#ifdef OPENRF_FS_PRETUNE
+	RadioSetFSPretune(openRFPrivateData.radio, 1);
+#endif
+#ifdef OPENRF_ADDRESS_FILTERING
+	RadioSetAddressFiltering(openRFPrivateData.radio, 1);
+#endif
+	// UniAck frames are acknowledged by the radio layer straight from PayloadReady
+	RadioSetAutoAck(openRFPrivateData.radio, 1);
 	openRFPrivateData.networkId = ini.NetworkId;
 	openRFPrivateData.macAddress = ini.MacAddress;
 	openRFPrivateData.ackTimeout = ini.AckTimeout;
 	openRFPrivateData.macState = kIdle;
 	openRFPrivateData.ackRetries = ini.AckRetries;
 	openRFPrivateData.alreadyHopped = 0;
+	openRFPrivateData.isCoordinator = 0;
+	openRFPrivateData.isLocked = 0;
+	openRFPrivateData.tdmaSlotCount = 0;
+	openRFPrivateData.beaconSending = 0;
+	openRFPrivateData.beaconSequence = 0;
+	openRFPrivateData.syncCount = 0;
+	openRFPrivateData.syncOffset = 0;
+	openRFPrivateData.syncSkew = 0;
+	openRFPrivateData.syncResidual = 0;
+	openRFPrivateData.isListening = 0;
+	openRFPrivateData.txQueueCount = 0;
+	openRFPrivateData.txSending = kNoPacket;
+	openRFPrivateData.txSentCount = 0;
+	openRFPrivateData.arqWindow = 0;
+	openRFPrivateData.arqNextSequence = 0;
+	openRFPrivateData.txNextSequence = 0;
+	openRFPrivateData.awaitingAck = 0;
+	openRFPrivateData.sequenceCacheCount = 0;
+	openRFPrivateData.arqProbe = 0;
+	openRFPrivateData.arqRxActive = 0;
+	openRFPrivateData.arqBlockAckQueued = 0;
+	openRFPrivateData.aggregateMax = kAggregateLength;
+	openRFPrivateData.aggregateDelay = kAggregateDelay;
+	openRFPrivateData.aggregateLength = 0;
+	openRFPrivateData.fragmentFollowing = 0;
+	openRFPrivateData.nextTag = 0;
+	openRFPrivateData.reassemblyCount = 0;
+	for (i = 0; i < kRouteTableSize; i++)
+		openRFPrivateData.routes[i].Metric = kNoMetric;
+	for (i = 0; i < kMeshBufferCount; i++)
+		openRFPrivateData.meshBuffers[i].State = kMeshFree;
+	openRFPrivateData.requestCacheCount = 0;
+	openRFPrivateData.requestCacheHead = 0;
+	for (i = 0; i < kNeighborTableSize; i++)
+		openRFPrivateData.neighbors[i].Used = 0;
+	openRFPrivateData.noiseFloor = 0;
+	openRFPrivateData.ccaThreshold = kCcaThreshold;
+	openRFPrivateData.csmaMaxAttempts = kCsmaMaxAttempts;
+	openRFPrivateData.csmaBackoff = 0;
+	// seeded from the MAC address so neighbours pick different backoff slots
+	openRFPrivateData.csmaRandom = ini.MacAddress.U8[0] | (ini.MacAddress.U8[1] << 8);
+	openRFPrivateData.csmaRandom ^= ini.MacAddress.U8[2] | (ini.MacAddress.U8[3] << 8);
+	if (!openRFPrivateData.csmaRandom)
+		openRFPrivateData.csmaRandom = 1;
+	OpenRFClearChannelStatistics();
 	EnableIntP0();
 }
 
@@ -215,12 +2031,13 @@ void OpenRFListenForPacket(tListenModes mode, U16 period)
 
 	openRFPrivateData.listenMode = mode;
 	openRFPrivateData.listenPeriod = period;
+	openRFPrivateData.isListening = 1;
 
-	RadioReceivePacket(mode, period);
+	RadioReceivePacket(openRFPrivateData.radio, mode, period);
 }
 tOpenRFStates OpenRFLoop()
 {
-	U8 oState = RadioGetRFICMode();
+	U8 oState = RadioGetRFICMode(openRFPrivateData.radio);
 
 	// Update our MACState based on the current radio state
 	switch(oState)
@@ -241,14 +2058,221 @@ tOpenRFStates OpenRFLoop()
 		break;
 
 	}
+	// no ACK in time.  Plain frames go again as they are, and windows ask again with their oldest frame, until the
+	// retries run out.
+	DisableInterrupts;
+	if (openRFPrivateData.awaitingAck && openRFPrivateData.timers[kAckTimer] > openRFPrivateData.ackTimeout)
+	{
+		openRFPrivateData.awaitingAck = 0;
+		EnableInterrupts;
+		openRFPrivateData.channelStatistics.Collisions++;
+		TriedNeighbor(openRFPrivateData.txQueue[openRFPrivateData.ackIndex].DestAddress, 0);
+		if (++openRFPrivateData.ackRetryCounter <= openRFPrivateData.ackRetries)
+			openRFPrivateData.arqProbe = openRFPrivateData.txQueue[openRFPrivateData.ackIndex].Windowed;
+		else if (openRFPrivateData.txQueue[openRFPrivateData.ackIndex].Windowed)
+			FailWindow();
+		else
+		{
+			openRFPrivateData.ackRetryCounter = 0;
+			CompletePacket(openRFPrivateData.ackIndex, 0, kNoAck);
+		}
+		if (!ServiceTxQueue())
+			ResumeListening();
+	}
+	else
+		EnableInterrupts;
+	// backoff over, so look at the channel again.  If the slot has run out meanwhile, the packet waits for the next one.
+	DisableInterrupts;
+	if (openRFPrivateData.csmaBackoff && openRFPrivateData.timers[kBackoffTimer] >= openRFPrivateData.csmaBackoff)
+	{
+		openRFPrivateData.csmaBackoff = 0;
+		EnableInterrupts;
+		if (!SlotHasRoom(&openRFPrivateData.txQueue[openRFPrivateData.txSending]))
+		{
+			openRFPrivateData.txSending = kNoPacket;
+			ResumeListening();
+		}
+		else if (!TransmitQueued() && !ServiceTxQueue())
+			ResumeListening();
+	}
+	else
+		EnableInterrupts;
+	// a message that has stopped getting fragments is given up on
+	DisableInterrupts;
+	if (openRFPrivateData.reassemblyCount && openRFPrivateData.timers[kReassemblyTimer] >= kReassemblyTimeout)
+		openRFPrivateData.reassemblyCount = 0;
+	EnableInterrupts;
+	ServiceMeshBuffers();
+	// a slave that has missed kTdmaLockLoss beacons in a row goes back to sending whenever it likes
+	DisableInterrupts;
+	if (openRFPrivateData.isLocked && openRFPrivateData.timers[kLockTimer] >= LockLossTime())
+		openRFPrivateData.isLocked = 0;
+	EnableInterrupts;
+	// the master's superframe is over, so the next one starts with a beacon
+	DisableInterrupts;
+	if (openRFPrivateData.isCoordinator && openRFPrivateData.tdmaSlotCount && !openRFPrivateData.beaconSending
+		&& openRFPrivateData.txSending == kNoPacket && !openRFPrivateData.awaitingAck
+		&& GetMicroseconds() - openRFPrivateData.superframeStart >= (U32)openRFPrivateData.frameLength * 1000)
+	{
+		EnableInterrupts;
+		SendBeacon();
+	}
+	else
+		EnableInterrupts;
+	// picks up anything queued while a send error was being reported
+	ServiceTxQueue();
 	return openRFPrivateData.macState;
 }
-U8 OpenRFReadyToSend()
+void OpenRFGetPacketMetadata(tPacketMetadata *metadata)
+{
+	DisableInterrupts;
+	*metadata = openRFPrivateData.rxMetadata;
+	EnableInterrupts;
+}
+void OpenRFExpectPeer(UU32 peer)
+{
+	RadioExpectPeer(openRFPrivateData.radio, peer);
+}
+void OpenRFSetCoordinator(U8 enable)
+{
+	openRFPrivateData.isCoordinator = enable;
+	openRFPrivateData.nextShortAddress = kCoordinatorShortAddress + 1;
+	RadioSetShortAddress(openRFPrivateData.radio, enable ? kCoordinatorShortAddress : kNoShortAddress);
+}
+void OpenRFAssociate(UU32 coordinator)
+{
+	// an empty association frame is a request
+	if (QueuePacket(coordinator, kAssociatePacketType, 0, openRFPrivateData.associateResponse, 0, 0xFF))
+		ServiceTxQueue();
+}
+void OpenRFSetWindow(UU32 peer, U8 window)
+{
+	DisableInterrupts;
+	openRFPrivateData.arqPeer = peer;
+	openRFPrivateData.arqWindow = (window > kMaxArqWindow) ? kMaxArqWindow : window;
+	EnableInterrupts;
+}
+U8 OpenRFGetShortAddress()
+{
+	return RadioGetShortAddress(openRFPrivateData.radio);
+}
+tRadioHandle OpenRFGetRadio()
+{
+	return openRFPrivateData.radio;
+}
+U8 OpenRFMaxSDULength()
+{
+	// kMaxHeaderLength allows for the sequence bytes of windowed frames
+	return RadioGetMaxFrameLength(openRFPrivateData.radio) - (kMaxHeaderLength - 1);
+}
+void OpenRFSetAggregation(U8 maxLength, U8 delay)
+{
+	DisableInterrupts;
+	openRFPrivateData.aggregateMax = (maxLength > kAggregateLength) ? kAggregateLength : maxLength;
+	openRFPrivateData.aggregateDelay = delay;
+	EnableInterrupts;
+}
+void OpenRFSetMesh(U8 enable)
+{
+	openRFPrivateData.meshEnabled = enable;
+}
+void OpenRFSetSuperframe(U8 slotCount, U8 slotLength)
+{
+	DisableInterrupts;
+	openRFPrivateData.tdmaSlotCount = slotLength ? slotCount : 0;
+	openRFPrivateData.tdmaSlotLength = slotLength;
+	openRFPrivateData.frameLength = (U16)slotCount * slotLength;
+	// the first beacon goes out straight away
+	openRFPrivateData.superframeStart = GetMicroseconds() - (U32)openRFPrivateData.frameLength * 1000;
+	EnableInterrupts;
+}
+U8 OpenRFIsLocked()
+{
+	return openRFPrivateData.isLocked;
+}
+U8 OpenRFGetNetworkTime(U32 *microseconds)
 {
-	if(openRFPrivateData.macState == kTransmitting)
+	U32 now;
+
+	now = GetMicroseconds();
+	if (openRFPrivateData.isCoordinator)
+	{
+		*microseconds = now;
+		return 1;
+	}
+	DisableInterrupts;
+	if (!openRFPrivateData.isLocked || !openRFPrivateData.syncCount)
+	{
+		EnableInterrupts;
 		return 0;
+	}
+	*microseconds = now + openRFPrivateData.syncOffset
+		+ SkewCorrection(openRFPrivateData.syncSkew, now - openRFPrivateData.syncReference);
+	EnableInterrupts;
 	return 1;
 }
+void OpenRFGetTimeSync(tTimeSyncStatistics *statistics)
+{
+	DisableInterrupts;
+	statistics->Offset = openRFPrivateData.syncOffset;
+	// 10^9 / 2^24 is 59.605
+	statistics->Skew = openRFPrivateData.syncSkew * 59605L / 1000;
+	statistics->Residual = openRFPrivateData.syncResidual;
+	statistics->Points = openRFPrivateData.syncCount;
+	EnableInterrupts;
+}
+void OpenRFSetChannelAccess(U8 threshold, U8 attempts)
+{
+	DisableInterrupts;
+	openRFPrivateData.ccaThreshold = threshold;
+	openRFPrivateData.csmaMaxAttempts = attempts ? attempts : 1;
+	EnableInterrupts;
+}
+void OpenRFGetChannelStatistics(tChannelAccessStatistics *statistics)
+{
+	DisableInterrupts;
+	*statistics = openRFPrivateData.channelStatistics;
+	EnableInterrupts;
+}
+U8 OpenRFGetNeighbor(U8 index, tNeighbor *neighbor)
+{
+	U8 used;
+
+	if (index >= kNeighborTableSize)
+		return 0;
+	DisableInterrupts;
+	used = openRFPrivateData.neighbors[index].Used;
+	if (used)
+		CopyNeighbor(&openRFPrivateData.neighbors[index], neighbor);
+	EnableInterrupts;
+	return used;
+}
+U8 OpenRFFindNeighbor(UU32 mac, tNeighbor *neighbor)
+{
+	tNeighborEntry *entry;
+
+	DisableInterrupts;
+	entry = FindNeighbor(mac, 0);
+	if (entry)
+		CopyNeighbor(entry, neighbor);
+	EnableInterrupts;
+	return entry != 0;
+}
+void OpenRFClearChannelStatistics()
+{
+	DisableInterrupts;
+	openRFPrivateData.channelStatistics.ClearChecks = 0;
+	openRFPrivateData.channelStatistics.BusyChecks = 0;
+	openRFPrivateData.channelStatistics.Backoffs = 0;
+	openRFPrivateData.channelStatistics.BackoffTime = 0;
+	openRFPrivateData.channelStatistics.AccessFailures = 0;
+	openRFPrivateData.channelStatistics.Collisions = 0;
+	EnableInterrupts;
+}
+U8 OpenRFReadyToSend()
+{
+	return openRFPrivateData.txQueueCount < kMaxMessageQueueSize;
+}
 void OpenRFSleep(U8 level)
 {
 
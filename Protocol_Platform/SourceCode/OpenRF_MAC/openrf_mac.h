@@ -3,7 +3,111 @@
 
 #include "../Radio/SX1231/radioapi.h"
 
-#define kMaxMessageQueueSize 4
+// Number of packets OpenRFSendPacket can hold, including the one on the air and windowed ones waiting for a block ACK
+#define kMaxMessageQueueSize 8
+// Largest selective repeat window, set by the 8 bit block ACK bitmap
+#define kMaxArqWindow 8
+// Windowed frames a receiver can hold while it waits for an earlier one.  Each takes kMaxSDULength bytes.
+#ifndef kArqHeldFrames
+#define kArqHeldFrames 3
+#endif
+// Peers whose last UniAck sequence number is remembered for dropping repeats.  Each takes 5 bytes.
+#ifndef kSequenceCacheSize
+#define kSequenceCacheSize 8
+#endif
+// Aggregation defaults.  Small packets to the same destination go out together in frames of up to kAggregateLength bytes
+// of SDU, which the MAC keeps one buffer of.  A packet waits kAggregateDelay mSec for others to join it.
+#ifndef kAggregateLength
+#define kAggregateLength 48
+#endif
+#ifndef kAggregateDelay
+#define kAggregateDelay 0
+#endif
+// Fragmentation defaults.  SDUs too long for one frame go out in up to 16 fragments, and the receiver puts them back
+// together in one buffer of kReassemblyLength bytes, which is also the longest SDU OpenRFSendPacket takes.  A message
+// that has not had a fragment for kReassemblyTimeout mSec is dropped.
+#ifndef kReassemblyLength
+#define kReassemblyLength 384
+#endif
+#ifndef kReassemblyTimeout
+#define kReassemblyTimeout 500
+#endif
+// Mesh defaults.  Routes to kRouteTableSize destinations are kept, and one that has not been used or heard from for
+// kRouteLifetime seconds is found again.  Mesh frames, forwarded ones included, are copied into kMeshBufferCount buffers
+// of kMeshFrameLength bytes, and are dropped after kMeshMaxHops hops.  A packet waits kRouteDiscoveryTime mSec for a route
+// and asks kRouteRequestRetries more times before it fails.  The last kRouteRequestCacheSize route requests are
+// remembered so each is passed on once.
+#ifndef kRouteTableSize
+#define kRouteTableSize 16
+#endif
+#ifndef kRouteLifetime
+#define kRouteLifetime 120
+#endif
+#ifndef kMeshBufferCount
+#define kMeshBufferCount 4
+#endif
+#ifndef kMeshFrameLength
+#define kMeshFrameLength 64
+#endif
+#ifndef kMeshMaxHops
+#define kMeshMaxHops 16
+#endif
+#ifndef kRouteDiscoveryTime
+#define kRouteDiscoveryTime 1000
+#endif
+#ifndef kRouteRequestRetries
+#define kRouteRequestRetries 2
+#endif
+#ifndef kRouteRequestCacheSize
+#define kRouteRequestCacheSize 8
+#endif
+// Largest SDU of a kMeshPacketType packet: a mesh buffer less the mesh header
+#define kMaxMeshSDULength (kMeshFrameLength - 10)
+// Neighbour table defaults.  kNeighborTableSize has to be a power of two.  A neighbour is looked for in the
+// kNeighborProbeLength entries from the one its MAC hashes to, so that is as long as a lookup gets.
+#ifndef kNeighborTableSize
+#define kNeighborTableSize 16
+#endif
+#ifndef kNeighborProbeLength
+#define kNeighborProbeLength 4
+#endif
+// Channel access defaults.  The channel counts as busy when RSSI is stronger than kCcaThreshold, by default the level the
+// receiver starts on (-80dBm).  After each busy check the packet backs off for a random number of mSec, from a window of
+// 2^kCsmaMinBackoffExponent doubling up to 2^kCsmaMaxBackoffExponent, and kCsmaMaxAttempts busy checks fail it.
+#ifndef kCcaThreshold
+#define kCcaThreshold 0xA0
+#endif
+#ifndef kCsmaMaxAttempts
+#define kCsmaMaxAttempts 5
+#endif
+#ifndef kCsmaMinBackoffExponent
+#define kCsmaMinBackoffExponent 2
+#endif
+#ifndef kCsmaMaxBackoffExponent
+#define kCsmaMaxBackoffExponent 5
+#endif
+// mSec a channel check waits for the receiver to come on and the tick to take its RSSI reading before it counts as busy
+#ifndef kCsmaReadingTimeout
+#define kCsmaReadingTimeout 5
+#endif
+// TDMA defaults.  Frames start kTdmaGuardTime uSec into a slot and end that long before it does, to cover the error in
+// the slaves' clock sync.  Slaves that miss kTdmaLockLoss beacons in a row stop following the superframe.
+#ifndef kTdmaGuardTime
+#define kTdmaGuardTime 50
+#endif
+#ifndef kTdmaLockLoss
+#define kTdmaLockLoss 4
+#endif
+// Beacons the clock sync fits a slave's clock over, at most 16
+#ifndef kTimeSyncPoints
+#define kTimeSyncPoints 8
+#endif
+// Band plan for the radio.  Override on the command line for 868 or 433MHz builds.
+#ifndef OPENRF_BAND_PLAN
+#define OPENRF_BAND_PLAN kBand915
+#endif
+// Largest SDU that fits in a frame: the length byte value less the rest of the largest header
+#define kMaxSDULength (kMaxFrameLength - (kMaxHeaderLength - 1))
 
 /*! \details Enumerates all of the possible states of the OpenRF stack.
  *
@@ -30,9 +134,51 @@ typedef enum
 	kNoAck,				/*! An ack was required but none was received */
 	kFifoUnderflow,		/*! The FIFO underflowed, meaning more bytes were extracted than were put in */
 	kFifoOverflow,		/*! The FIFO overflowed, meaning too many bytes were put into the FIFO */
+	kChannelBusy,		/*! The channel was busy every time it was checked */
+	kNoRoute,			/*! No route to a mesh destination was found */
 	kUndefined			/*! Undefined error */
 } tTransmitErrors;
 
+/*! \details Channel access counters.  Collisions are inferred, as the only sign of one is a missing ACK.
+ *
+ */
+typedef struct
+{
+	U16 ClearChecks;	/*! Channel checks that found the channel clear */
+	U16 BusyChecks;		/*! Channel checks that found the channel busy */
+	U16 Backoffs;		/*! Backoffs started after a busy check */
+	U32 BackoffTime;	/*! mSec spent backing off */
+	U16 AccessFailures;	/*! Packets that gave up after kCsmaMaxAttempts busy checks */
+	U16 Collisions;		/*! UniAck frames whose ACK or block ACK did not come back in time */
+} tChannelAccessStatistics;
+
+/*! \details Link quality to one neighbour.  The averages are moving averages, each new frame or ACK counting for an
+ *  eighth.
+ */
+typedef struct
+{
+	UU32 MacAddress;		/*! MAC address of the neighbour */
+	U8 Rssi;				/*! Average RSSI of the frames heard from it.  See section 3.4.9 in SX1231 manual. */
+	U8 Snr;					/*! Average signal to noise ratio of those frames in dB, against the noise the channel checks
+							 *  measure.  0 while no channel check has found the channel clear. */
+	U8 AckRate;				/*! Average percentage of tries sent to it that were ACKed.  Meaningless while TxCount is 0 */
+	S16 FrequencyOffset;	/*! Frequency of the neighbour relative to ours, in 61Hz steps */
+	U32 LastSeen;			/*! _RTCDateTimeInSecs when it was last heard.  0 if it has only been sent to. */
+	U16 RxCount;			/*! Frames heard from it */
+	U16 TxCount;			/*! Tries of acknowledged frames sent to it, each retry counting again */
+} tNeighbor;
+
+/*! \details Clock sync of a slave against the TDMA master.  Offset and Skew are the fit over the last Points beacons.
+ *
+ */
+typedef struct
+{
+	S32 Offset;		/*! Master's time less ours when the last beacon arrived, in uSec */
+	S32 Skew;		/*! How much faster the master's clock runs than ours, in parts per billion */
+	U16 Residual;	/*! Largest error of the fit at any of the beacons, in uSec */
+	U8 Points;		/*! Beacons the fit is over.  0 until the second beacon, which carries the time of the first. */
+} tTimeSyncStatistics;
+
 /*! \details Enumerates OpenRF hopping modes
  *
  */
@@ -54,28 +200,37 @@ typedef struct
 	tDataRates DataRate;/*! Radio data rate */
 	UU128 EncryptionKey;/*! Encryption Key - actual bit count is radio dependent */
 	UU32 NetworkId;		/*! 32-bit network Id */
-	U8 HopTable;		/*! Hop table */
+	U8 HopTable;		/*! Hop sequence selector.  Networks with the same id and a different selector hop differently. */
 	U8 StartChannel;	/*! Initial channel */
 	UU32 MacAddress;	/*! MAC address for this radio */
 } tOpenRFInitializer;
 
 
-extern void NotifyMacPacketReceived(tPacketTypes packetType, UU32 sourceMACAddress, U8 length, U8 *SDU, U8 rssi);
+extern void NotifyMacPacketReceived(tPacketTypes packetType, UU32 sourceMACAddress, U16 length, U8 *SDU, U8 rssi);
 extern void NotifyMacReceiveError(void);
 extern void NotifyMac1Second(void);
-extern void NotifyMacPacketSent(void);
-extern void NotifyMacPacketSendError(tTransmitErrors);
+extern void NotifyMacPacketSent(U8 *txBuffer);
+extern void NotifyMacPacketSendError(U8 *txBuffer, tTransmitErrors error);
 extern void NotifyMac1MilliSecond(void);
 /*! 
- * \details Queues a packet for transmission
- * \returns One of results enumeration (OK, MallocFailed, etc)
+ * \details Queues a packet for transmission.  The queue holds txBuffer itself rather than a copy, and SDUs that do not fit
+ * in the radio's FIFO are streamed from it while the packet is on the air, so txBuffer must not be reused until it comes
+ * back through NotifyMacPacketSent or NotifyMacPacketSendError.  Higher priority packets go out first, and packets of the
+ * same priority go out in the order they were queued.  UniAck packets are sent again until they are ACKed, up to
+ * AckRetries times, and the receiver passes a repeat up only once.  kMeshPacketType packets go through the mesh set up by
+ * OpenRFSetMesh, and are copied, so txBuffer comes back once the first hop has ACKed the copy.  SDUs longer than
+ * OpenRFMaxSDULength() go out as
+ * fragments back to back, each UniAck one waiting for its own ACK, and are reported once the last has gone.  Fragmented
+ * packets are never windowed.
+ * \returns 1 if queued, 0 if the queue is full or the SDU is longer than kReassemblyLength
  */
-void OpenRFSendPacket(
+U8 OpenRFSendPacket(
 	UU32 destAddress		/*! Destination MAC address */,
 	tPacketTypes packetType	/*! Type of packet */,
-	U8 length				/*! Length of SDU */,
+	U16 length				/*! Length of SDU */,
 	U8 *txBuffer			/*! Buffer containing SDU */,
-	U16 preambleCount		/*! Preamble bit count in bits */
+	U16 preambleCount		/*! Preamble bit count in bits */,
+	U8 priority				/*! 0 for normal packets, higher to go ahead of them */
 );
 /*! \details Initialize the OpenRF stack
  *
@@ -96,8 +251,135 @@ void OpenRFListenForPacket(
  */
 tOpenRFStates OpenRFLoop(void);
 
+/*! \details Gets the receive details (RSSI, frequency error, channel and timestamp) of the last packet passed to
+ *  NotifyMacPacketReceived.  Call it from NotifyMacPacketReceived to be sure they belong to that packet.
+ */
+void OpenRFGetPacketMetadata(tPacketMetadata *metadata /*! Receives a copy of the metadata */);
+
+/*! \details Tells the radio which peer the next packet is expected from, so a peer heard before is received with its
+ *  frequency offset already corrected and the ACK to it is ready.  Call it before OpenRFListenForPacket.
+ */
+void OpenRFExpectPeer(UU32 peer /*! MAC address of the expected sender */);
+
+/*! \details Makes this node the coordinator of the network, or a plain node again.  The coordinator takes short address 1
+ *  and hands out the others to the nodes that associate with it.
+ */
+void OpenRFSetCoordinator(U8 enable /*! Non-zero to be the coordinator */);
+
+/*! \details Asks the coordinator for a short address.  The request and the response carry full MAC addresses.  Once the
+ *  response arrives, frames between this node and the coordinator use short address headers.
+ */
+void OpenRFAssociate(UU32 coordinator /*! MAC address of the coordinator */);
+
+/*! \details Turns selective repeat on or off for UniAck packets to one peer.  Up to 'window' of them go out back to back,
+ *  and the peer answers with one block ACK saying which arrived.  Only the missing ones go out again, and each packet is
+ *  handed back through NotifyMacPacketSent once a block ACK covers it, or NotifyMacPacketSendError(kNoAck) once
+ *  AckRetries requests in a row go unanswered.  The receiver passes the packets up in the order they were sent.
+ */
+void OpenRFSetWindow(
+	UU32 peer	/*! MAC address of the receiver */,
+	U8 window	/*! Frames per block ACK, up to kMaxArqWindow.  0 goes back to an ACK per packet. */
+);
+
+/*! \details Sets up aggregation of small packets.  Packets of the same type to the same destination that are waiting
+ *  together go out in one frame, each as a [length][SDU] record, and the receiver passes each SDU up through its own call
+ *  to NotifyMacPacketReceived.  The first packet of a frame waits up to 'delay' mSec for others to join it, and holds up
+ *  the packets behind it meanwhile.  The packets in an aggregate frame are reported sent or failed together, and a UniAck
+ *  frame is ACKed as a whole.  Windowed packets go out on their own.  Both ends have to support aggregation.
+ */
+void OpenRFSetAggregation(
+	U8 maxLength	/*! Largest aggregate SDU, up to kAggregateLength.  0 turns aggregation off. */,
+	U8 delay		/*! mSec a packet may wait for others.  0 only aggregates packets that are already waiting. */
+);
+
+/*! \details Turns the mesh on or off.  With it on, the MAC forwards kMeshPacketType frames for other nodes and answers
+ *  route requests, all without calling the application, and the application can send kMeshPacketType packets to nodes
+ *  out of range.  Each hop is ACKed and sent again like a UniAck frame.  Routes are found by flooding a route request,
+ *  which the destination answers back along the path the first copy took, and are learnt from every mesh frame heard.
+ *  A route whose next hop stops ACKing is dropped and found again for the next packet.  The SDU of a mesh packet can be
+ *  up to kMaxMeshSDULength bytes, and it arrives as kMeshPacketType from the node that sent it.  Every node on the way has
+ *  to have the mesh on.  The setting survives OpenRFInitialize, but the routes do not.
+ */
+void OpenRFSetMesh(
+	U8 enable	/*! 1 to take part in the mesh, 0 to drop mesh frames */
+);
+
+/*! \details Runs the network on a TDMA superframe.  Call it on the coordinator.  The coordinator sends a beacon every
+ *  superframe.  The beacon carries the slot layout, the coordinator's RTC and the time the sync word of the previous
+ *  beacon ended by the coordinator's clock.  Each slot belongs to one short address: slot 0 to the coordinator and slot n
+ *  to short address n + 1.  Slots are timed from the end of the beacon's sync word, so slot 0 starts with the rest of the
+ *  beacon.  Nodes that hear a beacon lock on to the superframe, take the RTC from it and sync their clock to the
+ *  coordinator's.  From then on they only start frames in their own slot, so a node needs a short address below
+ *  slotCount + 1 to send anything but an association request.  slotLength has to cover the longest frame, its ACK, the
+ *  radio switching to TX for each and kTdmaGuardTime at each end.  Slaves have to be listening to hear the beacons.
+ */
+void OpenRFSetSuperframe(
+	U8 slotCount	/*! Slots per superframe, the coordinator's own included.  0 turns the superframe off. */,
+	U8 slotLength	/*! mSec per slot */
+);
+
+/*! \details Checks if this node is locked on to a TDMA master's superframe.
+ *  \return 1 if locked, 0 if not
+ */
+U8 OpenRFIsLocked(void);
+
+/*! \details Gets the network time, which is the TDMA master's GetMicroseconds() clock.  Slaves work it out from their own
+ *  clock with the offset and skew measured from the master's beacons.
+ *  \return 1 if the time is known, 0 if this node is a slave that has not locked on to a master yet
+ */
+U8 OpenRFGetNetworkTime(U32 *microseconds /*! Receives the network time */);
+
+/*! \details Gets how well this node's clock is synced to the TDMA master's.
+ */
+void OpenRFGetTimeSync(tTimeSyncStatistics *statistics /*! Receives the clock sync */);
+
+/*! \details Sets up the clear channel check made before every packet goes out.  Packets that find the channel busy
+ *  'attempts' times fail with kChannelBusy, except windowed ones, which are treated as lost on the air and left to the
+ *  block ACK.
+ */
+void OpenRFSetChannelAccess(
+	U8 threshold	/*! RSSI value the channel has to be weaker than, as RadioReadRSSIValue reads it.  0 turns the check off. */,
+	U8 attempts		/*! Busy checks before a packet fails */
+);
+
+/*! \details Gets the channel access counters.
+ */
+void OpenRFGetChannelStatistics(tChannelAccessStatistics *statistics /*! Receives a copy of the counters */);
+
+/*! \details Clears the channel access counters.
+ */
+void OpenRFClearChannelStatistics(void);
+
+/*! \details Gets one entry of the neighbour table, which keeps the link quality to every node heard or sent to.  Go
+ *  through 'index' from 0 to kNeighborTableSize-1 to see them all.  A new neighbour with no room in the entries it
+ *  hashes to takes over the one of them heard from longest ago.  The table is cleared by OpenRFInitialize.
+ *  \return 1 if the entry holds a neighbour, 0 if it is free
+ */
+U8 OpenRFGetNeighbor(U8 index /*! Entry, 0 to kNeighborTableSize-1 */, tNeighbor *neighbor /*! Receives the entry */);
+
+/*! \details Gets the link quality to one neighbour.
+ *  \return 1 if it is in the neighbour table, 0 if not
+ */
+U8 OpenRFFindNeighbor(UU32 mac /*! MAC address of the neighbour */, tNeighbor *neighbor /*! Receives its entry */);
+
+/*! \details Gets the short address the coordinator gave us.
+ *  \return Short address, kNoShortAddress if we have not associated
+ */
+U8 OpenRFGetShortAddress(void);
+
+/*! \details Gets the radio the MAC runs on, for calling RadioAPI directly.
+ *  \return Radio handle
+ */
+tRadioHandle OpenRFGetRadio(void);
+
+/*! \details Gets the largest SDU that can be sent in one frame with the current encryption setting.  Encryption limits the
+ *  whole frame to what fits in the radio's FIFO.  Longer SDUs are fragmented.
+ *  \return Largest SDU length
+ */
+U8 OpenRFMaxSDULength(void);
+
 /*! \details Check to see if we can send a packet
- *  \return  0=Not ready to send, >=1 = Ready to send
+ *  \return  0=Transmit queue full, >=1 = Ready to send
  */
 U8 OpenRFReadyToSend(void);
 
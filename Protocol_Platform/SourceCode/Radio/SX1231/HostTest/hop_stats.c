@@ -0,0 +1,193 @@
+// Channel usage statistics of the hop sequences RadioInitialize derives from NetworkId.  The generator is arithmetic on
+// the seed, so RadioAPI is built as is and stepped with HopChannel.  Nothing is sent; the host SPI port has no radio.
+//
+// Build and run from this directory:
+//		gcc -Wall -o hop_stats hop_stats.c hostapi.c && ./hop_stats
+// Returns non zero if a channel repeats within a cycle, two hops are closer than they should be, or channel usage
+// across network ids is not uniform.
+
+#include <stdio.h>
+#include "hostapi.h"
+#include "../radioapi.c"
+
+// Network ids tried for each channel count, and cycles followed for each
+#define kNetworks		2000
+#define kCycles			20
+// Hop whose channel is compared across network ids, and how many network ids take part
+#define kSampleHop		7
+#define kSampleNetworks	5000
+// Chi-square of a 50 channel histogram (49 degrees of freedom) is above this one time in a thousand
+#define kChiSquare999	85.35
+
+int _failures;
+
+void NotifyRadioPacketReceived(tRadioHandle radio, tPacketTypes packetType, UU32 source, U8 length, U8 *SDU,
+	tPacketMetadata *metadata)
+{
+}
+
+void NotifyRadioPacketSent(tRadioHandle radio)
+{
+}
+
+void NotifyRadioPacketSendError(tRadioHandle radio)
+{
+}
+
+void NotifyRadioReceiveError(tRadioHandle radio)
+{
+}
+
+void NotifyRadio1Second(void)
+{
+}
+
+void NotifyRadio1MilliSecond(void)
+{
+}
+
+void Check(int condition, const char *what, U8 count, U32 networkId)
+{
+	if (condition)
+		return;
+	if (_failures++ < 10)
+		printf("FAIL: %s, %u channels, network id %08X\n", what, count, networkId);
+}
+
+tRadioHandle StartRadio(U8 radioNumber, U32 networkId, U8 hopTable, U8 count)
+{
+	tRadioInitialization ini = { 0 };
+
+	ini.Radio = radioNumber;
+	ini.Bus = &kRadioBusSPI;
+	ini.NetworkId.U32 = networkId;
+	ini.HopTable = hopTable;
+	ini.ChannelCount = count;
+	return RadioInitialize(ini);
+}
+
+// Channels between two hops, the short way round the band
+U8 Distance(U8 a, U8 b, U8 count)
+{
+	U8 d;
+
+	d = (a > b) ? a - b : b - a;
+	return (count - d < d) ? count - d : d;
+}
+
+// Follows kCycles cycles of every network id for 'count' channels.  Returns the closest two consecutive hops came.
+U8 CheckCycles(U8 count)
+{
+	tRadioHandle radio;
+	U32 network;
+	U16 used[FHSSCHANNELS];
+	U8 channel, previous, closest, cycle, i;
+
+	closest = 0xFF;
+	for (network = 0; network < kNetworks; network++)
+	{
+		radio = StartRadio(0, network, (U8)network, count);
+		for (i = 0; i < count; i++)
+			used[i] = 0;
+		previous = radio->HopChannel;
+		used[previous]++;
+		for (cycle = 0; cycle < kCycles; cycle++)
+		{
+			// the first hop of the first cycle is where RadioInitialize left the radio
+			for (i = (cycle == 0) ? 1 : 0; i < count; i++)
+			{
+				HopChannel(radio);
+				channel = radio->HopChannel;
+				Check(channel < count, "channel out of range", count, network);
+				if (channel >= count)
+					return 0;
+				used[channel]++;
+				if (count > 1 && Distance(channel, previous, count) < closest)
+					closest = Distance(channel, previous, count);
+				previous = channel;
+			}
+			for (i = 0; i < count; i++)
+				Check(used[i] == cycle + 1, "channel used more than once in a cycle", count, network);
+		}
+	}
+	return closest;
+}
+
+// Histogram of the channel every network id is on at the same hop.  A good seed spreads networks evenly over the band.
+double ChiSquare(void)
+{
+	tRadioHandle radio;
+	U32 network, histogram[FHSSCHANNELS] = { 0 };
+	double expected, chi, d;
+	U8 i;
+
+	for (network = 0; network < kSampleNetworks; network++)
+	{
+		radio = StartRadio(0, network, 0, FHSSCHANNELS);
+		for (i = 0; i < kSampleHop; i++)
+			HopChannel(radio);
+		histogram[radio->HopChannel]++;
+	}
+	expected = (double)kSampleNetworks / FHSSCHANNELS;
+	chi = 0;
+	for (i = 0; i < FHSSCHANNELS; i++)
+	{
+		d = histogram[i] - expected;
+		chi += d * d / expected;
+	}
+	return chi;
+}
+
+// How often two networks land on the same channel, over a long run of neighbouring network id pairs.  Independent
+// sequences would share one hop in FHSSCHANNELS.
+double SharedHops(void)
+{
+	tRadioHandle a, b;
+	U32 network, shared, hops;
+	U16 i;
+
+	shared = 0;
+	hops = 0;
+	for (network = 0; network < 200; network++)
+	{
+		// RadioInitialize binds by radio number, so the second sequence runs on the second radio
+		a = StartRadio(0, network, 0, FHSSCHANNELS);
+		b = StartRadio(1, network + 1, 0, FHSSCHANNELS);
+		for (i = 0; i < 10 * FHSSCHANNELS; i++)
+		{
+			shared += (a->HopChannel == b->HopChannel);
+			hops++;
+			HopChannel(a);
+			HopChannel(b);
+		}
+	}
+	return (double)shared / hops;
+}
+
+int main(void)
+{
+	const U8 counts[] = { FHSSCHANNELS, 25, 16, 10, 7, 4, 2, 1 };
+	U8 i, closest, wanted;
+	double chi, shared;
+
+	printf("channels  closest hops  wanted\n");
+	for (i = 0; i < sizeof(counts); i++)
+	{
+		closest = CheckCycles(counts[i]);
+		// the generator only promises kMinHopDistance where a stride that far apart exists
+		wanted = (counts[i] >= 4 * kMinHopDistance) ? kMinHopDistance : (counts[i] > 1 ? 1 : 0);
+		if (counts[i] > 1)
+			printf("%8u  %12u  %6u\n", counts[i], closest, wanted);
+		Check(counts[i] == 1 || closest >= wanted, "consecutive hops too close", counts[i], 0);
+	}
+	chi = ChiSquare();
+	printf("chi-square of hop %u over %u network ids: %.1f (limit %.1f)\n", kSampleHop, kSampleNetworks, chi,
+		kChiSquare999);
+	Check(chi < kChiSquare999, "channel usage across network ids is not uniform", FHSSCHANNELS, 0);
+	shared = SharedHops();
+	printf("hops two neighbouring network ids share: %.4f (independent: %.4f)\n", shared, 1.0 / FHSSCHANNELS);
+	Check(shared < 2.0 / FHSSCHANNELS, "neighbouring network ids share too many hops", FHSSCHANNELS, 0);
+
+	printf(_failures ? "%d checks failed\n" : "all checks passed\n", _failures);
+	return _failures ? 1 : 0;
+}
@@ -0,0 +1,74 @@
+#include "hostapi.h"
+
+// *** Host stand-in for the microcontroller API ***
+
+U32 _hostMicroseconds;
+
+U32 GetMicroseconds(void)
+{
+	return _hostMicroseconds;
+}
+
+// Nothing is on the host SPI port.  Reads see a radio that is always ModeReady.
+U8 ReadCharSPI(U8 reg)
+{
+	return (reg == RegIrqFlags1) ? 0x80 : 0x00;
+}
+
+void WriteCharSPI(U8 reg, U8 data)
+{
+}
+
+void ReadCharSPIMultiple(U8 address, U8 count, U8 *receiveBuffer)
+{
+	while (count--)
+		*receiveBuffer++ = 0;
+}
+
+void WriteCharSPIMultiple(U8 reg, U8 count, U8 *buffer)
+{
+}
+
+void ResetRadio(void)
+{
+}
+
+void SetIOForReceive(void)
+{
+}
+
+void SetIOForTransmit(void)
+{
+}
+
+void EnableIntP0(void)
+{
+}
+
+void DisableIntP0(void)
+{
+}
+
+void EnableIntP1(void)
+{
+}
+
+void DisableIntP1(void)
+{
+}
+
+void EnableIntP3(void)
+{
+}
+
+void DisableIntP3(void)
+{
+}
+
+void EnableIntP5(void)
+{
+}
+
+void DisableIntP5(void)
+{
+}
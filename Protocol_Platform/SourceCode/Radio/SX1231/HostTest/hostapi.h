@@ -0,0 +1,95 @@
+#ifndef HOSTAPI_H
+#define HOSTAPI_H
+
+// Stands in for microapi.h when RadioAPI and the MAC are built on a PC for the host tests.  The types have the sizes
+// they have on the RL78, the radio is whatever tRadioBus the test binds it to, and time is what the test says it is.
+// Include this ahead of radioapi.h; none of the MICRO_IS_ targets are defined on the host.
+
+#include <stddef.h>
+
+typedef unsigned char	U8;
+typedef unsigned short	U16;
+typedef unsigned int	U32;
+
+typedef signed char		S8;
+typedef signed short	S16;
+typedef signed int		S32;
+
+typedef union
+{
+	U16 U16;
+	S16 S16;
+	U8 U8[2];
+	S8 S8[2];
+} UU16;
+
+typedef union
+{
+	U32 U32;
+	S32 S32;
+	UU16 UU16[2];
+	U16 U16[2];
+	S16 S16[2];
+	U8 U8[4];
+	S8 S8[4];
+} UU32;
+
+typedef union
+{
+	UU32 UU32[2];
+	UU16 UU16[4];
+	U16 U16[4];
+	U8 U8[8];
+} UU64;
+
+typedef union
+{
+	UU64 UU64[2];
+	UU32 UU32[4];
+	UU16 UU16[8];
+	U16 U16[8];
+	U8 U8[16];
+} UU128;
+
+#define bit unsigned char
+
+// these defines are used to nullify custom keywords used with other compilers
+#define xdata
+#define idata
+#define code
+#define reentrant
+
+// the tests are single threaded, so there is nothing to mask
+#define DisableInterrupts
+#define EnableInterrupts
+
+// Microseconds returned by GetMicroseconds.  Tests move it on themselves.
+extern U32 _hostMicroseconds;
+
+U32 GetMicroseconds(void);
+
+// The SPI port kRadioBusSPI is bound to.  It has no radio behind it; tests give RadioInitialize a bus of their own.
+U8 ReadCharSPI(U8 reg);
+void WriteCharSPI(U8 reg, U8 data);
+void ReadCharSPIMultiple(U8 address, U8 count, U8 *receiveBuffer);
+void WriteCharSPIMultiple(U8 reg, U8 count, U8 *buffer);
+void ResetRadio(void);
+void SetIOForReceive(void);
+void SetIOForTransmit(void);
+void EnableIntP0(void);
+void DisableIntP0(void);
+void EnableIntP1(void);
+void DisableIntP1(void);
+void EnableIntP3(void);
+void DisableIntP3(void);
+void EnableIntP5(void);
+void DisableIntP5(void);
+
+// These must be defined in radioapi, as on the targets
+extern void HandleInterrupt(U8 intType);
+extern void Handle1MsInterrupt(void);
+extern void Handle1SecInterrupt(void);
+
+#include "../SX1231_defs.h"
+
+#endif
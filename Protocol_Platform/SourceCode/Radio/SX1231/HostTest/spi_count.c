@@ -0,0 +1,331 @@
+// Counts the SPI transactions RadioAPI spends on each packet.  RadioAPI runs unchanged against a register level mock of
+// the SX1231 bound through tRadioBus.  Every Read, Write, ReadMultiple and WriteMultiple call is counted as one NSS
+// low transaction of one address byte plus its data.
+//
+// Build and run from this directory:
+//		gcc -Wall -o spi_count spi_count.c hostapi.c && ./spi_count
+// Returns non zero if a frame is not moved through the FIFO in bursts, or does not come out as it went in.
+
+#include <stdio.h>
+#include <string.h>
+#include "hostapi.h"
+#include "../radioapi.c"
+
+typedef struct
+{
+	U32 Reads;
+	U32 Writes;
+	U32 ReadMultiples;
+	U32 WriteMultiples;
+	U32 Bytes;				// address and data bytes clocked
+	U32 FifoTransactions;
+	U32 FifoSingles;		// FIFO transactions that moved one byte
+} tSpiCounts;
+
+// *************************************************************************************************
+// Mock SX1231
+// ModeReady is always set, so every mode change completes as soon as it is asked for.  The FIFO is real.  PacketSent
+// and PayloadReady are raised by the test.
+
+U8 _mockRegisters[0x80];
+U8 _mockFifo[kFifoSize];
+U8 _mockFifoHead;
+U8 _mockFifoCount;
+U8 _mockPacketSent;
+U8 _mockPayloadReady;
+tSpiCounts _counts;
+int _failures;
+
+void FifoPush(U8 value)
+{
+	if (_mockFifoCount < kFifoSize)
+		_mockFifo[(_mockFifoHead + _mockFifoCount++) % kFifoSize] = value;
+}
+
+U8 FifoPop(void)
+{
+	U8 value;
+
+	if (!_mockFifoCount)
+		return 0;
+	value = _mockFifo[_mockFifoHead];
+	_mockFifoHead = (_mockFifoHead + 1) % kFifoSize;
+	_mockFifoCount--;
+	return value;
+}
+
+U8 MockRead(U8 reg)
+{
+	U8 flags;
+
+	switch (reg)
+	{
+		case RegFifo:
+			return FifoPop();
+		case RegIrqFlags1:
+			return 0x80;
+		case RegIrqFlags2:
+			flags = 0;
+			if (_mockFifoCount == kFifoSize)
+				flags |= 0x80;
+			if (_mockFifoCount)
+				flags |= 0x40;
+			if (_mockFifoCount > (_mockRegisters[RegFifoThresh] & 0x7F))
+				flags |= 0x20;
+			if (_mockPacketSent)
+				flags |= 0x08;
+			if (_mockPayloadReady)
+				flags |= 0x06;
+			return flags;
+		case RegRssiConfig:
+			return 0x02;
+		default:
+			return _mockRegisters[reg & 0x7F];
+	}
+}
+
+void MockWrite(U8 reg, U8 value)
+{
+	if (reg == RegFifo)
+		FifoPush(value);
+	else if (reg == RegIrqFlags2)
+	{
+		// writing FifoOverrun clears the FIFO
+		if (value & 0x10)
+			_mockFifoCount = 0;
+	}
+	else
+		_mockRegisters[reg & 0x7F] = value;
+}
+
+void CountTransaction(U8 reg, U8 count)
+{
+	_counts.Bytes += 1 + count;
+	if (reg != RegFifo)
+		return;
+	_counts.FifoTransactions++;
+	if (count == 1)
+		_counts.FifoSingles++;
+}
+
+U8 BusRead(U8 reg)
+{
+	_counts.Reads++;
+	CountTransaction(reg, 1);
+	return MockRead(reg);
+}
+
+void BusWrite(U8 reg, U8 value)
+{
+	_counts.Writes++;
+	CountTransaction(reg, 1);
+	MockWrite(reg, value);
+}
+
+// Bursts other than the FIFO's walk up the register map
+void BusReadMultiple(U8 reg, U8 count, U8 *buffer)
+{
+	U8 i;
+
+	_counts.ReadMultiples++;
+	CountTransaction(reg, count);
+	for (i = 0; i < count; i++)
+		buffer[i] = MockRead(reg == RegFifo ? RegFifo : (U8)(reg + i));
+}
+
+void BusWriteMultiple(U8 reg, U8 count, U8 *buffer)
+{
+	U8 i;
+
+	_counts.WriteMultiples++;
+	CountTransaction(reg, count);
+	for (i = 0; i < count; i++)
+		MockWrite(reg == RegFifo ? RegFifo : (U8)(reg + i), buffer[i]);
+}
+
+void BusEnableIrq(U8 dio, U8 enable)
+{
+}
+
+const tRadioBus kMockBus = {
+	BusRead, BusWrite, BusReadMultiple, BusWriteMultiple, 0, 0, BusEnableIrq
+};
+
+// *************************************************************************************************
+// RadioAPI callbacks
+
+U8 _received[kMaxFrameLength];
+U8 _receivedLength;
+U8 _sent;
+
+void NotifyRadioPacketReceived(tRadioHandle radio, tPacketTypes packetType, UU32 source, U8 length, U8 *SDU,
+	tPacketMetadata *metadata)
+{
+	U8 i;
+
+	for (i = 0; i < length; i++)
+		_received[i] = SDU[i];
+	_receivedLength = length;
+}
+
+void NotifyRadioPacketSent(tRadioHandle radio)
+{
+	_sent = 1;
+}
+
+void NotifyRadioPacketSendError(tRadioHandle radio)
+{
+}
+
+void NotifyRadioReceiveError(tRadioHandle radio)
+{
+}
+
+void NotifyRadio1Second(void)
+{
+}
+
+void NotifyRadio1MilliSecond(void)
+{
+}
+
+// *************************************************************************************************
+// Test
+
+void ClearCounts(void)
+{
+	tSpiCounts none = { 0 };
+
+	_counts = none;
+}
+
+void Report(const char *what)
+{
+	printf("%-34s %5u %5u %5u %5u %6u %5u %5u\n", what, _counts.Reads, _counts.Writes, _counts.ReadMultiples,
+		_counts.WriteMultiples, _counts.Reads + _counts.Writes + _counts.ReadMultiples + _counts.WriteMultiples,
+		_counts.Bytes, _counts.FifoTransactions);
+}
+
+void Check(int condition, const char *what)
+{
+	if (condition)
+		return;
+	printf("FAIL: %s\n", what);
+	_failures++;
+}
+
+// Sends 'length' bytes and lets the mock radio put them on the air, reporting the call and the interrupts separately.
+// A frame that does not fit in the FIFO is topped up from FifoLevel as the radio sends it.
+void SendFrame(tRadioHandle radio, UU32 destination, U8 length, const char *name)
+{
+	char label[64];
+	U8 payload[kMaxFrameLength], expected[kMaxFrameLength + kMaxHeaderLength], header, i, count;
+
+	for (i = 0; i < length; i++)
+		payload[i] = (U8)(i * 7 + 1);
+	_mockFifoCount = 0;
+	ClearCounts();
+	Check(RadioSendPacket(radio, destination, kUniNoAckPacketType, length, payload, 0, 0) != 0, "RadioSendPacket refused");
+	sprintf(label, "RadioSendPacket, %s", name);
+	Report(label);
+	Check(_counts.FifoSingles == 0, "TX FIFO written a byte at a time");
+	Check(_counts.FifoTransactions <= 2, "TX FIFO loaded in more than two bursts");
+
+	// the radio sends what it holds, and FifoLevel going low asks for more
+	ClearCounts();
+	HandleInterrupt(intMODERDY);
+	header = _mockFifo[_mockFifoHead];
+	count = 0;
+	while (_mockFifoCount)
+	{
+		expected[count++] = FifoPop();
+		if (_mockFifoCount == (_mockRegisters[RegFifoThresh] & 0x7F))
+			HandleInterrupt(kInterruptP1);
+	}
+	_mockPacketSent = 1;
+	_sent = 0;
+	HandleInterrupt(kInterruptP0);
+	_mockPacketSent = 0;
+	sprintf(label, "  interrupts until PacketSent");
+	Report(label);
+	Check(_sent, "PacketSent not reported");
+	Check(count == header + 1, "frame on the air is not as long as its length byte");
+	Check(count >= length && !memcmp(&expected[count - length], payload, length), "payload on the air differs");
+}
+
+// Puts a frame from 'source' in the FIFO as the radio would receive it, and lets RadioAPI read it out.
+void ReceiveFrame(tRadioHandle radio, UU32 source, U8 length, const char *name)
+{
+	char label[64];
+	U8 frame[kMaxFrameLength + kMaxHeaderLength], i, count;
+	U32 bursts;
+
+	RadioReceivePacket(radio, kContinuous, 0);
+	HandleInterrupt(intMODERDY);
+	count = 1;
+	frame[count++] = kUniNoAckPacketType;
+	for (i = 0; i < 4; i++)
+		frame[count++] = radio->MacAddress.U8[i];
+	for (i = 0; i < 4; i++)
+		frame[count++] = source.U8[i];
+	for (i = 0; i < length; i++)
+		frame[count++] = (U8)(i * 3 + 2);
+	frame[0] = count - 1;
+
+	_mockFifoCount = 0;
+	_receivedLength = 0;
+	ClearCounts();
+	// the FIFO fills as the frame comes in, and FifoLevel going high asks for it to be drained
+	for (i = 0; i < count; i++)
+	{
+		FifoPush(frame[i]);
+		if (_mockFifoCount == (_mockRegisters[RegFifoThresh] & 0x7F) + 1 && !radio->AesEnabled)
+			HandleInterrupt(kInterruptP1);
+	}
+	_mockPayloadReady = 1;
+	HandleInterrupt(kInterruptP0);
+	_mockPayloadReady = 0;
+	sprintf(label, "receive, %s", name);
+	Report(label);
+	// one burst after the length byte, plus one for each FifoLevel edge of a streamed frame
+	bursts = 1 + (radio->AesEnabled ? 0 : count / (kFifoThreshold + 1));
+	Check(_counts.FifoTransactions - _counts.FifoSingles <= bursts, "RX FIFO read in more bursts than it filled");
+	Check(_counts.FifoSingles <= 1, "RX FIFO read a byte at a time");
+	Check(_receivedLength == length && !memcmp(_received, &frame[10], length), "received payload differs");
+}
+
+int main(void)
+{
+	tRadioInitialization ini = { 0 };
+	tRadioHandle radio;
+	UU32 peer;
+
+	ini.Radio = 0;
+	ini.Bus = &kMockBus;
+	ini.MacAddress.U32 = 0x11223344;
+	ini.NetworkId.U32 = 0x0A0B0C0D;
+	ClearCounts();
+	radio = RadioInitialize(ini);
+	Check(radio != 0, "RadioInitialize failed");
+	if (!radio)
+		return 1;
+	printf("%-34s %5s %5s %5s %5s %6s %5s %5s\n", "", "Read", "Write", "RdBst", "WrBst", "Total", "Bytes", "FIFO");
+	Report("RadioInitialize");
+	RadioSetDataRate(radio, k38400BPS);
+	peer.U32 = 0x55667788;
+
+	// AES on, as after RadioInitialize: the whole frame fits in the FIFO
+	SendFrame(radio, peer, 20, "20 bytes, AES");
+	SendFrame(radio, peer, kMaxAesFrameLength - 10, "54 bytes, AES");
+	ReceiveFrame(radio, peer, 20, "20 bytes, AES");
+	ReceiveFrame(radio, peer, kMaxAesFrameLength - 10, "54 bytes, AES");
+	// AES off: frames bigger than the FIFO are streamed
+	RadioSetEncryption(radio, 0);
+	SendFrame(radio, peer, 60, "60 bytes");
+	SendFrame(radio, peer, 200, "200 bytes");
+	ReceiveFrame(radio, peer, 60, "60 bytes");
+	ReceiveFrame(radio, peer, 200, "200 bytes");
+
+	printf(_failures ? "%d checks failed\n" : "all checks passed\n", _failures);
+	return _failures ? 1 : 0;
+}
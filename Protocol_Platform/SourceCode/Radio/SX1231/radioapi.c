@@ -1,153 +1,1274 @@
 #include "radioapi.h"
 
-struct
+typedef struct
 {
+	U8 Modulation[4];	// RegBitrateMsb, RegBitrateLsb, RegFdevMsb, RegFdevLsb
+	U8 Bandwidth[2];	// RegRxBw, RegAfcBw
+	U8 LowBetaOffset;	// RegTestAfc
+	U8 TrackedAfcBw;	// RegAfcBw once the peer's frequency offset is corrected for
+} tDataRateSetting;
+
+typedef struct
+{
+	UU32 MacAddress;
+	U8 ShortAddress;
+} tShortPeer;
+
+// Everything RadioAPI knows about one radio.  A tRadioHandle points at one of these.
+struct tRadio
+{
+	// NULL until RadioInitialize binds the radio to its port
+	const tRadioBus	*Bus;
 	tListenModes 	ListenMode;
 	U16 			ListenPeriod;
 	U8 				CurrentChannel;
+	// Channel the synthesizer was last tuned to
+	U8				Channel;
 	tOperatingModes	Mode;
-	U8				HopIndex;
-	U8 				HopTable;
+	// Hop sequence.  Channel i of a cycle is (HopBase + i * HopStride) mod ChannelCount, and HopBase moves on by HopShift
+	// every cycle.  HopChannel is the channel at HopPosition in the current cycle.
+	U8				ChannelCount;
+	U8				HopStride;
+	U8				HopShift;
+	U8				HopBase;
+	U8				HopPosition;
+	U8				HopChannel;
+	tBandPlans		BandPlan;
+	U16				FhssStepSize;
+	U8				FSPretune;
 	UU32			MacAddress;
 	U8				GfskEnabled;
-	U8				ReceiveBuffer[64];
+	U8				AesEnabled;
+	// Non zero when frames carry a node address byte for the radio to filter on
+	U8				AddressFiltering;
+	tFilterStatistics FilterStatistics;
+	// Short address headers.  ShortAddress is ours, kNoShortAddress until the MAC has associated.  ShortPeers holds the short
+	// addresses we can put a MAC to, with kNoShortAddress marking a free entry.
+	U8				ShortAddress;
+	tShortPeer		ShortPeers[kShortPeerCount];
+	tHeaderStatistics HeaderStatistics[kAckPacketType + 1];
+	// ACK engine.  AckFrame is built ahead of time for AckPeer, so answering a UniAck frame from that peer is a single FIFO
+	// burst.  AckedLength is the length of the received frame waiting in ReceiveBuffer for its ACK to go out, zero if none.
+	U8				AutoAck;
+	UU32			AckPeer;
+	U8				AckFrame[kMaxHeaderLength];
+	U8				AckFrameLength;
+	U8				AckedLength;
+	U8				TxPaLevel;
+	tAckTurnaround	AckTurnaround;
+	// RSSI sampler, run from the 1mSec tick.  Samples go into a ring of kRssiSampleCount starting at RssiHead.  A scan walks
+	// every channel, keeping the quietest reading of each in NoiseFloor.  ScanChannel is kNoScan when no scan is running.
+	// CcaRequested asks the tick for one reading for a clear channel assessment, and CcaReady says LastRssi is that reading.
+	U16				RssiInterval;
+	U16				RssiTimer;
+	U8				RssiPending;
+	U8				CcaRequested;
+	U8				CcaReady;
+	U8				LastRssi;
+	U8				RssiSamples[kRssiSampleCount];
+	U8				RssiHead;
+	U8				RssiCount;
+	U8				ScanChannel;
+	U8				ScanSamples;
+	U8				ScanCount;
+	U8				NoiseFloor[FHSSCHANNELS];
+	U8				ReceiveBuffer[kMaxFrameLength];
+	// Frames bigger than the FIFO are streamed.  RxLength is the length byte of the frame being drained (zero until it has
+	// been read) and RxCount is how much of it is already in ReceiveBuffer.  TxPointer/TxRemaining is the part of the
+	// caller's buffer that has not been loaded into the FIFO yet.
+	U8				RxLength;
+	U8				RxCount;
+	tPacketMetadata	RxMetadata;
+	// Frequency offset of each recently heard peer in Fstep units, the one for the expected peer, and the part of it Frf
+	// carries now: all of it while receiving, none while transmitting.  Frames from a peer that has been heard before are
+	// received with AfcBw narrowed to TrackedAfcBw.
+	tPeerOffset		PeerOffsets[kPeerOffsetCount];
+	U8				NextPeerOffset;
+	S16				FrequencyCorrection;
+	S16				TunedCorrection;
+	const tDataRateSetting *DataRate;
+	U8				*TxPointer;
+	U8				TxRemaining;
+	U8				TxSequence[2];
+	// Sync word timing.  SyncTimestamp is when the SyncAddress edge of the frame being received was serviced, valid while
+	// SyncSeen is set.  TxTimestamp is when the sync word of the last frame sent ended, worked back from PacketSent.
+	U32				SyncTimestamp;
+	U8				SyncSeen;
+	U8				TxFrameLength;
+	U32				TxTimestamp;
 	U16				Timers[MAXTIMERS];
-} radioPrivateData;
-
-const U8 _hopTable50[5][50] = {
-	{ 0x1a,0x13,0x2e,0x0c,0x16,0x00,0x01,0x19,0x15,0x1b,0x28,0x1c,0x09,0x31,0x0f,0x20,0x1e,0x22,0x03,0x0b,0x2c,0x18,0x17,0x26,0x0a,0x10,0x2a,0x2d,0x07,0x23,0x11,0x1d,0x21,0x30,0x2f,0x27,0x29,0x14,0x06,0x02,0x2b,0x04,0x05,0x24,0x0d,0x0e,0x1f,0x08,0x12,0x25 },
-	{ 0x09,0x2c,0x18,0x0b,0x0e,0x2f,0x15,0x29,0x30,0x14,0x1e,0x12,0x08,0x21,0x2e,0x10,0x2d,0x1d,0x0a,0x27,0x28,0x06,0x24,0x07,0x02,0x05,0x1b,0x03,0x26,0x01,0x23,0x00,0x20,0x25,0x31,0x2b,0x2a,0x19,0x1a,0x0d,0x11,0x22,0x0c,0x17,0x04,0x13,0x16,0x1c,0x0f,0x1f },
-	{ 0x28,0x09,0x0d,0x0b,0x0c,0x2c,0x1d,0x16,0x06,0x00,0x21,0x2e,0x02,0x08,0x1f,0x22,0x11,0x26,0x1e,0x2a,0x23,0x18,0x27,0x03,0x14,0x25,0x07,0x2b,0x01,0x0a,0x05,0x12,0x1b,0x24,0x1a,0x31,0x17,0x2f,0x19,0x10,0x15,0x04,0x20,0x2d,0x29,0x0f,0x30,0x1c,0x0e,0x13 },
-	{ 0x1f,0x15,0x2c,0x0b,0x14,0x07,0x08,0x09,0x0d,0x17,0x21,0x25,0x2b,0x27,0x18,0x04,0x10,0x1b,0x0a,0x0e,0x02,0x1a,0x29,0x2a,0x05,0x2e,0x2f,0x01,0x11,0x16,0x06,0x00,0x22,0x19,0x20,0x1d,0x03,0x2d,0x30,0x12,0x26,0x23,0x31,0x28,0x24,0x1c,0x13,0x0c,0x0f,0x1e },
-	{ 0x0f,0x25,0x22,0x15,0x13,0x10,0x20,0x0a,0x2a,0x06,0x1d,0x19,0x2b,0x23,0x18,0x1b,0x14,0x24,0x27,0x2d,0x05,0x09,0x08,0x29,0x02,0x0b,0x30,0x17,0x26,0x12,0x11,0x21,0x00,0x0d,0x1e,0x03,0x2f,0x1f,0x01,0x1c,0x04,0x28,0x07,0x31,0x2e,0x0c,0x16,0x2c,0x0e,0x1a }
+	// mSec without a FifoLevel or timeout edge after which the 1mSec tick services the receive FIFO itself.  Half the time
+	// the FIFO takes to fill at the current data rate, so a missed edge is caught before it overflows.
+	U16				FifoPollInterval;
+	// Shadow copy of the SX1231 register map.  Configuration registers are read from here instead of over SPI, and writes
+	// that do not change a value never reach the radio.  A set bit in DirtyRegisters means the cached value still has to be
+	// sent to the radio by FlushRegisters(radio).
+	U8				Registers[0x80];
+	U8				DirtyRegisters[0x80 / 8];
+	// Operating mode state machine.  OpMode is the last RegOpMode value the radio reported ready, PendingOpMode is the
+	// transition in flight and QueuedOpMode is started from the ModeReady interrupt once it completes.  kNoOpMode means none.
+	U8				OpMode;
+	U8				PendingOpMode;
+	U8				QueuedOpMode;
+	U32				OpModeStart;
+	tModeLatency	ModeLatency[kReceiveMode + 1];
 };
-U8 const _hopTable25[5][25] = {
-	{ 0x13,0x03,0x06,0x16,0x0c,0x0a,0x02,0x18,0x01,0x11,0x14,0x0b,0x10,0x09,0x08,0x05,0x0f,0x04,0x00,0x15,0x12,0x0e,0x0d,0x07,0x17 },
-	{ 0x0b,0x12,0x16,0x18,0x17,0x0d,0x15,0x01,0x10,0x0f,0x05,0x02,0x07,0x08,0x13,0x0e,0x0a,0x06,0x04,0x03,0x00,0x09,0x14,0x0c,0x11 },
-	{ 0x08,0x02,0x0b,0x06,0x0f,0x13,0x0a,0x0d,0x09,0x18,0x07,0x15,0x05,0x0e,0x12,0x00,0x11,0x04,0x14,0x01,0x17,0x10,0x03,0x16,0x0c },
-	{ 0x0b,0x0e,0x03,0x15,0x00,0x18,0x17,0x08,0x13,0x0f,0x10,0x0d,0x0c,0x07,0x14,0x0a,0x04,0x11,0x09,0x12,0x05,0x16,0x06,0x01,0x02 },
-	{ 0x00,0x16,0x01,0x0e,0x15,0x0b,0x12,0x07,0x06,0x18,0x11,0x13,0x0d,0x14,0x08,0x02,0x05,0x17,0x09,0x0c,0x04,0x0f,0x10,0x0a,0x03 }
+
+// Radio n's DIO interrupts are dispatched to _radios[n]
+struct tRadio _radios[kRadioCount];
+
+// *************************************************************************************************
+// Data rate table
+// Every register value is computed from the datasheet formulas at compile time, so the table cannot drift from them.
+
+#define kFxosc					32000000UL
+// Widest frequency error AFC has to pull in: +/-20ppm crystals on both ends at 915MHz
+#define kAfcMargin				40000UL
+// Frequency error left once a peer's measured offset is corrected for: drift since it was measured
+#define kTrackedAfcMargin		5000UL
+
+// Bit rate register = Fxosc / bit rate
+#define BITRATE_REG(br)			((kFxosc + (br) / 2) / (br))
+// FSK modulation index of 1, but never below the radio's 600Hz minimum deviation
+#define FDEV_HZ(br)				((br) / 2 < 600 ? 600UL : (br) / 2)
+// Fdev register = Fdev / Fstep with Fstep = Fxosc / 2^19 = 15625 / 256 Hz
+#define FDEV_REG(hz)			(((hz) * 256UL + 7812) / 15625)
+// Single sided receiver bandwidth = Fxosc / (RxBwMant * 2^(RxBwExp + 2))
+#define RXBW_HZ(mant, exp)		(kFxosc / ((mant) * (4UL << (exp))))
+#define RXBW_MANT(mant)			((mant) == 16 ? 0x00 : (mant) == 20 ? 0x08 : 0x10)
+#define RXBW_TRY(hz, mant, exp, next)	((hz) <= RXBW_HZ(mant, exp) ? (RXBW_MANT(mant) | (exp)) : (next))
+// Smallest bandwidth setting that passes hz, with DccFreq left at the default 4% of RxBw
+#define RXBW_REG(hz)	(0x40 | \
+	RXBW_TRY(hz, 24, 7, RXBW_TRY(hz, 20, 7, RXBW_TRY(hz, 16, 7, \
+	RXBW_TRY(hz, 24, 6, RXBW_TRY(hz, 20, 6, RXBW_TRY(hz, 16, 6, \
+	RXBW_TRY(hz, 24, 5, RXBW_TRY(hz, 20, 5, RXBW_TRY(hz, 16, 5, \
+	RXBW_TRY(hz, 24, 4, RXBW_TRY(hz, 20, 4, RXBW_TRY(hz, 16, 4, \
+	RXBW_TRY(hz, 24, 3, RXBW_TRY(hz, 20, 3, RXBW_TRY(hz, 16, 3, \
+	RXBW_TRY(hz, 24, 2, RXBW_TRY(hz, 20, 2, RXBW_TRY(hz, 16, 2, \
+	RXBW_TRY(hz, 24, 1, RXBW_TRY(hz, 20, 1, RXBW_TRY(hz, 16, 1, \
+	RXBW_TRY(hz, 24, 0, RXBW_TRY(hz, 20, 0, 0x00))))))))))))))))))))))))
+// Carson bandwidth (single sided) is Fdev + BR/2.  Gaussian shaping narrows the spectrum, so GFSK gets by with Fdev + BR/4.
+#define FSK_BW(br)				(FDEV_HZ(br) + (br) / 2)
+#define GFSK_BW(br)				(FDEV_HZ(br) + (br) / 4)
+// Low beta AFC offset, in 488Hz steps, of roughly 2.5% of the bit rate
+#define LOWBETA_REG(br)			(((br) / 40 + 244) / 488)
+
+#define DATARATE_ROW(br, bw, lowBeta) \
+	{ { BITRATE_REG(br) >> 8, BITRATE_REG(br) & 0xFF, FDEV_REG(FDEV_HZ(br)) >> 8, FDEV_REG(FDEV_HZ(br)) & 0xFF }, \
+	  { RXBW_REG(bw), RXBW_REG((bw) + kAfcMargin) }, \
+	  lowBeta, \
+	  RXBW_REG((bw) + kTrackedAfcMargin) }
+#define FSK_ROW(br)				DATARATE_ROW(br, FSK_BW(br), 0)
+#define GFSK_ROW(br)			DATARATE_ROW(br, GFSK_BW(br), LOWBETA_REG(br))
+
+// Indexed by GFSK enabled, then by tDataRates
+const tDataRateSetting _dataRateTable[2][k300KBPS + 1] = {
+	{
+		FSK_ROW(1200UL),	FSK_ROW(2400UL),	FSK_ROW(4800UL),	FSK_ROW(9600UL),	FSK_ROW(19200UL),	FSK_ROW(38400UL),
+		FSK_ROW(57600UL),	FSK_ROW(76800UL),	FSK_ROW(153600UL),	FSK_ROW(12500UL),	FSK_ROW(25000UL),	FSK_ROW(50000UL),
+		FSK_ROW(100000UL),	FSK_ROW(150000UL),	FSK_ROW(200000UL),	FSK_ROW(250000UL),	FSK_ROW(300000UL)
+	},
+	{
+		GFSK_ROW(1200UL),	GFSK_ROW(2400UL),	GFSK_ROW(4800UL),	GFSK_ROW(9600UL),	GFSK_ROW(19200UL),	GFSK_ROW(38400UL),
+		GFSK_ROW(57600UL),	GFSK_ROW(76800UL),	GFSK_ROW(153600UL),	GFSK_ROW(12500UL),	GFSK_ROW(25000UL),	GFSK_ROW(50000UL),
+		GFSK_ROW(100000UL),	GFSK_ROW(150000UL),	GFSK_ROW(200000UL),	GFSK_ROW(250000UL),	GFSK_ROW(300000UL)
+	}
 };
 
-U8 _registers[0x80];
+// Checks on the formulas above, against values printed in the SX1231 datasheet rather than worked out the same way.  A
+// check that fails stops the build with a negative array size.
+#define DATARATE_CHECK(name, condition)	typedef char name[(condition) ? 1 : -1]
+// Receiver bandwidth a RegRxBw / RegAfcBw value selects
+#define RXBW_DECODE(reg)		RXBW_HZ(((reg) & 0x18) == 0x00 ? 16 : ((reg) & 0x18) == 0x08 ? 20 : 24, (reg) & 0x07)
+// Bit rate register from the datasheet's bit rate table, and every bandwidth picked covers what it was asked for
+#define DATARATE_CHECKS(name, br, bitrate) \
+	DATARATE_CHECK(name##Bitrate, BITRATE_REG(br) == (bitrate)); \
+	DATARATE_CHECK(name##FskRxBw, RXBW_DECODE(RXBW_REG(FSK_BW(br))) >= FSK_BW(br)); \
+	DATARATE_CHECK(name##FskAfcBw, RXBW_DECODE(RXBW_REG(FSK_BW(br) + kAfcMargin)) >= FSK_BW(br) + kAfcMargin); \
+	DATARATE_CHECK(name##GfskRxBw, RXBW_DECODE(RXBW_REG(GFSK_BW(br))) >= GFSK_BW(br)); \
+	DATARATE_CHECK(name##GfskAfcBw, RXBW_DECODE(RXBW_REG(GFSK_BW(br) + kAfcMargin)) >= GFSK_BW(br) + kAfcMargin)
+
+DATARATE_CHECKS(Check1200, 1200UL, 0x682B);
+DATARATE_CHECKS(Check2400, 2400UL, 0x3415);
+DATARATE_CHECKS(Check4800, 4800UL, 0x1A0B);
+DATARATE_CHECKS(Check9600, 9600UL, 0x0D05);
+DATARATE_CHECKS(Check19200, 19200UL, 0x0683);
+DATARATE_CHECKS(Check38400, 38400UL, 0x0341);
+DATARATE_CHECKS(Check57600, 57600UL, 0x022C);
+DATARATE_CHECKS(Check76800, 76800UL, 0x01A1);
+DATARATE_CHECKS(Check153600, 153600UL, 0x00D0);
+DATARATE_CHECKS(Check12500, 12500UL, 0x0A00);
+DATARATE_CHECKS(Check25000, 25000UL, 0x0500);
+DATARATE_CHECKS(Check50000, 50000UL, 0x0280);
+DATARATE_CHECKS(Check100000, 100000UL, 0x0140);
+DATARATE_CHECKS(Check150000, 150000UL, 0x00D5);
+DATARATE_CHECKS(Check200000, 200000UL, 0x00A0);
+DATARATE_CHECKS(Check250000, 250000UL, 0x0080);
+DATARATE_CHECKS(Check300000, 300000UL, 0x006B);
+// Reset values: 5kHz is RegFdev 0x0052, 10.4kHz is RegRxBw 0x55 and 50kHz is RegAfcBw 0x8B less its DccFreq
+DATARATE_CHECK(CheckFdev, FDEV_REG(5000UL) == 0x52);
+DATARATE_CHECK(CheckRxBw, RXBW_REG(10416UL) == 0x55 && RXBW_REG(10417UL) == 0x4D);
+DATARATE_CHECK(CheckAfcBw, (RXBW_REG(50000UL) & 0x1F) == 0x0B);
+DATARATE_CHECK(CheckWidestBw, RXBW_REG(500000UL) == 0x40);
 
-#define WriteCHARSPI		WriteCharSPI
-#define ReadCHARSPI			ReadCharSPI
+// *************************************************************************************************
+// Band plans
+// Frf for every channel of every band plan is worked out at compile time, so a hop is a single 3 byte burst.
+
+// Frf = Fc / Fstep with Fstep = Fxosc / 2^19, which is 2048 / 125 per kHz
+#define FRF_REG(khz)			(((khz) * 2048UL + 62) / 125)
+#define FRF_ROW(khz)			{ FRF_REG(khz) >> 16, (FRF_REG(khz) >> 8) & 0xFF, FRF_REG(khz) & 0xFF }
+#define FRF_ROW10(base, step, first) \
+	FRF_ROW((base) + ((first) + 0) * (step)), FRF_ROW((base) + ((first) + 1) * (step)), \
+	FRF_ROW((base) + ((first) + 2) * (step)), FRF_ROW((base) + ((first) + 3) * (step)), \
+	FRF_ROW((base) + ((first) + 4) * (step)), FRF_ROW((base) + ((first) + 5) * (step)), \
+	FRF_ROW((base) + ((first) + 6) * (step)), FRF_ROW((base) + ((first) + 7) * (step)), \
+	FRF_ROW((base) + ((first) + 8) * (step)), FRF_ROW((base) + ((first) + 9) * (step))
+#define FRF_CHANNELS(base, step) \
+	{ FRF_ROW10(base, step, 0), FRF_ROW10(base, step, 10), FRF_ROW10(base, step, 20), \
+	  FRF_ROW10(base, step, 30), FRF_ROW10(base, step, 40) }
+
+// 902-928MHz: 500kHz channels starting at 902.5MHz
+#define kBand915BaseKHz			902500UL
+#define kBand915StepKHz			500
+// 863-870MHz: 125kHz channels starting at 863.125MHz
+#define kBand868BaseKHz			863125UL
+#define kBand868StepKHz			125
+// 433.05-434.79MHz: 25kHz channels starting at 433.1MHz
+#define kBand433BaseKHz			433100UL
+#define kBand433StepKHz			25
+
+// Indexed by tBandPlans, then by channel.  MSB first, in register order.
+const U8 _frfTable[kBand433 + 1][FHSSCHANNELS][3] = {
+	FRF_CHANNELS(kBand915BaseKHz, kBand915StepKHz),
+	FRF_CHANNELS(kBand868BaseKHz, kBand868StepKHz),
+	FRF_CHANNELS(kBand433BaseKHz, kBand433StepKHz)
+};
+// Lowest channel of each band plan, used when a non default channel spacing has to be worked out at run time
+const U32 _bandBaseKHz[kBand433 + 1] = { kBand915BaseKHz, kBand868BaseKHz, kBand433BaseKHz };
+
+// Every access goes out on the bus of the radio being worked on, which is always in scope as 'radio'
+#define WriteCHARSPI(reg, value)					radio->Bus->Write(reg, value)
+#define ReadCHARSPI(reg)							radio->Bus->Read(reg)
+#define WriteCHARSPIMultiple(reg, count, buffer)	radio->Bus->WriteMultiple(reg, count, buffer)
+#define ReadCHARSPIMultiple(reg, count, buffer)		radio->Bus->ReadMultiple(reg, count, buffer)
+// Longest a blocking caller waits for ModeReady, in uSec
 #define kModeChangeTimeout	8192
+// Longest a non-blocking transition may stay in flight before the 1mSec tick gives up on it, in mSec
+#define kModeChangeTimeoutMs	10
+#define kNoOpMode				0xFF
+// RegOpMode bits that run and stop the radio's own listen cycle.  Mode (4-2) says where the radio goes once ListenEnd is met.
+#define kListenOn				0x40
+#define kListenAbort			0x20
+// Length of each listen RX window in bit times: enough for RSSI to settle and for two preamble and four sync bytes to match
+#define kListenRxBits			64
+// Receive timeout.  RegRxTimeout2 counts in 16 bit times from RSSI going over the threshold, so it has to outlast the
+// longest frame: kRxTimeoutPreamble preamble bytes, the 4 sync bytes, the length byte, kMaxFrameLength bytes and the CRC,
+// with 4 bytes of slack.  Frames sent with a longer preamble than that are cut short.
+#define kRxTimeoutPreamble		24
+#define kRxTimeout				(((kRxTimeoutPreamble + 4 + 1 + kMaxFrameLength + 2 + 4) * 8 + 15) / 16)
+#if kRxTimeout > 0xFF
+#error kRxTimeout does not fit in RegRxTimeout2
+#endif
+// Preamble sent ahead of an ACK, in bytes.  The peer is already listening, so it only needs enough to settle AFC.
+#define kAckPreambleLength		3
+#define kNoScan					0xFF
+#define kNoPeer					0xFF
+// Set in the packet type byte of frames with short address headers.  Packet types sent over the air stay below
+// kFragmentFlag.  The flags the next layer up sets are passed through untouched.
+#define kShortHeaderFlag		0x40
+#define kPacketTypeMask			0x07
+#define kUpperLayerFlags		(kAggregateFlag | kFragmentFlag)
+// The Mode bits of RegOpMode (4-2) line up with tOperatingModes
+#define OpModeToMode(opMode)	(((opMode) >> 2) & 0x07)
+
+// ModeReady is on DIO5.  Ports that do not bring DIO5 out to a pin, and radios other than the one on SPI, fall back to the
+// ModeReady flag in RegIrqFlags1.
+#ifdef pinDIO5
+#define IsModeReady()			(radio->Bus == &kRadioBusSPI ? (pinMODERDY) : (ReadCHARSPI(RegIrqFlags1) & 0x80))
+#else
+#define IsModeReady()			(ReadCHARSPI(RegIrqFlags1) & 0x80)
+#endif
+
+// *************************************************************************************************
+// Radio buses
+
+void SpiSetIO(U8 transmit)
+{
+	if (transmit)
+		SetIOForTransmit();
+	else
+		SetIOForReceive();
+}
+
+// DIOn of the radio on SPI is wired to external interrupt n
+void SpiEnableIrq(U8 dio, U8 enable)
+{
+	switch (dio)
+	{
+		case 0:
+			if (enable)
+				EnableIntP0();
+			else
+				DisableIntP0();
+			break;
+		case 1:
+			if (enable)
+				EnableIntP1();
+			else
+				DisableIntP1();
+			break;
+		case 3:
+			if (enable)
+				EnableIntP3();
+			else
+				DisableIntP3();
+			break;
+		case 5:
+			if (enable)
+				EnableIntP5();
+			else
+				DisableIntP5();
+			break;
+		default:
+			break;
+	}
+}
+
+const tRadioBus kRadioBusSPI = {
+	ReadCharSPI, WriteCharSPI, ReadCharSPIMultiple, WriteCharSPIMultiple, ResetRadio, SpiSetIO, SpiEnableIrq
+};
+#ifdef RADIO_SPI2
+const tRadioBus kRadioBusSPI2 = {
+	ReadCharSPI2, WriteCharSPI2, ReadCharSPIMultiple2, WriteCharSPIMultiple2, 0, 0, 0
+};
+#endif
 
 // *************************************************************************************************
 // Utility functions used internally by RadioAPI
-// returns zero if the change times out, one if the mode times out
-U8 WaitForModeChange()
+
+void EnableIrq(tRadioHandle radio, U8 dio, U8 enable)
 {
-	U16 timeOut;
+	if (radio->Bus->EnableIrq)
+		radio->Bus->EnableIrq(dio, enable);
+}
 
-	timeOut = kModeChangeTimeout;
-	while (timeOut && !(ReadCHARSPI(RegIrqFlags1) & 0x80))
-		timeOut--;
-	return (timeOut ? 1 : 0);
+// Status, FIFO and trigger registers change underneath us, so they always go straight to the radio and are never cached.
+U8 IsVolatileRegister(U8 reg)
+{
+	return (reg <= RegOpMode
+		||	reg == RegOsc1
+		||	(reg >= RegAfcFei && reg <= RegRssiValue)
+		||	reg == RegIrqFlags1
+		||	reg == RegIrqFlags2
+		||	reg == RegTemp1
+		||	reg == RegTemp2);
 }
 
-void ReadRegs()
+#define IsRegisterDirty(reg)	(radio->DirtyRegisters[(reg) >> 3] & (1 << ((reg) & 0x07)))
+
+// Fill the shadow copy from the radio in one burst.  Must be done whenever the radio may have been reset underneath us.
+void LoadRegisters(tRadioHandle radio)
 {
-	int i;
-	for (i = 0x01; i < 0x80; i++)
-		_registers[i] = ReadCHARSPI(i);
+	U8 i;
+
+	ReadCHARSPIMultiple(0x01, 0x7F, &radio->Registers[1]);
+	for (i = 0; i < sizeof(radio->DirtyRegisters); i++)
+		radio->DirtyRegisters[i] = 0;
+}
+
+// Send every dirty register to the radio.  Contiguous dirty registers go out as one burst, and a single clean configuration
+// register between two dirty ones is rewritten with its cached value rather than paying for a second SPI transaction.
+void FlushRegisters(tRadioHandle radio)
+{
+	U8 reg, start;
+
+	reg = 0x01;
+	while (reg < 0x80)
+	{
+		if (!radio->DirtyRegisters[reg >> 3])
+		{
+			// nothing dirty in this group of eight
+			reg = (reg | 0x07) + 1;
+			continue;
+		}
+		if (!IsRegisterDirty(reg))
+		{
+			reg++;
+			continue;
+		}
+		start = reg;
+		while (reg < 0x80
+		&&	(IsRegisterDirty(reg)
+			||	(reg + 1 < 0x80 && IsRegisterDirty(reg + 1) && !IsVolatileRegister(reg)))
+			)
+		{
+			radio->DirtyRegisters[reg >> 3] &= ~(1 << (reg & 0x07));
+			reg++;
+		}
+		WriteCHARSPIMultiple(start, reg - start, &radio->Registers[start]);
+	}
+}
+
+void WriteRegister(tRadioHandle radio, U8 reg, U8 value)
+{
+	if (IsVolatileRegister(reg))
+		WriteCHARSPI(reg, value);
+	else if (radio->Registers[reg] != value)
+	{
+		radio->Registers[reg] = value;
+		radio->DirtyRegisters[reg >> 3] |= 1 << (reg & 0x07);
+	}
+}
+
+void WriteRegisters(tRadioHandle radio, U8 reg, U8 count, const U8 *values)
+{
+	while (count--)
+		WriteRegister(radio, reg++, *values++);
 }
 
-void ClearFIFO()
+U8 ReadRegister(tRadioHandle radio, U8 reg)
 {
-	WriteCHARSPI(RegIrqFlags2, 0x10);
+	if (IsVolatileRegister(reg))
+		return ReadCHARSPI(reg);
+	return radio->Registers[reg];
 }
 
-void HandleTimeout()
+// Every mode change goes through here so pending configuration is on the radio before the new mode starts using it.
+// Listen mode cycles between idle and RX on its own, so its ModeReady edges are masked while it runs and it has to be
+// aborted before any other mode is set.  A radio in an unknown state is aborted as well, which is harmless if it was not
+// listening.
+void StartOpMode(tRadioHandle radio, U8 opMode)
 {
-	if (radioPrivateData.ListenMode & 0x80)
+	FlushRegisters(radio);
+	if (opMode & kListenOn)
+		EnableIrq(radio, 5, 0);
+	else if (radio->OpMode & kListenOn)
 	{
-		radioPrivateData.CurrentChannel++;
+		WriteCHARSPI(RegOpMode, opMode | kListenAbort);
+		EnableIrq(radio, 5, 1);
+	}
+	WriteCHARSPI(RegOpMode, opMode);
+	radio->PendingOpMode = opMode;
+	radio->OpModeStart = GetMicroseconds();
+	radio->Timers[kModeTimer] = 0;
+}
+
+// Finishes the transition in flight, records how long it took and starts the queued transition, if there is one.
+// Must be called with interrupts disabled or from an ISR.
+void CompleteOpMode(tRadioHandle radio, U8 timedOut)
+{
+	tModeLatency *latency;
+	U32 elapsed;
+	U8 opMode;
+
+	if (radio->PendingOpMode == kNoOpMode)
+		return;
+	latency = &radio->ModeLatency[OpModeToMode(radio->PendingOpMode)];
+	if (timedOut)
+		latency->Timeouts++;
+	else if (latency->Count < 0xFFFF)
+	{
+		elapsed = GetMicroseconds() - radio->OpModeStart;
+		if (elapsed > 0xFFFF)
+			elapsed = 0xFFFF;
+		if (latency->Count == 0 || elapsed < latency->Minimum)
+			latency->Minimum = (U16)elapsed;
+		if (elapsed > latency->Maximum)
+			latency->Maximum = (U16)elapsed;
+		latency->Count++;
+		latency->Total += elapsed;
+	}
+	radio->OpMode = radio->PendingOpMode;
+	radio->PendingOpMode = kNoOpMode;
+
+	opMode = radio->QueuedOpMode;
+	radio->QueuedOpMode = kNoOpMode;
+	if (opMode != kNoOpMode && opMode != radio->OpMode)
+		StartOpMode(radio, opMode);
+}
+
+// Requests a mode change and returns without waiting for it.  If a transition is already in flight, the new mode is started
+// from the ModeReady interrupt once it completes.  Only the most recent request is kept.
+void SetOpMode(tRadioHandle radio, U8 opMode)
+{
+	DisableInterrupts;
+	if (radio->PendingOpMode != kNoOpMode)
+		radio->QueuedOpMode = (opMode == radio->PendingOpMode) ? kNoOpMode : opMode;
+	else if (opMode != radio->OpMode)
+		StartOpMode(radio, opMode);
+	else
+		// already there, but the caller still expects its configuration to be on the radio
+		FlushRegisters(radio);
+	EnableInterrupts;
+}
+
+// Blocks until the transition in flight, and any transition queued behind it, has completed.  This polls the ModeReady pin
+// rather than the radio, so no SPI traffic is generated while waiting.
+// returns zero if the change times out, one if the mode change completed
+U8 WaitForModeChange(tRadioHandle radio)
+{
+	U32 start;
 
-		if (radioPrivateData.CurrentChannel > FHSSCHANNELS
-		&&	radioPrivateData.ListenMode == kContinuousScan
+	start = GetMicroseconds();
+	while (radio->PendingOpMode != kNoOpMode)
+	{
+		if (GetMicroseconds() - start > kModeChangeTimeout)
+			return 0;
+		if (IsModeReady())
+		{
+			DisableInterrupts;
+			CompleteOpMode(radio, 0);
+			EnableInterrupts;
+		}
+	}
+	return 1;
+}
+
+// Empties the FIFO and forgets any partially drained frame
+void ClearFIFO(tRadioHandle radio)
+{
+	WriteRegister(radio, RegIrqFlags2, 0x10);
+	radio->RxLength = 0;
+	radio->RxCount = 0;
+}
+
+// Moves up to 'available' bytes of the frame being received from the FIFO into ReceiveBuffer.  The length byte is read on
+// its own first so we know where the frame ends.  Returns zero if the length byte is not valid.
+U8 DrainFIFO(tRadioHandle radio, U8 available)
+{
+	U8 count;
+
+	if (!radio->RxLength)
+	{
+		radio->RxLength = ReadCHARSPI(RegFifo);
+		if (!radio->RxLength)
+			return 0;
+		available--;
+	}
+	count = radio->RxLength - radio->RxCount;
+	if (count > available)
+		count = available;
+	if (count)
+	{
+		ReadCHARSPIMultiple(RegFifo, count, &radio->ReceiveBuffer[radio->RxCount]);
+		radio->RxCount += count;
+	}
+	return 1;
+}
+
+// Keeps a streamed frame moving.  Called when FifoLevel (DIO1) changes, with RegIrqFlags2 already read by the caller.
+// TX: FifoLevel clear means no more than kFifoThreshold bytes are left, so the rest of the FIFO can be refilled.
+// RX: FifoLevel set means more than kFifoThreshold bytes are waiting.  With AES on the FIFO holds cipher text until the whole
+// frame is in, so nothing is drained early.
+void ServiceFIFO(tRadioHandle radio, U8 irqFlags2)
+{
+	U8 count;
+
+	switch (radio->Mode)
+	{
+		case kTransmitMode:
+			if (radio->TxRemaining && !(irqFlags2 & 0x20))
+			{
+				count = kFifoSize - kFifoThreshold - 1;
+				if (count > radio->TxRemaining)
+					count = radio->TxRemaining;
+				WriteCHARSPIMultiple(RegFifo, count, radio->TxPointer);
+				radio->TxPointer += count;
+				radio->TxRemaining -= count;
+			}
+			break;
+		case kListenMode:
+		case kReceiveMode:
+			if (!radio->AesEnabled && (irqFlags2 & 0x20) && !DrainFIFO(radio, kFifoThreshold))
+			{
+				ClearFIFO(radio);
+				NotifyRadioReceiveError(radio);
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+// Listen mode idle and RX times are a coefficient times one of three resolutions, in uSec
+const U32 _listenResolutions[3] = { 64, 4100, 262000 };
+
+// Finds the finest resolution that can express 'duration' uSec.  Returns the coefficient and puts the RegListen1 resolution
+// code (1-3) in 'resolution'.  Anything too long for the coarsest resolution is clamped to it.
+U8 ListenCoefficient(U32 duration, U8 *resolution)
+{
+	U32 coefficient;
+	U8 i;
+
+	for (i = 0; i < 3; i++)
+	{
+		coefficient = (duration + _listenResolutions[i] - 1) / _listenResolutions[i];
+		if (coefficient <= 0xFF)
+			break;
+	}
+	if (i == 3)
+	{
+		i = 2;
+		coefficient = 0xFF;
+	}
+	*resolution = i + 1;
+	return coefficient ? (U8)coefficient : 1;
+}
+
+// Programs the radio to sleep for 'period' mSec, then listen for kListenRxBits, over and over.  Nothing wakes the MCU until
+// RSSI is over the threshold and the sync word matches in the same window.  The radio then stays in RX until PayloadReady
+// or Timeout, after which it drops to standby and listen mode stops.
+void ConfigureListen(tRadioHandle radio, U16 period)
+{
+	U8 idleResolution, rxResolution, idle, rx;
+	U32 bitTime;
+
+	idle = ListenCoefficient((U32)period * 1000, &idleResolution);
+	// RegBitrate is Fxosc / bit rate, so a bit lasts RegBitrate / 32 uSec
+	bitTime = ((U32)radio->Registers[RegBitrateMsb] << 8) | radio->Registers[RegBitrateLsb];
+	rx = ListenCoefficient((kListenRxBits * bitTime + 31) / 32, &rxResolution);
+	// ListenCriteria = RSSI and SyncAddress, ListenEnd = stay in RX until PayloadReady or Timeout, then go to Mode
+	WriteRegister(radio, RegListen1, (idleResolution << 6) | (rxResolution << 4) | 0x08 | 0x02);
+	WriteRegister(radio, RegListen2, idle);
+	WriteRegister(radio, RegListen3, rx);
+	// no timeout before RSSI, but give up on a frame that matched the window and never completed
+	WriteRegister(radio, RegRxTimeout1, 0);
+	WriteRegister(radio, RegRxTimeout2, kRxTimeout);
+}
+
+// Listen mode has to be switched on from standby.  The listen request is queued behind standby and started from the
+// ModeReady interrupt once standby is reached.  With auto ACK on, the radio drops to FS mode rather than standby once a
+// frame is in, so the synthesizer is still locked when the ACK goes out.
+void StartListen(tRadioHandle radio)
+{
+	SetOpMode(radio, 0x04);
+	SetOpMode(radio, kListenOn | (radio->AutoAck ? 0x08 : 0x04));
+}
+
+void HandleTimeout(tRadioHandle radio)
+{
+	if (radio->ListenMode & 0x80)
+	{
+		radio->CurrentChannel++;
+
+		if (radio->CurrentChannel >= radio->ChannelCount
+		&&	radio->ListenMode == kContinuousScan
 			)
-			radioPrivateData.CurrentChannel = 0;
+			radio->CurrentChannel = 0;
 
 		// at this point, if we got to the end of the channels and we are in continuous scan mode, the channel will wrap to 0.
-		//  If the channel is FHSSCHANNELS, then we are in PeriodicScan mode and we need to stop the process here, put the radio
+		//  If the channel is ChannelCount, then we are in PeriodicScan mode and we need to stop the process here, put the radio
 		// to sleep, and indicate we are sleeping
-		if (radioPrivateData.CurrentChannel == FHSSCHANNELS)
+		if (radio->CurrentChannel == radio->ChannelCount)
 		{
 			// this ensures we start at the right channel next time
-			radioPrivateData.CurrentChannel = 0;
-			RadioSetChannel(radioPrivateData.CurrentChannel);
-			RadioSleepMode();
+			radio->CurrentChannel = 0;
+			RadioSetChannel(radio, radio->CurrentChannel);
+			RadioSleepMode(radio);
 		}
 		else
 		{
-			RadioStandbyMode();
+			RadioStandbyMode(radio);
 			// set the next channel
-			RadioSetChannel(radioPrivateData.CurrentChannel);
-			// put the radio in receive mode
-			WriteCHARSPI(RegOpMode, 0x10);
-			WaitForModeChange();
+			RadioSetChannel(radio, radio->CurrentChannel);
+			ClearFIFO(radio);
+			// put the radio in receive mode once standby is reached
+			SetOpMode(radio, 0x10);
 		}
 	}
+	else if (radio->ListenMode == kPeriodic)
+	{
+		// the listen window matched but no packet followed.  Listen mode stops when that happens, so start it again.
+		ClearFIFO(radio);
+		StartListen(radio);
+	}
 	else
+		RadioSleepMode(radio);
+}
+
+// *************************************************************************************************
+// Peer frequency offsets
+// A peer's offset is what AFC had to correct plus the correction the synthesizer already had, so it keeps converging while
+// the correction is in use.  AFC is cleared before every reception, so it only ever measures what is left over.
+// Only the receiver is corrected.  Frames and ACKs go out on the nominal channel frequency, because the peer measures its
+// offset against that; correcting both ends would apply the same offset twice.
+
+U8 FindPeerOffset(tRadioHandle radio, U8 *mac)
+{
+	U8 i, j;
+
+	for (i = 0; i < kPeerOffsetCount; i++)
 	{
-		// if we are in periodic mode, we don't scan.  Once we have the channel's timeout, we go to sleep for the rest of the period
-		RadioSleepMode();
+		if (!radio->PeerOffsets[i].Valid)
+			continue;
+		for (j = 0; j < 4; j++)
+			if (radio->PeerOffsets[i].MacAddress.U8[j] != mac[j])
+				break;
+		if (j == 4)
+			return i;
 	}
+	return kNoPeer;
 }
 
-void HandleReceivedPacket()
+// Folds the frequency error of a frame from 'mac' into its offset.  New peers replace the oldest entry.
+void UpdatePeerOffset(tRadioHandle radio, U8 *mac, S16 afc)
 {
-	U8 *sdu;
-	U8 length;
-	int i;
+	tPeerOffset *peer;
+	S16 measured;
+	U8 i;
+
+	measured = radio->TunedCorrection + afc;
+	i = FindPeerOffset(radio, mac);
+	if (i != kNoPeer)
+	{
+		// a quarter of the way to the new measurement, so one noisy frame cannot pull a settled offset far
+		peer = &radio->PeerOffsets[i];
+		peer->Offset += (measured - peer->Offset) / 4;
+		return;
+	}
+	peer = &radio->PeerOffsets[radio->NextPeerOffset];
+	radio->NextPeerOffset = (radio->NextPeerOffset + 1) % kPeerOffsetCount;
+	for (i = 0; i < 4; i++)
+		peer->MacAddress.U8[i] = mac[i];
+	peer->Offset = measured;
+	peer->Valid = 1;
+}
 
-	tPacketTypes packetType;
-	WriteCHARSPI(RegOpMode, 0x00);
-	WaitForModeChange();
+// Writes Frf for the current channel moved by 'correction', which like Frf is in 61Hz steps.  The register cache skips
+// the burst if the synthesizer is already there.
+void TuneChannel(tRadioHandle radio, S16 correction)
+{
+	const U8 *entry;
+	UU32 frf;
+	U8 row[3];
 
-	length = ReadCHARSPI(RegFifo);
-	if (length > 64)
-		NotifyRadioReceiveError();
+	radio->TunedCorrection = correction;
+	if (!radio->FhssStepSize && !correction)
+		WriteRegisters(radio, RegFrfMsb, 3, _frfTable[radio->BandPlan][radio->Channel]);
 	else
 	{
-		packetType = (tPacketTypes)ReadCHARSPI(RegFifo);
-
-		// The remaining bytes go in the buffer
-		if (length > 64)
-			NotifyRadioReceiveError();
+		if (radio->FhssStepSize)
+			// non default spacing: Fc = band base + channel * step
+			frf.U32 = FRF_REG(_bandBaseKHz[radio->BandPlan] + (U32)radio->Channel * radio->FhssStepSize);
 		else
 		{
-			for (i = 0; i < length; i++)
-				radioPrivateData.ReceiveBuffer[i] = ReadCHARSPI(RegFifo);
-			sdu = &(radioPrivateData.ReceiveBuffer[0]);
-			// Send it all to the next layer up.
-			NotifyRadioPacketReceived(packetType, length, sdu);
+			entry = _frfTable[radio->BandPlan][radio->Channel];
+			frf.U32 = ((U32)entry[0] << 16) | ((U32)entry[1] << 8) | entry[2];
+		}
+		frf.U32 += correction;
+		row[0] = frf.U8[2];
+		row[1] = frf.U8[1];
+		row[2] = frf.U8[0];
+		WriteRegisters(radio, RegFrfMsb, 3, row);
+	}
+	// one 3 byte burst, or nothing at all if we are already on this frequency
+	FlushRegisters(radio);
+}
+
+// *************************************************************************************************
+// Short addresses
+
+// Index of the ShortPeers entry for 'peer', kNoPeer if there is none
+U8 FindShortPeer(tRadioHandle radio, UU32 peer)
+{
+	U8 i;
+
+	for (i = 0; i < kShortPeerCount; i++)
+		if (radio->ShortPeers[i].ShortAddress != kNoShortAddress && radio->ShortPeers[i].MacAddress.U32 == peer.U32)
+			return i;
+	return kNoPeer;
+}
+
+// Puts the MAC of 'shortAddress' in 'peer'.  Returns zero if we do not know it.
+U8 ResolveShortAddress(tRadioHandle radio, U8 shortAddress, UU32 *peer)
+{
+	U8 i;
+
+	for (i = 0; i < kShortPeerCount; i++)
+		if (radio->ShortPeers[i].ShortAddress == shortAddress)
+		{
+			peer->U32 = radio->ShortPeers[i].MacAddress.U32;
+			return 1;
 		}
+	return 0;
+}
+
+// Non-zero if frames of 'packetType' carry a destination.  Multicasts, beacons and route requests are for everyone.
+U8 HasDestination(U8 packetType)
+{
+	return packetType != kMulticastPacketType && packetType != kBeaconPacketType && packetType != kRouteRequestPacketType;
+}
+
+// Non-zero if frames of 'packetType' are acknowledged, and so carry a sequence byte
+U8 IsAcknowledged(U8 packetType)
+{
+	return packetType == kUniAckPacketType || packetType == kMeshPacketType;
+}
+
+// Short address to send a frame of 'packetType' to 'peer' with, kNoShortAddress if it has to carry full MACs.  Multicasts
+// have no destination, so they only need our own short address, but every receiver has to be able to resolve it.  Nodes
+// only learn the coordinator's, so anyone else multicasts with its full MAC.
+U8 ShortDestination(tRadioHandle radio, tPacketTypes packetType, UU32 peer)
+{
+	U8 i;
+
+	if (radio->ShortAddress == kNoShortAddress || packetType > kAckPacketType)
+		return kNoShortAddress;
+	if (packetType == kMulticastPacketType)
+		return (radio->ShortAddress == kCoordinatorShortAddress) ? kMaxShortAddress + 1 : kNoShortAddress;
+	i = FindShortPeer(radio, peer);
+	return (i == kNoPeer) ? kNoShortAddress : radio->ShortPeers[i].ShortAddress;
+}
+
+// Counts a frame of 'packetType' going out with a short or a full header
+void CountHeader(tRadioHandle radio, tPacketTypes packetType, U8 shortHeader)
+{
+	tHeaderStatistics *statistics;
+
+	if (packetType > kAckPacketType)
+		return;
+	statistics = &radio->HeaderStatistics[packetType];
+	if (!shortHeader)
+	{
+		if (statistics->LongFrames < 0xFFFF)
+			statistics->LongFrames++;
+		return;
+	}
+	if (statistics->ShortFrames < 0xFFFF)
+		statistics->ShortFrames++;
+	// a byte lasts 8 * RegBitrate / 32 uSec.  Multicasts only save the source MAC, the others the destination MAC as well.
+	statistics->AirtimeSaved += ((packetType == kMulticastPacketType) ? 3 : 6)
+		* (((U32)radio->Registers[RegBitrateMsb] << 8) | radio->Registers[RegBitrateLsb]) / 4;
+}
+
+// Works out where a received frame is from and checks it is for us.  With address filtering on, the radio has already
+// dropped frames for other node addresses, so only frames whose node byte happens to match ours get this far.
+// packet points at the packet type.  Returns the header length from the packet type to the payload, zero if the frame is
+// not for us, is too short to carry its addresses, or is from a short address we cannot put a MAC to.
+U8 ParseHeader(tRadioHandle radio, U8 *packet, U8 length, UU32 *source)
+{
+	U8 header, i;
+
+	if (packet[0] & kShortHeaderFlag)
+	{
+		// [packettype][dest][src], with no destination in multicasts
+		header = ((packet[0] & kPacketTypeMask) == kMulticastPacketType) ? 2 : 3;
+		if (length < header)
+			return 0;
+		if (header == 3 && (radio->ShortAddress == kNoShortAddress || packet[1] != radio->ShortAddress))
+			return 0;
+		return ResolveShortAddress(radio, packet[header - 1], source) ? header : 0;
+	}
+	header = HasDestination(packet[0] & kPacketTypeMask) ? 9 : 5;
+	if (length < header)
+		return 0;
+	if (header == 9)
+		for (i = 0; i < 4; i++)
+			if (packet[1 + i] != radio->MacAddress.U8[i])
+				return 0;
+	for (i = 0; i < 4; i++)
+		source->U8[i] = packet[header - 4 + i];
+	return header;
+}
+
+// Writes the PA settings saved by RadioSetTxPower.  Receive mode needs the PA off, so they are put back before transmitting.
+void TurnPaOn(tRadioHandle radio)
+{
+	WriteRegister(radio, RegPaLevel, radio->TxPaLevel);
+	WriteRegister(radio, RegOcp, 0x0F);
+	WriteRegister(radio, RegTestPa1, 0x5D);
+	WriteRegister(radio, RegTestPa2, 0x7C);
+}
+
+// Builds the ACK for AckPeer: [len][node][packettype][destaddress][srcaddress], with the node byte only when address
+// filtering is on and short addresses when both ends have one.
+void BuildAckFrame(tRadioHandle radio)
+{
+	U8 length, i, destination;
+
+	length = 1;
+	if (radio->AddressFiltering)
+		radio->AckFrame[length++] = radio->AckPeer.U8[0];
+	destination = ShortDestination(radio, kAckPacketType, radio->AckPeer);
+	if (destination != kNoShortAddress)
+	{
+		radio->AckFrame[length++] = kAckPacketType | kShortHeaderFlag;
+		radio->AckFrame[length++] = destination;
+		radio->AckFrame[length++] = radio->ShortAddress;
+	}
+	else
+	{
+		radio->AckFrame[length++] = kAckPacketType;
+		for (i = 0; i < 4; i++)
+			radio->AckFrame[length++] = radio->AckPeer.U8[i];
+		for (i = 0; i < 4; i++)
+			radio->AckFrame[length++] = radio->MacAddress.U8[i];
+	}
+	radio->AckFrame[0] = length - 1;
+	radio->AckFrameLength = length;
+}
+
+// Sends the ACK for a UniAck frame from 'peer'.  The radio is already in FS mode.  AutoModes switches it to TX once the
+// whole ACK is in the FIFO and back to FS on PacketSent, so all the MCU does is restore the PA and load the FIFO.
+// 'start' is when PayloadReady was serviced, and the time from there to the ACK being loaded is recorded in bit times.
+void SendAck(tRadioHandle radio, UU32 peer, U32 start)
+{
+	tAckTurnaround *turnaround;
+	U32 elapsed;
+
+	if (peer.U32 != radio->AckPeer.U32)
+	{
+		// not the peer we built the ACK for, so it is now
+		radio->AckPeer.U32 = peer.U32;
+		BuildAckFrame(radio);
+	}
+	TurnPaOn(radio);
+	// the ACK goes out on the nominal frequency.  Frf is written in FS mode, so the PLL relocks while the FIFO loads.
+	if (radio->TunedCorrection)
+		TuneChannel(radio, 0);
+	// dio0 = PKTSENT.  The rest of the mapping is left alone because the radio will be back in FS mode before it matters.
+	WriteRegister(radio, RegDioMapping1, (ReadRegister(radio, RegDioMapping1) & 0x3F));
+	// FifoLevel rises when the FIFO holds more than AckFrameLength - 1 bytes, which is on the last byte of the burst below.
+	// Entering TX on FifoNotEmpty instead would start the ACK on its first byte, so a stalled burst could underrun the FIFO.
+	WriteRegister(radio, RegFifoThresh, (radio->AckFrameLength - 1) & 0x7F);
+	// EnterCondition = FifoLevel rising, ExitCondition = PacketSent, IntermediateMode = TX
+	WriteRegister(radio, RegAutoModes, 0x5B);
+	FlushRegisters(radio);
+	WriteCHARSPIMultiple(RegFifo, radio->AckFrameLength, radio->AckFrame);
+	radio->Mode = kTransmitMode;
+	CountHeader(radio, kAckPacketType, radio->AckFrame[radio->AddressFiltering + 1] & kShortHeaderFlag);
+
+	turnaround = &radio->AckTurnaround;
+	if (turnaround->Count < 0xFFFF)
+	{
+		elapsed = GetMicroseconds() - start;
+		if (elapsed > 0xFFFF)
+			elapsed = 0xFFFF;
+		// a bit lasts RegBitrate / 32 uSec, so this is in sixteenths of a bit
+		elapsed = (elapsed << 9) / (((U32)radio->Registers[RegBitrateMsb] << 8) | radio->Registers[RegBitrateLsb]);
+		if (elapsed > 0xFFFF)
+			elapsed = 0xFFFF;
+		if (turnaround->Count == 0 || elapsed < turnaround->Minimum)
+			turnaround->Minimum = (U16)elapsed;
+		if (elapsed > turnaround->Maximum)
+			turnaround->Maximum = (U16)elapsed;
+		turnaround->Count++;
+		turnaround->Total += elapsed;
 	}
-	// always leave with an empty FIFO
-	ClearFIFO();
 }
 
-void HopChannel()
+// Passes a received frame to the next layer up.  The radio goes to sleep first so a packet sent from the notification is
+// not overridden.
+void DeliverPacket(tRadioHandle radio, U8 *packet, U8 length, U8 header, UU32 source)
+{
+	RadioSleepMode(radio);
+	radio->FilterStatistics.Accepted++;
+	// The next layer up gets the packet type and sender, and the payload after the header.
+	NotifyRadioPacketReceived(radio, (tPacketTypes)(packet[0] & (kPacketTypeMask | kBlockAckFlag | kUpperLayerFlags)), source,
+		length - header, &packet[header], &radio->RxMetadata);
+}
+
+// How long 'bytes' take on the air at the current data rate, in uSec.  A byte lasts 8 * RegBitrate / 32 uSec.
+U32 ByteTimes(tRadioHandle radio, U16 bytes)
+{
+	return ((U32)bytes * ((((U32)radio->Registers[RegBitrateMsb] << 8) | radio->Registers[RegBitrateLsb]))) / 4;
+}
+
+// Bytes that follow the sync word of a frame whose length byte is 'length': the length byte itself, the frame and the CRC
+U16 BytesAfterSync(tRadioHandle radio, U16 length)
+{
+	return 1 + length + ((radio->Registers[RegPacketConfig1] & 0x10) ? 2 : 0);
+}
+
+// Fills RxMetadata for the frame that just raised PayloadReady.  AFC, FEI and RSSI sit next to each other, so they come out
+// in one burst, and this is done before the receiver is stopped so RSSI still belongs to the frame.
+void CaptureMetadata(tRadioHandle radio, U32 timestamp)
+{
+	U8 values[RegRssiValue - RegAfcFei + 1];
+
+	ReadCHARSPIMultiple(RegAfcFei, sizeof(values), values);
+	radio->RxMetadata.Timestamp = timestamp;
+	// the MSB goes through S8 so the sign survives on targets where S16 is wider than 16 bits
+	radio->RxMetadata.Afc = (S16)((S8)values[RegAfcMsb - RegAfcFei] * 256 + values[RegAfcLsb - RegAfcFei]);
+	radio->RxMetadata.Fei = (S16)((S8)values[RegFeiMsb - RegAfcFei] * 256 + values[RegFeiLsb - RegAfcFei]);
+	radio->RxMetadata.Rssi = values[RegRssiValue - RegAfcFei];
+	radio->RxMetadata.Channel = radio->Channel;
+}
+
+// Called from PacketSent once an ACK is out.  The acknowledged frame has waited in ReceiveBuffer so that nothing could load
+// the FIFO under the ACK.  AckedLength does not count the node address byte.
+void FinishAck(tRadioHandle radio)
+{
+	UU32 source;
+	U8 length, *packet;
+
+	length = radio->AckedLength;
+	radio->AckedLength = 0;
+	WriteRegister(radio, RegAutoModes, 0x00);
+	WriteRegister(radio, RegFifoThresh, 0x80 | kFifoThreshold);
+	// past the node address byte, if there is one.  The frame was checked before it was acknowledged.
+	packet = &radio->ReceiveBuffer[radio->AddressFiltering];
+	DeliverPacket(radio, packet, length, ParseHeader(radio, packet, length, &source), source);
+}
+
+// Reads out a frame on PayloadReady, then acknowledges it, passes it up, or drops it and goes back to listening.
+void HandleReceivedPacket(tRadioHandle radio)
 {
-	//return;
-	if (radioPrivateData.HopTable>5)
+	U8 valid, length, header, *packet;
+	UU32 source;
+	U32 start;
+
+	start = GetMicroseconds();
+	CaptureMetadata(radio, start);
+	// The FIFO stays readable while the sequencer takes the radio to sleep, so there is no need to wait for ModeReady here.
+	// With auto ACK on, FS mode keeps the synthesizer locked for the ACK instead.
+	SetOpMode(radio, radio->AutoAck ? 0x08 : 0x00);
+
+	// Whatever was not drained while the frame was arriving (all of it, if the frame fit in the FIFO) comes out in one burst.
+	valid = DrainFIFO(radio, kFifoSize);
+	length = radio->RxLength;
+	// PayloadReady comes once the CRC is in, so without a SyncAddress edge the sync word is put that far back
+	radio->RxMetadata.SyncTimestamp = radio->SyncSeen ? radio->SyncTimestamp
+		: start - ByteTimes(radio, BytesAfterSync(radio, length));
+	radio->SyncSeen = 0;
+	// always leave with an empty FIFO.  This is done before notifying so the next layer up is free to load the FIFO again.
+	ClearFIFO(radio);
+	if (!valid)
+	{
+		RadioSleepMode(radio);
+		NotifyRadioReceiveError(radio);
+		return;
+	}
+	// skip the node address byte the radio filtered on
+	packet = radio->ReceiveBuffer;
+	if (radio->AddressFiltering)
+	{
+		packet++;
+		length--;
+	}
+	header = length ? ParseHeader(radio, packet, length, &source) : 0;
+	if (!header)
+	{
+		radio->FilterStatistics.Rejected++;
+		// not for us, so go straight back to listening the way we were asked to
+		RadioReceivePacket(radio, radio->ListenMode, radio->ListenPeriod);
+		return;
+	}
+	UpdatePeerOffset(radio, source.U8, radio->RxMetadata.Afc);
+	// block ACK frames are left to the next layer up
+	if (radio->AutoAck && !(packet[0] & kBlockAckFlag) && IsAcknowledged(packet[0] & kPacketTypeMask))
 	{
-		radioPrivateData.HopIndex++;
-		if (radioPrivateData.HopIndex > 50)
-			radioPrivateData.HopIndex = 0;
-		RadioSetChannel(_hopTable50[radioPrivateData.HopTable][radioPrivateData.HopIndex]);
+		radio->AckedLength = length;
+		SendAck(radio, source, start);
 	}
 	else
+		DeliverPacket(radio, packet, length, header, source);
+}
+
+// *************************************************************************************************
+// Hop sequence generator
+// Each network hops through (HopBase + i * HopStride) mod ChannelCount.  A stride that is coprime to the channel count
+// visits every channel exactly once per cycle, and consecutive channels are always the stride apart.  Every cycle starts
+// HopShift further on, so the step across a cycle boundary is HopShift + HopStride, which is chosen to respect the
+// minimum hop distance too.  Two networks with different strides collide on at most gcd(stride difference, ChannelCount)
+// channels per cycle.
+
+U8 Gcd(U8 a, U8 b)
+{
+	U8 t;
+
+	while (b)
 	{
-		radioPrivateData.HopIndex++;
-		if (radioPrivateData.HopIndex > 25)
-			radioPrivateData.HopIndex = 0;
-		RadioSetChannel(_hopTable25[radioPrivateData.HopTable][radioPrivateData.HopIndex]);
+		t = a % b;
+		a = b;
+		b = t;
 	}
+	return a;
+}
+
+// Spacing, in channels, of a step of 'step' channels once the sequence wraps around the band
+U8 HopDistance(tRadioHandle radio, U8 step)
+{
+	return (step > radio->ChannelCount - step) ? radio->ChannelCount - step : step;
+}
+
+// Spreads NetworkId and the hop table selector over all 32 bits so that nearby ids get unrelated sequences
+U32 HopSeed(UU32 networkId, U8 hopTable)
+{
+	U32 seed;
+
+	seed = networkId.U32 ^ ((U32)hopTable << 24) ^ hopTable;
+	seed = ((seed >> 16) ^ seed) * 0x45D9F3BUL;
+	seed = ((seed >> 16) ^ seed) * 0x45D9F3BUL;
+	return ((seed >> 16) ^ seed) & 0xFFFFFFFFUL;
+}
+
+// Works out the hop sequence for a network and puts it at the start of its first cycle.  Only run at initialization, so
+// the searches here do not affect the cost of a hop.
+void InitializeHopSequence(tRadioHandle radio, UU32 networkId, U8 hopTable)
+{
+	U32 seed;
+	U8 count, distance, start, step, i;
+
+	seed = HopSeed(networkId, hopTable);
+	count = radio->ChannelCount;
+	// Small channel counts may not have a stride that far apart, so settle for the widest spacing that exists.  A stride of
+	// one always works, which ends the search.
+	distance = (kMinHopDistance < count / 2) ? kMinHopDistance : count / 2;
+	start = seed % count;
+	for (;;)
+	{
+		for (i = 0; i < count; i++)
+		{
+			step = (start + i) % count;
+			if (Gcd(step, count) == 1 && HopDistance(radio, step) >= distance)
+				break;
+		}
+		if (i < count)
+			break;
+		distance--;
+	}
+	radio->HopStride = step;
+	// any boundary step at least as far apart as the stride will do.  The stride itself qualifies, so this always ends.
+	start = (seed >> 8) % count;
+	for (i = 0; i < count; i++)
+	{
+		step = (start + i) % count;
+		if (HopDistance(radio, step) >= distance)
+			break;
+	}
+	radio->HopShift = (step + count - radio->HopStride) % count;
+	radio->HopBase = (seed >> 16) % count;
+	radio->HopPosition = 0;
+	radio->HopChannel = radio->HopBase;
+}
+
+// Channel of the hop after the current one
+U8 NextHopChannel(tRadioHandle radio)
+{
+	U8 channel;
+
+	if (radio->HopPosition + 1 >= radio->ChannelCount)
+		channel = radio->HopBase + radio->HopShift;
+	else
+		channel = radio->HopChannel + radio->HopStride;
+	// both terms are below ChannelCount, so one subtraction is enough
+	if (channel >= radio->ChannelCount)
+		channel -= radio->ChannelCount;
+	return channel;
+}
+
+// If the radio was parked in FS mode on the next channel, the Frf writes are skipped by the register cache and the PLL is
+// already locked.
+void HopChannel(tRadioHandle radio)
+{
+	radio->HopChannel = NextHopChannel(radio);
+	if (++radio->HopPosition >= radio->ChannelCount)
+	{
+		radio->HopPosition = 0;
+		radio->HopBase = radio->HopChannel;
+	}
+	RadioSetChannel(radio, radio->HopChannel);
+}
+
+// Called once a packet has gone out.  Either sleeps, or parks the synthesizer on the next hop channel so that PLL lock time
+// overlaps whatever happens before the next frame.
+void ParkAfterTransmit(tRadioHandle radio)
+{
+	if (radio->FSPretune)
+	{
+		RadioSetChannel(radio, NextHopChannel(radio));
+		SetOpMode(radio, 0x08);
+		radio->Mode = kFSMode;
+	}
+	else
+		RadioSleepMode(radio);
+}
+
+// *************************************************************************************************
+// RSSI sampler
+// Measurements are started and collected from the 1mSec tick, one SPI access at a time, so nothing spins waiting for
+// RssiDone and interrupts are never masked for longer than a register access.  RSSI is only valid in RX mode, so ticks in
+// any other mode are skipped.
+
+// Tunes the scan to the next channel.  The receiver has to be restarted to settle on the new frequency.
+void ScanNextChannel(tRadioHandle radio)
+{
+	RadioSetChannel(radio, radio->ScanChannel);
+	WriteCHARSPI(RegPacketConfig2, radio->Registers[RegPacketConfig2] | 0x04);
+	// the first reading after a restart is thrown away
+	radio->ScanCount = 0;
+}
+
+// Records a finished measurement
+void StoreRssi(tRadioHandle radio, U8 rssi)
+{
+	U8 channel;
+
+	radio->LastRssi = rssi;
+	channel = radio->ScanChannel;
+	if (channel != kNoScan)
+	{
+		// larger values are weaker signals, so the floor is the largest reading
+		if (radio->ScanCount
+		&&	(radio->ScanCount == 1 || rssi > radio->NoiseFloor[channel])
+			)
+			radio->NoiseFloor[channel] = rssi;
+		if (radio->ScanCount++ < radio->ScanSamples)
+			return;
+		if (++radio->ScanChannel < FHSSCHANNELS)
+			ScanNextChannel(radio);
+		else
+		{
+			radio->ScanChannel = kNoScan;
+			WriteRegister(radio, RegRxTimeout2, kRxTimeout);
+			RadioSetChannel(radio, radio->HopChannel);
+			RadioSleepMode(radio);
+		}
+		return;
+	}
+	radio->RssiSamples[(radio->RssiHead + radio->RssiCount) % kRssiSampleCount] = rssi;
+	if (radio->RssiCount < kRssiSampleCount)
+		radio->RssiCount++;
+	else
+		// full, so the oldest sample makes way
+		radio->RssiHead = (radio->RssiHead + 1) % kRssiSampleCount;
+}
+
+// Called from the 1mSec tick
+void SampleRssi(tRadioHandle radio)
+{
+	if (radio->ScanChannel == kNoScan)
+	{
+		if (!radio->RssiInterval && !radio->CcaRequested)
+			return;
+		if (!radio->RssiPending && !radio->CcaRequested && ++radio->RssiTimer < radio->RssiInterval)
+			return;
+	}
+	if (radio->OpMode != 0x10 || radio->PendingOpMode != kNoOpMode)
+	{
+		radio->RssiPending = 0;
+		return;
+	}
+	if (radio->RssiPending)
+	{
+		if (!(ReadRegister(radio, RegRssiConfig) & 0x02))
+			return;
+		radio->RssiPending = 0;
+		radio->RssiTimer = 0;
+		StoreRssi(radio, ReadRegister(radio, RegRssiValue));
+		if (radio->CcaRequested)
+		{
+			radio->CcaRequested = 0;
+			radio->CcaReady = 1;
+		}
+		if (radio->ScanChannel == kNoScan)
+			return;
+	}
+	// RssiStart
+	WriteRegister(radio, RegRssiConfig, 0x01);
+	radio->RssiPending = 1;
 }
 
 // ***********************************************************************************
@@ -156,97 +1277,167 @@ void HopChannel()
 // when an interrupt happens. These execute in the ISR context.
 // Use normal programming precautions.
 
-// called by microcontroller for io based interrupts
-
-void HandleInterrupt(U8 intType)
+// Services DIOn of one radio
+void ServiceInterrupt(tRadioHandle radio, U8 intType)
 {
 	U8 idata isr1;
 	U8 idata isr2;
+	U32 now;
 
 	// Tx-> PktSent
 	// Rx-> CrcOk
 
 	if (intType == kInterruptP0)
 	{
-		isr1 = ReadCHARSPI(RegIrqFlags1);
-		isr2 = ReadCHARSPI(RegIrqFlags2);
+		now = GetMicroseconds();
+		isr1 = ReadRegister(radio, RegIrqFlags1);
+		isr2 = ReadRegister(radio, RegIrqFlags2);
 
-		switch (radioPrivateData.Mode)
+		switch (radio->Mode)
 		{
 			case kListenMode:
 			case kReceiveMode:
 
 				if (isr2 & 0x04)
 				{
-					HandleReceivedPacket();
-					RadioSleepMode();
+					HandleReceivedPacket(radio);
 				}
 				else // if (isr1 & EZRADIOPRO_ICRCERROR)
-					NotifyRadioReceiveError();
+					NotifyRadioReceiveError(radio);
 				break;
 			case kTransmitMode:
-				// process "packet sent" interrupt
-				if (isr2 & 0x08)
+				// the frame an ACK was for goes up whether or not the ACK made it.  A lost ACK is for the peer to retry.
+				if (radio->AckedLength)
+					FinishAck(radio);
+				// process "packet sent" interrupt.  Bytes still waiting to be streamed mean the FIFO ran dry and the frame went
+				// out short.
+				else if ((isr2 & 0x08) && !radio->TxRemaining)
 				{
-					NotifyRadioPacketSent();
-					RadioSleepMode();
+					// the length byte, the frame and the CRC went out after the sync word
+					radio->TxTimestamp = now - ByteTimes(radio, BytesAfterSync(radio, radio->TxFrameLength));
+					// park first so that a packet sent from the notification is not overridden
+					ParkAfterTransmit(radio);
+					NotifyRadioPacketSent(radio);
 				}
 				else
-					NotifyRadioPacketSendError();
+				{
+					radio->TxRemaining = 0;
+					NotifyRadioPacketSendError(radio);
+				}
 				break;
 			default:
 				break;
 		}
 	}
+	else if (intType == intSYNCADDR)
+	{
+		// the sync word has just been matched.  Nothing else is read, so the time is as close to the edge as it gets.
+		if (radio->Mode == kReceiveMode || radio->Mode == kListenMode)
+		{
+			radio->SyncTimestamp = GetMicroseconds();
+			radio->SyncSeen = 1;
+		}
+	}
+	else if (intType == intMODERDY)
+	{
+		// ignore a stale edge from a transition that has already been completed by polling
+		if (IsModeReady())
+			CompleteOpMode(radio, 0);
+	}
 	else if (intType == kInterruptP1)
 	{
-		isr1 = ReadCHARSPI(RegIrqFlags1);
-		isr2 = ReadCHARSPI(RegIrqFlags2);
+		radio->Timers[kFifoTimer] = 0;
+		isr1 = ReadRegister(radio, RegIrqFlags1);
+		isr2 = ReadRegister(radio, RegIrqFlags2);
 
 		// TODO: We should never get here in TxMode or in RxMode where the Timeout bit isn't set in ISR1.
 		// Therefore, we need to handle those exceptions here
-		switch (radioPrivateData.Mode)
+		switch (radio->Mode)
 		{
 			case kListenMode:
 			case kReceiveMode:
+				ServiceFIFO(radio, isr2);
 				if (isr1 & 0x04)
-					HandleTimeout();
+					HandleTimeout(radio);
+				break;
+			case kTransmitMode:
+				ServiceFIFO(radio, isr2);
 				break;
-			// case kTransmitMode:
 			default:
 				break;
 		}
 	}
 }
 
-void StateMachine()
+// Does what a radio without DIO interrupts would have been interrupted for
+void PollRadio(tRadioHandle radio)
 {
-	switch (radioPrivateData.Mode)
+	U8 isr2;
+
+	switch (radio->Mode)
 	{
+		case kListenMode:
 		case kReceiveMode:
-			if (radioPrivateData.ListenMode >= kPeriodic)
-			{
-				// if we are in a periodic listen mode, we need to monitor the listen timer
-				if (radioPrivateData.Timers[kListenTimer] > radioPrivateData.ListenPeriod)
-				{
-					radioPrivateData.Timers[kListenTimer] = 0;
-					// we have slept long enough, start the process over again
-					WriteCHARSPI(RegOpMode, 0x10);
-				}
-			}
+			isr2 = ReadCHARSPI(RegIrqFlags2);
+			// PayloadReady, otherwise drain the FIFO and check for a timeout
+			ServiceInterrupt(radio, (isr2 & 0x04) ? kInterruptP0 : kInterruptP1);
+			break;
+		case kTransmitMode:
+			isr2 = ReadCHARSPI(RegIrqFlags2);
+			// PacketSent, otherwise top up the FIFO
+			ServiceInterrupt(radio, (isr2 & 0x08) ? kInterruptP0 : kInterruptP1);
 			break;
 		default:
 			break;
 	}
 }
 
+// One radio's share of the 1mSec tick
+void ServiceTick(tRadioHandle radio)
+{
+	int i;
+	for (i = 0; i < MAXTIMERS; i++)
+		radio->Timers[i]++;
+	// safety net in case a ModeReady edge was missed or never comes
+	if (radio->PendingOpMode != kNoOpMode && radio->Timers[kModeTimer] > 1)
+	{
+		if (IsModeReady())
+			CompleteOpMode(radio, 0);
+		else if (radio->Timers[kModeTimer] > kModeChangeTimeoutMs)
+			CompleteOpMode(radio, 1);
+	}
+	if (!radio->Bus->EnableIrq)
+		PollRadio(radio);
+	// safety net for a streamed frame in case a FifoLevel edge was missed.  A receiver only costs the SPI reads once no edge
+	// has come for FifoPollInterval, which is what a missed one looks like.
+	else if ((radio->Mode == kTransmitMode && radio->TxRemaining)
+	||	(	(radio->Mode == kReceiveMode || radio->Mode == kListenMode) && !radio->AesEnabled
+		&&	radio->Timers[kFifoTimer] > radio->FifoPollInterval
+		)
+		)
+		ServiceInterrupt(radio, kInterruptP1);
+	SampleRssi(radio);
+}
+
+// called by microcontroller for io based interrupts
+void HandleInterrupt(U8 intType)
+{
+	tRadioHandle radio;
+
+	radio = &_radios[(intType & kInterruptRadio2) ? 1 : 0];
+	// an interrupt can fire before its radio has been initialized
+	if (radio->Bus)
+		ServiceInterrupt(radio, intType & ~kInterruptRadio2);
+}
+
 // called by microcontroller every 1mSec.  Timeouts should be tied to this
 void Handle1MsInterrupt()
 {
-	int i;
-	for (i = 0; i < MAXTIMERS; i++)
-		radioPrivateData.Timers[i]++;
-	StateMachine();
+	U8 i;
+
+	for (i = 0; i < kRadioCount; i++)
+		if (_radios[i].Bus)
+			ServiceTick(&_radios[i]);
 	NotifyRadio1MilliSecond();
 }
 
@@ -258,569 +1449,389 @@ void Handle1SecInterrupt()
 
 // ***********************************************************************************
 // *** Internal Functions ***
-void ClearTimer(U8 timer)
+void ClearTimer(tRadioHandle radio, U8 timer)
 {
 	DisableInterrupts;
-	radioPrivateData.Timers[timer] = 0;
+	radio->Timers[timer] = 0;
 	EnableInterrupts;
 }
 
 // ***********************************************************************************
 // *** Public API ***
 
-U8 RadioInitialize(tRadioInitialization ini)
+tRadioHandle RadioInitialize(tRadioInitialization ini)
 {
+	tRadioHandle radio;
 	U8 i;
-	ResetRadio();
-	// force the hop channel to wrap to zero on next hop so we start on zero
-	radioPrivateData.HopIndex = 100;
-	radioPrivateData.Mode = kSleepMode;
-	radioPrivateData.MacAddress.U32 = ini.MacAddress.U32;
-	radioPrivateData.HopTable = ini.HopTable;
-	radioPrivateData.GfskEnabled = ini.GausianEnabled;
+
+	if (ini.Radio >= kRadioCount || !ini.Bus)
+		return 0;
+	radio = &_radios[ini.Radio];
+	radio->Bus = ini.Bus;
+	if (radio->Bus->Reset)
+		radio->Bus->Reset();
+	// the radio may have been reset (or never configured), so the shadow copy has to start from what is really there
+	LoadRegisters(radio);
+	radio->Mode = kSleepMode;
+	radio->MacAddress.U32 = ini.MacAddress.U32;
+	radio->ChannelCount = (ini.ChannelCount && ini.ChannelCount < FHSSCHANNELS) ? ini.ChannelCount : FHSSCHANNELS;
+	InitializeHopSequence(radio, ini.NetworkId, ini.HopTable);
+	radio->BandPlan = ini.BandPlan > kBand433 ? kBand915 : ini.BandPlan;
+	radio->FhssStepSize = ini.FhssStepSize;
+	radio->FSPretune = 0;
+	radio->GfskEnabled = ini.GausianEnabled;
+	radio->AesEnabled = 1;
+	radio->AddressFiltering = 0;
+	radio->AutoAck = 0;
+	radio->AckedLength = 0;
+	radio->TxPaLevel = 0;
+	radio->RssiInterval = 0;
+	radio->RssiPending = 0;
+	radio->CcaRequested = 0;
+	radio->CcaReady = 0;
+	radio->RssiCount = 0;
+	radio->ScanChannel = kNoScan;
+	radio->FrequencyCorrection = 0;
+	radio->TunedCorrection = 0;
+	radio->NextPeerOffset = 0;
+	radio->ShortAddress = kNoShortAddress;
+	for (i = 0; i < kShortPeerCount; i++)
+		radio->ShortPeers[i].ShortAddress = kNoShortAddress;
+	RadioClearHeaderStatistics(radio);
+	radio->DataRate = &_dataRateTable[0][k9600BPS];
+	// every tick until RadioSetDataRate says how fast the FIFO fills
+	radio->FifoPollInterval = 0;
+	for (i = 0; i < kPeerOffsetCount; i++)
+		radio->PeerOffsets[i].Valid = 0;
+	radio->TxRemaining = 0;
+	// we don't know what mode the radio is in, so the first mode change always goes out
+	radio->OpMode = kNoOpMode;
+	radio->PendingOpMode = kNoOpMode;
+	radio->QueuedOpMode = kNoOpMode;
+	EnableIrq(radio, 5, 1);
 
 	// Radio starts in sleep mode
-	WriteCHARSPI(RegOpMode, 0x00);
+	SetOpMode(radio, 0x00);
 	if (ini.GausianEnabled)
 	{
 		// Packet mode, FSK modulation, Gausian Filter Bt=0.5
-		WriteCHARSPI(RegDataModul, 0x02);		// Set AfcLowBetaOn = 1;
-		WriteCHARSPI(RegAfcCtrl, 0x20);
+		WriteRegister(radio, RegDataModul, 0x02);		// Set AfcLowBetaOn = 1;
+		WriteRegister(radio, RegAfcCtrl, 0x20);
 	}
 	else
 	{
 		// Packet mode, FSK modulation, no shaping
-		WriteCHARSPI(RegDataModul, 0x00);
+		WriteRegister(radio, RegDataModul, 0x00);
 		// Normal AFC
-		WriteCHARSPI(RegAfcCtrl, 0x00);
+		WriteRegister(radio, RegAfcCtrl, 0x00);
 	}
-	// this will hop to hop index 0, the start of the hopping sequence
-	HopChannel();
+	// start on the first channel of the hop sequence
+	RadioSetChannel(radio, radio->HopChannel);
 
 	// Lowest power level, all PA off
-	WriteCHARSPI(RegPaLevel, 0);
+	WriteRegister(radio, RegPaLevel, 0);
 	// LNA is 50 ohms and manually set to highest gain
-	WriteCHARSPI(RegLna, 0x00);
-	// AfcAutoClear is off, and Afc automatically runs when module switches to RX mode
-	WriteCHARSPI(RegAfcFei, 0x04);
+	WriteRegister(radio, RegLna, 0x00);
+	// AfcAutoClear is on, so AFC only measures what the peer frequency correction leaves, and Afc automatically runs when
+	// module switches to RX mode
+	WriteRegister(radio, RegAfcFei, 0x0C);
 
 	// Setup DIO pins for receive mode
 	// dio0 = PAYLOADRDY, dio1 = TIMEOUT, dio2=FIFONE, dio3=RSSI, dio4=RXRDY, dio5=MODERDY, CLKOUT = off
-	WriteCHARSPI(RegDioMapping1, 0x71);
-	WriteCHARSPI(RegDioMapping2, 0x87);
+	WriteRegister(radio, RegDioMapping1, 0x71);
+	WriteRegister(radio, RegDioMapping2, 0xB7);
 
 	// Set RSSI threshold to -110dBm.  Reception and AFC are triggered from this level.  Nothing happens until RSSI exceeds it.
-	WriteCHARSPI(RegRssiThresh, 0xDE);
-	// Set the RSSI Threshold timeout to 80 byte times.  This accounts for a packet of 4 preamble, 4 sync, 64 payload, and 2 CRC bytes plus a 4 byte buffer
+	WriteRegister(radio, RegRssiThresh, 0xDE);
+	// Set the RSSI Threshold timeout to kRxTimeout, long enough for the largest frame (see above).
 	// This is needed because the radio will hang if it triggers on a false positive of RSSI threshold and no packet is received.  Since it won't automatically restart the cycle
-	// and re-enter the RSSI phase, it never generates a PayloadReady interrupt.  With this timeout value programmed, the radio will let us know when 80 byte times have expired
-	// since a valid RSSI with no corresponding packet.  We will check this in our OpenRF loop to catch the problem and reset the receiver portion of the radio.
-	WriteCHARSPI(RegRxTimeout2, 0x40);
+	// and re-enter the RSSI phase, it never generates a PayloadReady interrupt.  With this timeout value programmed, the radio will let us know when the largest frame
+	// would have been in since a valid RSSI with no corresponding packet.  We catch that in HandleTimeout and reset the receiver portion of the radio.
+	WriteRegister(radio, RegRxTimeout2, kRxTimeout);
 	// initialize the AES key
 	for (i = 0x3E; i <= 0x4D; i++)
-		WriteCHARSPI(i, 0x55);
+		WriteRegister(radio, i, 0x55);
 
 	// set the mode to idle with the sequencer on
-	WriteCHARSPI(RegOpMode, 0x00);
-	WriteCHARSPI(RegAutoModes, 0x00);
+	SetOpMode(radio, 0x00);
+	WriteRegister(radio, RegAutoModes, 0x00);
 	// Preamble count is 24
-	WriteCHARSPI(RegPreambleMsb, 0x00);
-	WriteCHARSPI(RegPreambleLsb, 0x18);
+	WriteRegister(radio, RegPreambleMsb, 0x00);
+	WriteRegister(radio, RegPreambleLsb, 0x18);
 
-	// Config: sync on,FIFO fill on syncaddr interrupt, sync size=8, synctol = 0
-	WriteCHARSPI(RegSyncConfig, 0x98);
+	// Config: sync on,FIFO fill on syncaddr interrupt, sync size=4, synctol = 0
+	WriteRegister(radio, RegSyncConfig, 0x98);
 
 	// variable length packet, data whitening, crc on, crc autoclear is on, no address filtering
-	WriteCHARSPI(RegPacketConfig1, 0xd0);
+	WriteRegister(radio, RegPacketConfig1, 0xd0);
 
-	// Maximum receive packet length is 48
-	WriteCHARSPI(RegPayloadLength, 0x30);
+	// Accept any length byte.  Frames that do not fit in the FIFO are streamed, and RadioSendPacket enforces the AES limit.
+	WriteRegister(radio, RegPayloadLength, kMaxFrameLength);
+	// FIFO level interrupt used for streaming.  TX starts as soon as there is something in the FIFO.
+	WriteRegister(radio, RegFifoThresh, 0x80 | kFifoThreshold);
 
 	// interpacketRxDelay = 0, autorxrestarton = off, aes = on
-	WriteCHARSPI(RegPacketConfig2, 0x01);
+	WriteRegister(radio, RegPacketConfig2, 0x01);
 
-	WriteCHARSPI(RegTestDagc, 0x00);
-	ClearFIFO();
-	WriteCHARSPI(RegSyncValue1, ini.NetworkId.U8[3]);
-	WriteCHARSPI(RegSyncValue1, ini.NetworkId.U8[2]);
-	WriteCHARSPI(RegSyncValue1, ini.NetworkId.U8[1]);
-	WriteCHARSPI(RegSyncValue1, ini.NetworkId.U8[0]);
-	return WaitForModeChange();
+	WriteRegister(radio, RegTestDagc, 0x00);
+	ClearFIFO(radio);
+	// sync word is the network id
+	RadioSetSyncCode(radio, ini.NetworkId);
+	return WaitForModeChange(radio) ? radio : 0;
 }
 
 
 // Packet types (data length in bits)
 //
-// UniAck/UniNoAck - [len:8][packettype:8][destaddress:32][srcaddress:32][payload:len*8]
+// UniAck - [len:8][packettype:8][destaddress:32][srcaddress:32][sequence:8][payload:len*8]
+// UniNoAck - [len:8][packettype:8][destaddress:32][srcaddress:32][payload:len*8]
 // Multicast - [len:8][packettype:8][srcaddress:32][payload:len*8]
 // Ack - [len:8][packettype:8][destaddress:32][srcaddress:32]
+// Associate - [len:8][packettype:8][destaddress:32][srcaddress:32][payload:len*8]
+// Beacon - [len:8][packettype:8][srcaddress:32][payload:len*8]
+//
+// With address filtering on, every frame has a [node:8] byte between the length and the packet type.  It is the first byte
+// of the destination MAC, or kBroadcastNodeAddress for multicasts and beacons.
+//
+// Once we have a short address, frames to a peer whose short address we know carry one byte addresses instead, and the
+// packet type has kShortHeaderFlag set:
+//
+// UniAck - [len:8][packettype:8][dest:8][src:8][sequence:8][payload:len*8]
+// UniNoAck - [len:8][packettype:8][dest:8][src:8][payload:len*8]
+// Multicast - [len:8][packettype:8][src:8][payload:len*8]
+// Ack - [len:8][packettype:8][dest:8][src:8]
+//
+// UniAck frames with kBlockAckFlag set carry [sequence:8][base:8] after the addresses, and ACKs with it set carry a payload.
+// kAggregateFlag and kFragmentFlag are passed through untouched.
 
-U8 RadioSendPacket(UU32 destAddress, tPacketTypes packetType, U8 length, U8 *txBuffer, U16 preambleCount, U8 blocking)
+U8 RadioSendPacket(tRadioHandle radio, UU32 destAddress, tPacketTypes packetType, U8 length, U8 *txBuffer, U16 preambleCount, U8 blocking)
 {
-	U8 sduLength, i, hopping;
+	U8 header[kMaxHeaderLength];
+	U8 headerLength, i, hopping, first, destination, blockAck, upperFlags;
+	U16 frameLength;
 	UU16 uu16;
 
 	// if the MSB of packetType is set, we are supposed to hop
 	hopping = packetType & 0x80;
-	// only look at the lower 7 bits to get the actual packet type
-	packetType &= 0x7F;
+	blockAck = packetType & kBlockAckFlag;
+	upperFlags = packetType & kUpperLayerFlags;
+	// only look at the lower bits to get the actual packet type
+	packetType &= kPacketTypeMask;
+
+	// Assemble the header in one contiguous buffer so it goes into the FIFO in a single SPI transaction.
+	// header[0] is the length byte and is filled in once we know how big the header is.
+	headerLength = 1;
+	if (radio->AddressFiltering)
+		header[headerLength++] = HasDestination(packetType) ? destAddress.U8[0] : kBroadcastNodeAddress;
+	destination = ShortDestination(radio, packetType, destAddress);
+	if (destination != kNoShortAddress)
+	{
+		header[headerLength++] = packetType | blockAck | upperFlags | kShortHeaderFlag;
+		if (HasDestination(packetType))
+			header[headerLength++] = destination;
+		header[headerLength++] = radio->ShortAddress;
+	}
+	else
+	{
+		header[headerLength++] = packetType | blockAck | upperFlags;
+		if (HasDestination(packetType))
+		{
+			// Write the destination MAC
+			for (i = 0; i < 4; i++)
+				header[headerLength++] = destAddress.U8[i];
+		}
+		// Write the sender MAC
+		for (i = 0; i < 4; i++)
+			header[headerLength++] = radio->MacAddress.U8[i];
+	}
+	if (IsAcknowledged(packetType))
+	{
+		header[headerLength++] = radio->TxSequence[0];
+		if (blockAck)
+			header[headerLength++] = radio->TxSequence[1];
+	}
+	// only block ACKs carry a payload
+	if (packetType == kAckPacketType && !blockAck)
+		length = 0;
+	// the length byte does not count itself
+	frameLength = headerLength - 1 + length;
+	if (frameLength > RadioGetMaxFrameLength(radio))
+		return 0;
+	header[0] = (U8)frameLength;
+	radio->TxFrameLength = header[0];
+	CountHeader(radio, packetType, destination != kNoShortAddress);
 
-	sduLength = length;
 	// Setup DIO pins for transmit  mode
 	// dio0 = PKTSENT, dio1 = FIFOLVL, dio2=FIFONE, dio3=PLLLOCK, dio4=TXRDY, dio5=MODERDY, CLKOUT = off
-	WriteCHARSPI(RegDioMapping1, 0x03);
-	WriteCHARSPI(RegDioMapping2, 0x47);
+	WriteRegister(radio, RegDioMapping1, 0x03);
+	WriteRegister(radio, RegDioMapping2, 0x77);
 
 	if (hopping)
-		HopChannel();
+		HopChannel(radio);
+	// the peer corrects its receiver for us, so frames go out on the nominal frequency
+	if (radio->TunedCorrection)
+		TuneChannel(radio, 0);
 
 	// don't touch the FIFO unless we are sure we are in a IDLE mode
-	while ((ReadCHARSPI(RegIrqFlags1) & 0x80) == 0)
-		ReadRegs();
-
-	if (packetType == kUniAckPacketType || packetType == kUniNoAckPacketType)
-	{
-		// NOTE: This must be set to TX start on threshold or else the packet send does not work.  That is the purpose of the 0x7F mask
-		WriteCHARSPI(RegFifoThresh, ((length + 9) & 0x7F));
-		// the first byte must be the length of the packet, but the length count should not include this count.  So we add 5 to account for overhead instead of 6.
-		WriteCHARSPI(RegFifo, length + 9);
-		// tx start = 0, fifothreshold = length
-		// Write the packetType to the first byte in the FIFO
-		WriteCHARSPI(RegFifo, packetType);
-		// Write the destination MAC
-		WriteCHARSPI(RegFifo, destAddress.U8[0]);
-		WriteCHARSPI(RegFifo, destAddress.U8[1]);
-		WriteCHARSPI(RegFifo, destAddress.U8[2]);
-		WriteCHARSPI(RegFifo, destAddress.U8[3]);
-		// Write the sender MAC
-		WriteCHARSPI(RegFifo, radioPrivateData.MacAddress.U8[0]);
-		WriteCHARSPI(RegFifo, radioPrivateData.MacAddress.U8[1]);
-		WriteCHARSPI(RegFifo, radioPrivateData.MacAddress.U8[2]);
-		WriteCHARSPI(RegFifo, radioPrivateData.MacAddress.U8[3]);
-
-		for (i = 0; i < sduLength; i++)
-			WriteCHARSPI(RegFifo, *(txBuffer++));
-	}
-	else if (packetType == kMulticastPacketType)
-	{
-		// NOTE: This must be set to TX start on threshold or else the packet send does not work.  That is the purpose of the 0x7F mask
-		WriteCHARSPI(RegFifoThresh, ((length + 5) & 0x7F));
-		// the first byte must be the length of the packet, but the length count should not include this count.  So we add 5 to account for overhead instead of 6.
-		WriteCHARSPI(RegFifo, length+9);
-		// tx start = 0, fifothreshold = length
-		// Write the packetType to the first byte in the FIFO
-		WriteCHARSPI(RegFifo, packetType);
-		// Write the sender MAC
-		WriteCHARSPI(RegFifo, radioPrivateData.MacAddress.U8[0]);
-		WriteCHARSPI(RegFifo, radioPrivateData.MacAddress.U8[1]);
-		WriteCHARSPI(RegFifo, radioPrivateData.MacAddress.U8[2]);
-		WriteCHARSPI(RegFifo, radioPrivateData.MacAddress.U8[3]);
-
-		for (i=0;i<sduLength;i++)
-			WriteCHARSPI(RegFifo,*(txBuffer++));
-	}
-	else if (packetType==kAckPacketType)
-	{
-		// the first byte must be the length of the packet, but the length count should not include this count.  So we add 5 to account for overhead instead of 6.
-		WriteCHARSPI(RegFifo, 9);
-		// tx start = 0, fifothreshold = length
-		// Write the packetType to the first byte in the FIFO
-		WriteCHARSPI(RegFifo, packetType);
-		// Write the destination MAC
-		WriteCHARSPI(RegFifo, destAddress.U8[0]);
-		WriteCHARSPI(RegFifo, destAddress.U8[1]);
-		WriteCHARSPI(RegFifo, destAddress.U8[2]);
-		WriteCHARSPI(RegFifo, destAddress.U8[3]);
-		// Write the destination MAC
-		WriteCHARSPI(RegFifo, radioPrivateData.MacAddress.U8[0]);
-		WriteCHARSPI(RegFifo, radioPrivateData.MacAddress.U8[1]);
-		WriteCHARSPI(RegFifo, radioPrivateData.MacAddress.U8[2]);
-		WriteCHARSPI(RegFifo, radioPrivateData.MacAddress.U8[3]);
-	}
-
-	SetIOForTransmit();
+	WaitForModeChange(radio);
+
+	// As much of the payload as fits goes into the FIFO now.  The rest is streamed in from the FifoLevel interrupt.
+	first = kFifoSize - headerLength;
+	if (first > length)
+		first = length;
+	radio->TxPointer = txBuffer + first;
+	radio->TxRemaining = length - first;
+	if (radio->TxRemaining)
+		// TX starts on FifoNotEmpty, and FifoLevel tells us when there is room for more
+		WriteRegister(radio, RegFifoThresh, 0x80 | kFifoThreshold);
+	else
+		// NOTE: This must be set to TX start on threshold or else the packet send does not work.  That is the purpose of the 0x7F mask.
+		// The threshold is one less than the number of bytes we put in the FIFO, so TX starts once the whole frame is loaded.
+		WriteRegister(radio, RegFifoThresh, header[0] & 0x7F);
+	WriteCHARSPIMultiple(RegFifo, headerLength, header);
+	if (first)
+		WriteCHARSPIMultiple(RegFifo, first, txBuffer);
+
+	if (radio->Bus->SetIO)
+		radio->Bus->SetIO(1);
 	// TODO: shift so high byte == 0
 	
 	preambleCount >>= 8;
 	uu16.U16 = preambleCount;
-	WriteCHARSPI(RegPreambleMsb, uu16.U8[1]);
-	WriteCHARSPI(RegPreambleLsb, uu16.U8[0]);
+	WriteRegister(radio, RegPreambleMsb, uu16.U8[1]);
+	WriteRegister(radio, RegPreambleLsb, uu16.U8[0]);
 
-   	WriteCHARSPI(RegOpMode, 0x0C);
-	radioPrivateData.Mode = kTransmitMode;
+	radio->Mode = kTransmitMode;
+	SetOpMode(radio, 0x0C);
 	// we can either return here and let the interrupt based event system take over, or if the caller wants us to block until done, we
 	// can wait until the packet is completely sent or the radio causes some error that requires exit.
 	if (blocking)
 	{
-		if (!WaitForModeChange())
+		if (!WaitForModeChange(radio))
 			return 0;
-		// Wait until packet sent flag is true
-		while ((ReadCHARSPI(RegIrqFlags2) & 0x08) == 0)
-			;
+		// Wait until packet sent flag is true, topping up the FIFO as we go
+		while (((i = ReadRegister(radio, RegIrqFlags2)) & 0x08) == 0)
+			ServiceFIFO(radio, i);
+		if (radio->TxRemaining)
+		{
+			// the FIFO ran dry and the frame went out short
+			radio->TxRemaining = 0;
+			SetOpMode(radio, 0x00);
+			WaitForModeChange(radio);
+			return 0;
+		}
 		// go back to sleep mode
-	   	WriteCHARSPI(RegOpMode,0x00);
-	   	return WaitForModeChange();
+		SetOpMode(radio, 0x00);
+		return WaitForModeChange(radio);
 	}
-	return WaitForModeChange();
+	// the ModeReady interrupt takes it from here
+	return 1;
 }
 
 
-void RadioReceivePacket(tListenModes listenMode, U16 period)
+void RadioReceivePacket(tRadioHandle radio, tListenModes listenMode, U16 period)
 {
-	radioPrivateData.ListenMode = listenMode;
-	radioPrivateData.ListenPeriod = period;
+	radio->ListenMode = listenMode;
+	radio->ListenPeriod = period;
 
 	// turn PA off
-	WriteCHARSPI(RegPaLevel, 0x00);
-	WriteCHARSPI(RegTestPa1, 0x55);
-	WriteCHARSPI(RegTestPa2, 0x70);
-	WriteCHARSPI(RegOcp, 0x00);
+	WriteRegister(radio, RegPaLevel, 0x00);
+	WriteRegister(radio, RegTestPa1, 0x55);
+	WriteRegister(radio, RegTestPa2, 0x70);
+	WriteRegister(radio, RegOcp, 0x00);
+	// a reading from before the restart may be from another channel
+	radio->CcaReady = 0;
+	// the receiver is moved by the expected peer's offset
+	if (radio->TunedCorrection != radio->FrequencyCorrection)
+		TuneChannel(radio, radio->FrequencyCorrection);
 
 	if (listenMode & 0x80)
 	{
 		// Setup timeout for scanning
-		WriteCHARSPI(RegRxTimeout1, 0x01);
-		WriteCHARSPI(RegRxTimeout2, 0);
-		radioPrivateData.CurrentChannel = 0;
-		RadioSetChannel(0);
+		WriteRegister(radio, RegRxTimeout1, 0x01);
+		WriteRegister(radio, RegRxTimeout2, 0);
+		radio->CurrentChannel = 0;
+		RadioSetChannel(radio, 0);
 	}
-
-	ClearFIFO();
-	WriteCHARSPI(RegRssiThresh, 0xA0);
-	SetIOForReceive();
-	EnableIntP0();
-	EnableIntP1();
-	radioPrivateData.Mode = kListenMode;
-
-	ClearTimer(kListenTimer);
-	// put the radio in receive mode
-	WriteCHARSPI(RegOpMode, 0x10);
-
-	// wait until the mode ready indicator shows that the new mode is active and ready to go.
-	WaitForModeChange();
-}
-
-void RadioSetDataRate(tDataRates dataRate)
-{
-	U8 brHi, brLo, fdHi, fdLo, bwMan, bwExp, afcMan, afcExp, bo;
-
-	switch(dataRate)
+	else if (listenMode == kPeriodic)
+		ConfigureListen(radio, period);
+
+	// dio0 = PAYLOADRDY, dio1 = TIMEOUT or FIFOLVL, dio2=FIFONE, dio3=SYNCADDR, dio4=RXRDY, dio5=MODERDY, CLKOUT = off
+	// DIO1 carries FifoLevel so long frames can be drained as they arrive.  Scanning needs the timeout on DIO1, and with AES on
+	// nothing can be drained early, so in those cases it stays on the timeout and the 1mSec tick polls FifoLevel instead.
+	// DIO3 timestamps the sync word of each frame.
+	if ((listenMode & 0x80) || radio->AesEnabled)
+		WriteRegister(radio, RegDioMapping1, 0x72);
+	else
+		WriteRegister(radio, RegDioMapping1, 0x42);
+	WriteRegister(radio, RegDioMapping2, 0xB7);
+	WriteRegister(radio, RegFifoThresh, 0x80 | kFifoThreshold);
+	// The receiver ignores the preamble length, so the ACK's is set now rather than after PayloadReady
+	if (radio->AutoAck)
 	{
-	case k1200BPS:
-		brHi = 0x68;
-		brLo = 0x28;
-		if (radioPrivateData.GfskEnabled)
-		{
-			//300 hZ fDev
-			fdHi = 0x00;
-			fdLo = 0x05;
-			// 2.6kHz RXBW
-			bwMan = 0x02;
-			bwExp = 0x07;
-			// 50kHz afcBW
-			afcMan = 1;
-			afcExp = 3;
-			// no afc offset required
-			bo = 0;
-		}
-		else
-		{
-			// 600hZ Fdev
-			fdHi=0x00;
-			fdLo = 0x09;
-			// 2.6kHz RxBW
-			bwMan = 0x02;
-			bwExp = 0x07;
-			// 50kHz afcBW
-			afcMan = 1;
-			afcExp = 3;
-		}
-		break;
-	case k2400BPS:
-		brHi = 0x34;
-		brLo = 0x15;
-		if (radioPrivateData.GfskEnabled)
-		{
-			// 600hZ Fdev
-			fdHi = 0x00;
-			fdLo = 0x09;
-			// 2.6kHz RX BW
-			bwMan = 0x02;
-			bwExp = 0x07;
-			// 50kHz afcBW
-			afcMan = 1;
-			afcExp = 3;
-			// no afc offset required
-			bo = 0;
-		}
-		else
-		{
-			// 1200 Hz Fdev
-			fdHi=0x00;
-			fdLo = 0x13;
-			// 2.6kHz RxBW
-			bwMan = 0x02;
-			bwExp = 0x07;
-			// 50kHz afcBW
-			afcMan = 1;
-			afcExp = 3;
-		}
-		break;
-	case k4800BPS:
-		brHi = 0x1a;
-		brLo = 0x0b;
-		if (radioPrivateData.GfskEnabled)
-		{
-			// 2.4kHz Fdev
-			fdHi = 0x00;
-			fdLo = 0x27;
-			// 3.6kHz Rx BW
-			bwMan = 0x00;
-			bwExp = 0x07;
-			// 62.5kHz afcBW
-			afcMan = 0;
-			afcExp = 3;
-		}
-		else
-		{
-			// 2.4kHz Fdev
-			fdHi=0x00;
-			fdLo = 0x27;
-			// 5.2 kHz RxBW
-			bwMan = 0x02;
-			bwExp = 0x06;
-			// 62.5kHz afcBW
-			afcMan = 0;
-			afcExp = 3;
-			// no afc offset required
-			bo = 0;
-		}
-		break;
-	case k9600BPS:
-		brHi = 0x0d;
-		brLo = 0x05;
-		if (radioPrivateData.GfskEnabled)
-		{
-			// 4.8kHz Fdev
-			fdHi = 0x00;
-			fdLo = 0x48;
-			// 7.8 kHz RxBW
-			bwMan = 0x00;
-			bwExp = 0x06;
-			// 62.5kHz afcBW
-			afcMan = 0;
-			afcExp = 3;
-		}
-		else
-		{
-			// 4.8kHz Fdev
-			fdHi=0x00;
-			fdLo = 0x4e;
-			// 10.4kHz RXBW
-			bwMan = 0x02;
-			bwExp = 0x05;
-			// 83.3kHz afcBW
-			afcMan = 2;
-			afcExp = 2;
-			// 488hZ afc offset
-			bo = 1;
-		}
-		break;
-	case k19200BPS:
-		brHi = 0x06;
-		brLo = 0x83;
-		if (radioPrivateData.GfskEnabled)
-		{
-			// 9.6kHz Fdev
-			fdHi = 0x00;
-			fdLo = 0x98;
-			// 15.6 kHz RxBW
-			bwMan = 0x00;
-			bwExp = 0x05;
-			// 83.3kHz afcBW
-			afcMan = 2;
-			afcExp = 2;
-			// 488hZ afc offset
-			bo = 1;
-		}
-		else
-		{
-			// 9.6kHz Fdev
-			fdHi=0x00;
-			fdLo = 0x98;
-			// 20.8kHz RxBW
-
-			bwMan = 0x02;
-			bwExp = 0x04;
-			// 100kHz afcBW
-			afcMan = 1;
-			afcExp = 2;
-		}
-		break;
-	case k38400BPS:
-		brHi = 0x03;
-		brLo = 0x41;
-		if (radioPrivateData.GfskEnabled)
-		{
-			// 19.2kHz Fdev
-			fdHi = 0x01;
-			fdLo = 0x47;
-			// 31.3kHz RxBW
-			bwMan = 0x00;
-			bwExp = 0x04;
-			// 125kHz afcBW
-			afcMan = 0;
-			afcExp = 2;
-			// 976hZ afc offset
-			bo = 15;
-		}
-		else
-		{
-			// 19.2kHz Fdev
-			fdHi=0x01;
-			fdLo = 0x3a;
-			// 41.7kHz RxBW
-			bwMan = 0x02;
-			bwExp = 0x03;
-			// 125kHz afcBW
-			afcMan = 0;
-			afcExp = 2;
-		}
-		break;
-	case k76800BPS:
-		brHi = 0x01;
-		brLo = 0xa1;
-		if (radioPrivateData.GfskEnabled)
-		{
-			// 38.4kHz Fdev
-			fdHi = 0x02;
-			fdLo = 0x75;
-			// 62.5kHz RxBW
-			bwMan = 0x00;
-			bwExp = 0x03;
-			// 166.7kHz afcBW
-			afcMan = 2;
-			afcExp = 1;
-			// 1952hZ afc offset
-			bo = 4;
-		}
-		else
-		{
-			// 38.4kHz Fdev
-			fdHi=0x02;
-			fdLo = 0x75;
-			// 83.3kHz RxBW
-			bwMan = 0x02;
-			bwExp = 0x02;
-			// 200kHz afcBW
-			afcMan = 1;
-			afcExp = 1;
-		}
-		break;
-	case k153600BPS:
-		brHi = 0x00;
-		brLo = 0x0d;
-		if (radioPrivateData.GfskEnabled)
-		{
-			// 38.4kHz Fdev
-			fdHi = 0x02;
-			fdLo = 0x75;
-			// 125kHz RxBW
-			bwMan = 0x00;
-			bwExp = 0x02;
-			// 333kHz afcBW
-			afcMan = 2;
-			afcExp = 0;
-			// 3904hZ afc offset
-			bo = 8;
-		}
-		else
-		{
-			// 76.8kHz Fdev
-			fdHi=0x04;
-			fdLo = 0xeb;
-			// 166.7kHz RxBW
-			bwMan = 0x00;
-			bwExp = 0x02;
-			// 400kHz afcBW
-			afcMan = 1;
-			afcExp = 0;
-		}
-		break;
-	default:
-		// default to 9600
-		brHi = 0x0d;
-		brLo = 0x05;
-
-		if (radioPrivateData.GfskEnabled)
-		{
-			// 2.4kHz Fdev
-			fdHi = 0x00;
-			fdLo = 0x27;
-			// 7.8 kHz RxBW
-			bwMan = 0x00;
-			bwExp = 0x06;
-			// 62.5kHz afcBW
-			afcMan = 0;
-			afcExp = 3;
-			// 0hZ afc offset
-			bo = 0;
-		}
-		else
-		{
-			// 4.8kHz Fdev
-			fdHi=0x00;
-			fdLo = 0x4e;
-			// 10.4kHz RXBW
-			bwMan = 0x02;
-			bwExp = 0x05;
-			// 83.3kHz afcBW
-			afcMan = 2;
-			afcExp = 2;
-		}
-		break;
+		WriteRegister(radio, RegPreambleMsb, 0);
+		WriteRegister(radio, RegPreambleLsb, kAckPreambleLength);
 	}
 
-	WriteCHARSPI(RegBitrateMsb, brHi);
-	WriteCHARSPI(RegBitrateLsb, brLo);
-	WriteCHARSPI(RegFdevMsb, fdHi);
-	WriteCHARSPI(RegFdevLsb, fdLo);
-
-	WriteCHARSPI(RegRxBw, 0x40 | (bwMan  << 3) | bwExp);
-	WriteCHARSPI(RegAfcBw,0x40 | (afcMan << 3) | afcExp);
-	
-	if (radioPrivateData.GfskEnabled)
-		WriteCHARSPI(RegTestAfc, bo);
+	ClearFIFO(radio);
+	WriteRegister(radio, RegRssiThresh, 0xA0);
+	if (radio->Bus->SetIO)
+		radio->Bus->SetIO(0);
+	radio->SyncSeen = 0;
+	EnableIrq(radio, 0, 1);
+	EnableIrq(radio, 1, 1);
+	EnableIrq(radio, 3, 1);
+	radio->Mode = kListenMode;
+
+	if (listenMode == kPeriodic)
+		// the radio runs the idle/RX cycle itself
+		StartListen(radio);
+	else
+		// put the radio in receive mode.  The ModeReady interrupt tells us when it is active.
+		SetOpMode(radio, 0x10);
 }
 
-U8 RadioSleepMode(void)
+void RadioSetDataRate(tRadioHandle radio, tDataRates dataRate)
 {
-	WriteCHARSPI(RegOpMode, 0x00);
-	radioPrivateData.Mode = kSleepMode;
-	return WaitForModeChange();
+	const tDataRateSetting *setting;
+
+	if (dataRate > k300KBPS)
+		dataRate = k9600BPS;
+	setting = &_dataRateTable[radio->GfskEnabled ? 1 : 0][dataRate];
+	radio->DataRate = setting;
+
+	// The shadow cache turns these into one burst per contiguous register run
+	WriteRegisters(radio, RegBitrateMsb, sizeof(setting->Modulation), setting->Modulation);
+	radio->FifoPollInterval = (U16)(ByteTimes(radio, kFifoSize) / 2000);
+	WriteRegisters(radio, RegRxBw, sizeof(setting->Bandwidth), setting->Bandwidth);
+	WriteRegister(radio, RegTestAfc, setting->LowBetaOffset);
+	// a corrected link keeps its narrow AFC bandwidth
+	if (radio->FrequencyCorrection)
+		WriteRegister(radio, RegAfcBw, setting->TrackedAfcBw);
+	FlushRegisters(radio);
 }
 
-U8 RadioStandbyMode(void)
+U8 RadioSleepMode(tRadioHandle radio)
 {
-	WriteCHARSPI(RegOpMode, 0x04);
-	radioPrivateData.Mode = kStandbyMode;
-	return WaitForModeChange();
+	SetOpMode(radio, 0x00);
+	radio->Mode = kSleepMode;
+	return 1;
 }
 
-void RadioSetChannel(U8 channel)
+U8 RadioStandbyMode(tRadioHandle radio)
 {
-	UU32 frf;
-
-	// Fstep = Fxosc / 2^19 => 32Mhz/2^19 = 61
-	// Fc = Fstep * RegFrf[23:0]
-	// => RegFrf = Fc / Fstep
-	// Fc = 902.5MHz + channel * .5Mhz
-	// => RegFrf = (902500000 + channel*500000) / 61
-	frf.U32 = (14795082 + (U32)channel * (U32)8196) ;
+	SetOpMode(radio, 0x04);
+	radio->Mode = kStandbyMode;
+	return 1;
+}
 
-	WriteCHARSPI(RegFrfMsb, frf.U8[2]);
-	WriteCHARSPI(RegFrfMid, frf.U8[1]);
-	WriteCHARSPI(RegFrfLsb, frf.U8[0]);
+void RadioSetChannel(tRadioHandle radio, U8 channel)
+{
+	if (channel >= FHSSCHANNELS)
+		return;
+	radio->Channel = channel;
+	// whatever correction is in place stays, so a receiver keeps its offset across hops
+	TuneChannel(radio, radio->TunedCorrection);
 }
 
 //
@@ -844,73 +1855,386 @@ void RadioSetChannel(U8 channel)
 // 30			+19 dBm
 // 31			+20 dBm
 
-void RadioSetTxPower(U8 power)
+void RadioSetTxPower(tRadioHandle radio, U8 power)
 {
-	WriteCHARSPI(RegPaLevel, 0x60 + power);
-	WriteCHARSPI(RegOcp, 0x0F);
-	WriteCHARSPI(RegTestPa1, 0x5D);
-	WriteCHARSPI(RegTestPa2, 0x7C);
+	radio->TxPaLevel = 0x60 + power;
+	TurnPaOn(radio);
+	FlushRegisters(radio);
 }
 
-void RadioSetRSSIThreshold(U8 threshold)
+void RadioSetRSSIThreshold(tRadioHandle radio, U8 threshold)
 {
-	WriteCHARSPI(RegRssiThresh, threshold);
+	WriteRegister(radio, RegRssiThresh, threshold);
+	FlushRegisters(radio);
 }
 
-U8 RadioReadRSSIValue()
+U8 RadioReadRSSIValue(tRadioHandle radio)
 {
-	U8 om, rssiConfig, rssi;
+	U8 rssi;
+	U32 start;
+
+	// the sampler already has a recent reading
+	if (radio->RssiInterval || radio->ScanChannel != kNoScan)
+		return radio->LastRssi;
+	if (radio->OpMode != 0x10)
+		return 0x01;
+	// Interrupts are only masked for each register access, so the ISRs (radio included) keep running while we wait
 	DisableInterrupts;
-	rssi = 0;
-	om = ReadCHARSPI(RegOpMode);
-	if (om == 0x10)
+	WriteRegister(radio, RegRssiConfig, 0x01);
+	EnableInterrupts;
+	start = GetMicroseconds();
+	do
 	{
-		WriteCHARSPI(RegRssiConfig, 0x01);
-		rssiConfig = ReadCHARSPI(RegRssiConfig);
-		while ((rssiConfig & 0x02)==0)
-		{
-			rssiConfig = ReadCHARSPI(RegRssiConfig);
-			ReadRegs();
-			rssi++;
-		}
-		rssi = ReadCHARSPI(RegRssiValue);
+		DisableInterrupts;
+		rssi = ReadRegister(radio, RegRssiConfig);
+		EnableInterrupts;
+	} while (!(rssi & 0x02) && GetMicroseconds() - start < kModeChangeTimeout);
+	DisableInterrupts;
+	rssi = ReadRegister(radio, RegRssiValue);
+	EnableInterrupts;
+	return rssi;
+}
+
+U8 RadioReadChannelRSSI(tRadioHandle radio, U8 *rssi)
+{
+	U8 ready;
+
+	// a reading taken on the way into receive mode means nothing
+	if (radio->OpMode != 0x10 || radio->PendingOpMode != kNoOpMode)
+		return 0;
+	// This is called from the radio ISR, where waiting for RssiDone could stall the tick that times the wait.  The tick
+	// takes the reading instead, and each one answers a single assessment.
+	DisableInterrupts;
+	ready = radio->CcaReady;
+	if (ready)
+	{
+		*rssi = radio->LastRssi;
+		radio->CcaReady = 0;
 	}
 	else
-		rssi = 0x01;
+		radio->CcaRequested = 1;
 	EnableInterrupts;
-	return rssi;
+	return ready;
 }
 
-void RadioSetEncryptionKey(U8 *key, U8 length)
+void RadioStartRSSISampler(tRadioHandle radio, U16 interval)
 {
-	int i;
-	for (i = 0; i < length; i++)
-		WriteCHARSPI(RegAesKey1 + i, *(key++));
+	DisableInterrupts;
+	radio->RssiInterval = interval ? interval : 1;
+	radio->RssiTimer = 0;
+	radio->RssiHead = 0;
+	radio->RssiCount = 0;
+	EnableInterrupts;
+}
+
+void RadioStopRSSISampler(tRadioHandle radio)
+{
+	DisableInterrupts;
+	radio->RssiInterval = 0;
+	radio->RssiPending = 0;
+	EnableInterrupts;
+}
+
+U8 RadioReadRSSISample(tRadioHandle radio, U8 *rssi)
+{
+	U8 available;
+
+	DisableInterrupts;
+	available = radio->RssiCount;
+	if (available)
+	{
+		*rssi = radio->RssiSamples[radio->RssiHead];
+		radio->RssiHead = (radio->RssiHead + 1) % kRssiSampleCount;
+		radio->RssiCount--;
+	}
+	EnableInterrupts;
+	return available ? 1 : 0;
+}
+
+void RadioStartRSSIScan(tRadioHandle radio, U8 samples)
+{
+	// no RX timeouts while sitting on each channel
+	WriteRegister(radio, RegRxTimeout1, 0);
+	WriteRegister(radio, RegRxTimeout2, 0);
+	WriteRegister(radio, RegPaLevel, 0x00);
+	WriteRegister(radio, RegTestPa1, 0x55);
+	WriteRegister(radio, RegTestPa2, 0x70);
+	WriteRegister(radio, RegOcp, 0x00);
+	ClearFIFO(radio);
+	DisableInterrupts;
+	radio->ScanSamples = samples ? samples : 1;
+	radio->RssiPending = 0;
+	radio->ScanChannel = 0;
+	ScanNextChannel(radio);
+	radio->Mode = kScanMode;
+	SetOpMode(radio, 0x10);
+	EnableInterrupts;
+}
+
+U8 RadioIsRSSIScanDone(tRadioHandle radio)
+{
+	return radio->ScanChannel == kNoScan;
+}
+
+U8 RadioGetNoiseFloor(tRadioHandle radio, U8 channel)
+{
+	if (channel >= FHSSCHANNELS)
+		return 0xFF;
+	return radio->NoiseFloor[channel];
+}
+
+U8 RadioGetPeerOffset(tRadioHandle radio, UU32 peer, S16 *offset)
+{
+	U8 i;
+
+	DisableInterrupts;
+	i = FindPeerOffset(radio, peer.U8);
+	if (i != kNoPeer)
+		*offset = radio->PeerOffsets[i].Offset;
+	EnableInterrupts;
+	return i != kNoPeer;
+}
+
+void RadioSetFSPretune(tRadioHandle radio, U8 enable)
+{
+	radio->FSPretune = enable;
+}
+
+void RadioSetEncryption(tRadioHandle radio, U8 enable)
+{
+	radio->AesEnabled = enable ? 1 : 0;
+	WriteRegister(radio, RegPacketConfig2, (ReadRegister(radio, RegPacketConfig2) & 0xFE) | radio->AesEnabled);
+	FlushRegisters(radio);
+}
+
+void RadioSetAddressFiltering(tRadioHandle radio, U8 enable)
+{
+	radio->AddressFiltering = enable ? 1 : 0;
+	WriteRegister(radio, RegNodeAdrs, radio->MacAddress.U8[0]);
+	WriteRegister(radio, RegBroadcaseAdrs, kBroadcastNodeAddress);
+	// AddressFiltering (bits 2-1) = node or broadcast address, or off
+	WriteRegister(radio, RegPacketConfig1, (ReadRegister(radio, RegPacketConfig1) & 0xF9) | (radio->AddressFiltering ? 0x04 : 0x00));
+	FlushRegisters(radio);
+	// the ACK gains or loses its node byte
+	BuildAckFrame(radio);
+}
+
+void RadioGetFilterStatistics(tRadioHandle radio, tFilterStatistics *statistics)
+{
+	DisableInterrupts;
+	*statistics = radio->FilterStatistics;
+	EnableInterrupts;
+}
+
+void RadioClearFilterStatistics(tRadioHandle radio)
+{
+	DisableInterrupts;
+	radio->FilterStatistics.Accepted = 0;
+	radio->FilterStatistics.Rejected = 0;
+	EnableInterrupts;
+}
+
+void RadioSetShortAddress(tRadioHandle radio, U8 shortAddress)
+{
+	radio->ShortAddress = (shortAddress > kMaxShortAddress) ? kNoShortAddress : shortAddress;
+	// the ACK may change format
+	BuildAckFrame(radio);
+}
+
+U8 RadioGetShortAddress(tRadioHandle radio)
+{
+	return radio->ShortAddress;
+}
+
+U8 RadioSetShortPeer(tRadioHandle radio, UU32 peer, U8 shortAddress)
+{
+	U8 i;
+
+	if (shortAddress > kMaxShortAddress)
+		return 0;
+	DisableInterrupts;
+	i = FindShortPeer(radio, peer);
+	if (i == kNoPeer)
+		// a free entry
+		for (i = 0; i < kShortPeerCount && radio->ShortPeers[i].ShortAddress != kNoShortAddress; i++)
+			;
+	if (i < kShortPeerCount)
+	{
+		radio->ShortPeers[i].MacAddress.U32 = peer.U32;
+		radio->ShortPeers[i].ShortAddress = shortAddress;
+	}
+	EnableInterrupts;
+	if (i == kShortPeerCount)
+		return shortAddress == kNoShortAddress;
+	if (peer.U32 == radio->AckPeer.U32)
+		BuildAckFrame(radio);
+	return 1;
+}
+
+U8 RadioGetShortPeer(tRadioHandle radio, UU32 peer)
+{
+	U8 i;
+
+	i = FindShortPeer(radio, peer);
+	return (i == kNoPeer) ? kNoShortAddress : radio->ShortPeers[i].ShortAddress;
+}
+
+void RadioGetHeaderStatistics(tRadioHandle radio, tPacketTypes packetType, tHeaderStatistics *statistics)
+{
+	if (packetType > kAckPacketType)
+		return;
+	DisableInterrupts;
+	*statistics = radio->HeaderStatistics[packetType];
+	EnableInterrupts;
+}
+
+void RadioClearHeaderStatistics(tRadioHandle radio)
+{
+	U8 i;
+
+	DisableInterrupts;
+	for (i = 0; i <= kAckPacketType; i++)
+	{
+		radio->HeaderStatistics[i].ShortFrames = 0;
+		radio->HeaderStatistics[i].LongFrames = 0;
+		radio->HeaderStatistics[i].AirtimeSaved = 0;
+	}
+	EnableInterrupts;
+}
+
+void RadioSetSequence(tRadioHandle radio, U8 sequence, U8 base)
+{
+	radio->TxSequence[0] = sequence;
+	radio->TxSequence[1] = base;
+}
+
+void RadioSetAutoAck(tRadioHandle radio, U8 enable)
+{
+	radio->AutoAck = enable ? 1 : 0;
+	BuildAckFrame(radio);
+}
+
+void RadioExpectPeer(tRadioHandle radio, UU32 peer)
+{
+	U8 i;
+
+	radio->AckPeer.U32 = peer.U32;
+	BuildAckFrame(radio);
+	i = FindPeerOffset(radio, peer.U8);
+	if (i == kNoPeer)
+	{
+		radio->FrequencyCorrection = 0;
+		WriteRegister(radio, RegAfcBw, radio->DataRate->Bandwidth[1]);
+	}
+	else
+	{
+		// AFC only has the residual error to find, so it can use a narrower bandwidth
+		radio->FrequencyCorrection = radio->PeerOffsets[i].Offset;
+		WriteRegister(radio, RegAfcBw, radio->DataRate->TrackedAfcBw);
+	}
+	// A running receiver is retuned now, which flushes RegAfcBw too.  Otherwise the correction waits for RadioReceivePacket.
+	if (radio->Mode == kReceiveMode || radio->Mode == kListenMode)
+		TuneChannel(radio, radio->FrequencyCorrection);
+	else
+		FlushRegisters(radio);
+}
+
+void RadioGetAckTurnaround(tRadioHandle radio, tAckTurnaround *turnaround)
+{
+	DisableInterrupts;
+	*turnaround = radio->AckTurnaround;
+	EnableInterrupts;
+}
+
+void RadioClearAckTurnaround(tRadioHandle radio)
+{
+	DisableInterrupts;
+	radio->AckTurnaround.Count = 0;
+	radio->AckTurnaround.Minimum = 0;
+	radio->AckTurnaround.Maximum = 0;
+	radio->AckTurnaround.Total = 0;
+	EnableInterrupts;
+}
+
+U8 RadioGetMaxFrameLength(tRadioHandle radio)
+{
+	return radio->AesEnabled ? kMaxAesFrameLength : kMaxFrameLength;
+}
+
+U32 RadioGetAirtime(tRadioHandle radio, U8 length, U16 preambleCount)
+{
+	U16 bytes;
+
+	// preamble as RadioSendPacket sets it, the sync word (SyncSize + 1 bytes), then a frame with the largest header
+	bytes = (preambleCount >> 8) + ((radio->Registers[RegSyncConfig] >> 3) & 0x07) + 1
+		+ BytesAfterSync(radio, kMaxHeaderLength - 1 + length);
+	return ByteTimes(radio, bytes);
+}
+
+U32 RadioGetTxTimestamp(tRadioHandle radio)
+{
+	U32 timestamp;
+
+	DisableInterrupts;
+	timestamp = radio->TxTimestamp;
+	EnableInterrupts;
+	return timestamp;
+}
+
+void RadioSetEncryptionKey(tRadioHandle radio, U8 *key, U8 length)
+{
+	WriteRegisters(radio, RegAesKey1, length, key);
+	FlushRegisters(radio);
 }
 
-void RadioSetSyncCode(UU32 syncCode)
+void RadioSetSyncCode(tRadioHandle radio, UU32 syncCode)
 {
 	int i;
+	// most significant byte first, in consecutive registers so it flushes in one burst
 	for (i = 0; i < 4; i++)
-		WriteCHARSPI(RegSyncValue1 + i, syncCode.U8[i]);
+		WriteRegister(radio, RegSyncValue1 + i, syncCode.U8[3 - i]);
+	FlushRegisters(radio);
 }
 
-U8 RadioGetTemperature()
+U8 RadioGetTemperature(tRadioHandle radio)
 {
 	U8 om, temp=0;
-	om = ReadCHARSPI(RegOpMode);
+	om = ReadRegister(radio, RegOpMode);
 	if (om == 0x08 || om == 0x04)
 	{
-		WriteCHARSPI(RegTemp1, 0x08);
-		while ((ReadCHARSPI(RegTemp1) & 0x04))
+		WriteRegister(radio, RegTemp1, 0x08);
+		while ((ReadRegister(radio, RegTemp1) & 0x04))
 			;
-		temp = ReadCHARSPI(RegTemp2);
+		temp = ReadRegister(radio, RegTemp2);
 	}
 	return temp;
 }
 
-U8 RadioGetRFICMode()
+U8 RadioGetRFICMode(tRadioHandle radio)
 {
-	U8 mode = ReadCHARSPI(RegOpMode);
+	U8 mode = ReadRegister(radio, RegOpMode);
 	return mode;
 }
+
+void RadioGetModeLatency(tRadioHandle radio, tOperatingModes mode, tModeLatency *latency)
+{
+	DisableInterrupts;
+	*latency = radio->ModeLatency[mode];
+	EnableInterrupts;
+}
+
+void RadioClearModeLatency(tRadioHandle radio)
+{
+	U8 i;
+
+	DisableInterrupts;
+	for (i = 0; i <= kReceiveMode; i++)
+	{
+		radio->ModeLatency[i].Count = 0;
+		radio->ModeLatency[i].Timeouts = 0;
+		radio->ModeLatency[i].Minimum = 0;
+		radio->ModeLatency[i].Maximum = 0;
+		radio->ModeLatency[i].Total = 0;
+	}
+	EnableInterrupts;
+}
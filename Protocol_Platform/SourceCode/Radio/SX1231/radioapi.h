@@ -18,20 +18,102 @@
 
 enum
 {
-	kListenTimer,
+	kModeTimer,
+	kFifoTimer,
 	MAXTIMERS
 };
 
 #define FHSSCHANNELS 50
+// Fewest channels between two consecutive hops.  Sequences for very small channel counts use the widest spacing they can.
+#define kMinHopDistance 6
+// Largest radio header: length, node address, packet type, destination MAC, source MAC and the two sequence bytes of
+// block ACK frames
+#define kMaxHeaderLength 13
+// UniAck and mesh frames carry the first byte set by RadioSetSequence after their addresses, and it reaches
+// NotifyRadioPacketReceived as the first byte of the SDU.
+// OR kBlockAckFlag into kUniAckPacketType to have the next layer up acknowledge the frame with a block ACK instead of
+// RadioAPI.  These frames carry the second sequence byte as well.  Block ACKs are kAckPacketType | kBlockAckFlag, and
+// unlike plain ACKs carry a payload.
+#define kBlockAckFlag		0x20
+// OR kAggregateFlag into the packet type to tell the next layer up that the payload holds several of its SDUs.  RadioAPI
+// only carries it, and frames with it set are acknowledged as usual.
+#define kAggregateFlag		0x10
+// OR kFragmentFlag in for frames that carry one fragment of a bigger SDU of the next layer up.  It is carried the same way.
+#define kFragmentFlag		0x08
+// Node address byte of multicast frames when address filtering is on.  Every radio accepts it.
+#define kBroadcastNodeAddress 0xFF
+// Short addresses run from 1 to kMaxShortAddress.  kNoShortAddress means none has been handed out.
+#define kNoShortAddress		0
+#define kMaxShortAddress	0xFE
+// The coordinator's short address.  Every associated node knows it, so only the coordinator multicasts from a short address.
+#define kCoordinatorShortAddress 1
+// Number of peers whose short address is remembered
+#define kShortPeerCount		32
+// Size of the SX1231 FIFO and the FifoLevel threshold used to stream frames that do not fit in it
+#define kFifoSize			66
+#define kFifoThreshold		32
+// Largest length byte (packet type, addresses and payload).  With AES on the whole frame has to fit in the FIFO.
+#define kMaxFrameLength		255
+#define kMaxAesFrameLength	64
+// Number of RSSI samples the sampler keeps before overwriting the oldest
+#define kRssiSampleCount	16
+// Number of peers whose frequency offset is remembered
+#define kPeerOffsetCount	8
+// Number of radios RadioAPI can run at once
+#define kRadioCount			2
+
+/*!
+ *	\details Frequency band plans.  Each has FHSSCHANNELS channels.
+ */
+typedef enum
+{
+	kBand915,	/*! 902-928MHz, 500kHz spacing from 902.5MHz */
+	kBand868,	/*! 863-870MHz, 125kHz spacing from 863.125MHz */
+	kBand433	/*! 433.05-434.79MHz, 25kHz spacing from 433.1MHz */
+} tBandPlans;
+
+/*!
+ *	\details SPI accessors and board wiring of one radio.  Every function RadioAPI calls for a radio goes through its bus,
+ *  so radios on different SPI ports can run side by side.
+ */
+typedef struct
+{
+	U8 (*Read)(U8 reg);									/*! Reads one register */
+	void (*Write)(U8 reg, U8 value);					/*! Writes one register */
+	void (*ReadMultiple)(U8 reg, U8 count, U8 *buffer);	/*! Burst read starting at reg */
+	void (*WriteMultiple)(U8 reg, U8 count, U8 *buffer);/*! Burst write starting at reg */
+	void (*Reset)(void);								/*! Pulses the reset line.  NULL if it is not wired. */
+	void (*SetIO)(U8 transmit);							/*! Sets up board IO for transmit (non zero) or receive.  May be NULL. */
+	void (*EnableIrq)(U8 dio, U8 enable);				/*! Unmasks or masks the interrupt DIOn is wired to.  NULL if the DIOs
+															are not wired, in which case the radio is polled every mSec. */
+} tRadioBus;
+
+/*! \details The radio on the SPI port.  Its DIOs are wired to external interrupts 0 to 5.
+ */
+extern const tRadioBus kRadioBusSPI;
+#ifdef RADIO_SPI2
+/*! \details The radio on the SPI2 port.  Its reset line and DIOs are not wired, so it is polled.
+ */
+extern const tRadioBus kRadioBusSPI2;
+#endif
+
+/*! \details Handle of one radio, returned by RadioInitialize and passed to every other RadioAPI function.
+ */
+typedef struct tRadio *tRadioHandle;
 
 /*!
  *	\details Initialization structure for RadioAPI
  */
 typedef struct
 {
+	U8 Radio;			/*! Which radio, 0 to kRadioCount-1.  Radio 0's DIOn interrupts arrive as kInterruptPn, radio 1's as
+							kInterruptRadio2 + n. */
+	const tRadioBus *Bus;/*! Port the radio is on, such as &kRadioBusSPI */
 	UU32 MacAddress;	/*! MAC address of radio */
-	U8 HopTable;		/*! Hop table to use */
-	U16 FhssStepSize;	/*! Channel spacing between FHSS channels in khz */
+	U8 HopTable;		/*! Hop sequence selector.  Mixed with NetworkId to seed the hop sequence. */
+	U8 ChannelCount;	/*! Channels in the hop sequence, 1 to FHSSCHANNELS.  0 uses FHSSCHANNELS. */
+	U16 FhssStepSize;	/*! Channel spacing between FHSS channels in khz.  0 uses the band plan's spacing. */
+	tBandPlans BandPlan;/*! Frequency band plan */
 	U8 GausianEnabled;	/*! Non zero if GFSK is to be used.  Bt will be 0.5 for GFSK and 1.0 for FSK*/
 	UU32 NetworkId;		/*! Network id  */
 } tRadioInitialization;
@@ -45,6 +127,10 @@ typedef enum
 	kUniNoAckPacketType,	/*! Unicast packet(point to point) without acknowledgment */
 	kMulticastPacketType,	/*! Multicast packet.  This is a broadcast packet to everyone on the network */
 	kAckPacketType,			/*! Acknowledgment packet.  This is sent in response to a UNIACK packet	 */
+	kAssociatePacketType,	/*! Association request or response.  Always carries full MAC addresses. */
+	kBeaconPacketType,		/*! Superframe beacon from a TDMA master.  Goes to everyone like a multicast, with the master's full MAC. */
+	kMeshPacketType,		/*! Frame forwarded hop by hop by the MAC.  Acknowledged at each hop like a UNIACK packet, and carries its sequence byte. */
+	kRouteRequestPacketType,	/*! Mesh route discovery request.  Goes to everyone like a multicast, with full MACs. */
 	kHoppingUniAckPacketType = 128,	/*! Unicast packet (point to point) with acknowledgment  with hopping*/
 	kHoppingUniNoAckPacketType,		/*! Unicast packet(point to point) without acknowledgment with hopping*/
 	kHoppingMulticastPacketType,	/*! Multicast packet.  This is a broadcast packet to everyone on the network with hopping*/
@@ -58,7 +144,7 @@ typedef enum
 {
 	kContinuous = 1,		/*! Listen on the current channel until a packet is received or the mode is changed via OpenRFSendPacket or OpenRFSleep */
 	kContinuousScan = 129,	/*! Listen for 48-bit periods on each channel in turn until a packet is received or the mode is changed via OpenRFSendPacket or OpenRFSleep */
-	kPeriodic = 2,			/*! Listen for 48-bit periods on the current channel then sleep for the remainder of the sleep period.  Exits on packet reception or mode change. */
+	kPeriodic = 2,			/*! Radio listen mode: sleep for the period, then listen for 64-bit periods on the current channel, without waking the MCU until RSSI and sync both match.  Senders need a preamble longer than the period.  Exits on packet reception or mode change. */
 	kPeriodicScan = 130		/*! Listen for 48-bit periods on the each channel then sleep for the remainder of the sleep period.  Exits on packet reception or mode change. */
 } tListenModes;
 
@@ -96,9 +182,76 @@ typedef enum
 	kFSMode,		/*! Frequency synthesizer is enabled */
 	kTransmitMode,	/*! Frequency synthesizer and transmitter are enabled */
 	kReceiveMode,	/* Frequency synthesizer and receiver are enabled */
-	kListenMode		/* Periodically listens for trasnmitter, staying in Standby mode most of the time */
+	kListenMode,	/* Periodically listens for trasnmitter, staying in Standby mode most of the time */
+	kScanMode		/* Receiver on, stepping through every channel to measure its noise floor */
 } tOperatingModes;
 
+/*! \details Latency statistics for transitions into one operating mode.  Times are in microseconds, measured from the
+ *  RegOpMode write to the ModeReady interrupt.
+ */
+typedef struct
+{
+	U16 Count;		/*! Number of completed transitions */
+	U16 Timeouts;	/*! Number of transitions that never raised ModeReady */
+	U16 Minimum;	/*! Fastest transition */
+	U16 Maximum;	/*! Slowest transition */
+	U32 Total;		/*! Sum of all transition times.  Total / Count is the average. */
+} tModeLatency;
+
+/*! \details Counts of received frames that passed sync and CRC.  Frames the radio drops on its node address never reach
+ *  the MCU and are not counted, so Rejected only counts frames whose node byte matched but whose full MAC did not.
+ */
+typedef struct
+{
+	U16 Accepted;	/*! Frames passed to NotifyRadioPacketReceived */
+	U16 Rejected;	/*! Frames for another MAC address, dropped by RadioAPI */
+} tFilterStatistics;
+
+/*! \details Use of short address headers for one packet type.  AirtimeSaved is worked out at the data rate each frame was
+ *  sent at.
+ */
+typedef struct
+{
+	U16 ShortFrames;	/*! Frames sent with short addresses */
+	U16 LongFrames;		/*! Frames sent with full MAC addresses */
+	U32 AirtimeSaved;	/*! uSec of airtime the short frames saved */
+} tHeaderStatistics;
+
+/*! \details Turnaround statistics for automatic ACKs.  Times are in sixteenths of a bit time at the current data rate,
+ *  measured from servicing PayloadReady to the ACK being in the FIFO.  128 is one byte time.
+ */
+typedef struct
+{
+	U16 Count;		/*! Number of ACKs sent */
+	U16 Minimum;	/*! Fastest turnaround */
+	U16 Maximum;	/*! Slowest turnaround */
+	U32 Total;		/*! Sum of all turnarounds.  Total / Count is the average. */
+} tAckTurnaround;
+
+/*! \details Receive details of one frame, captured when PayloadReady is serviced.
+ */
+typedef struct
+{
+	U32 Timestamp;	/*! GetMicroseconds() when PayloadReady was serviced */
+	U32 SyncTimestamp;	/*! GetMicroseconds() when the sync word ended.  Taken from the SyncAddress interrupt on DIO3, or worked
+						 *  back from Timestamp at the current data rate where DIO3 is not wired. */
+	S16 Afc;		/*! Frequency correction AFC applied, in 61Hz steps */
+	S16 Fei;		/*! Frequency error measured by FEI, in 61Hz steps */
+	U8 Rssi;		/*! RSSI value.  See section 3.4.9 in SX1231 manual. */
+	U8 Channel;		/*! Channel the frame arrived on */
+} tPacketMetadata;
+
+/*! \details Measured frequency offset of one peer.
+ */
+typedef struct
+{
+	UU32 MacAddress;	/*! MAC address of the peer */
+	S16 Offset;			/*! Frequency of the peer relative to ours, in 61Hz steps */
+	U8 Valid;			/*! Non zero once the peer has been heard */
+} tPeerOffset;
+
+// Radio DIOn is wired to external interrupt n and arrives at HandleInterrupt() as kInterruptPn.  The same DIO of the second
+// radio arrives as kInterruptRadio2 + kInterruptPn.
 enum
 {
 	kInterruptP0,
@@ -107,6 +260,7 @@ enum
 	kInterruptP3,
 	kInterruptP4,
 	kInterruptP5,
+	kInterruptRadio2 = 0x40,
 	kInterruptK0 = 0x80,
 	kInterruptK1,
 	kInterruptK2,
@@ -116,14 +270,17 @@ enum
 // ***********************************************************************************
 // *** Public API ***
 
-/*! \details Initialize the RadioAPI.  On return, the radio hardware will be configured and will be asleep.
+/*! \details Initialize one radio.  On return, the radio hardware will be configured and will be asleep.
+ *  \return Handle of the radio, 0 if ini.Radio or ini.Bus is not valid or the radio did not respond
  */
-U8 RadioInitialize(tRadioInitialization ini /*! Data structure to initialize radio API */);
+tRadioHandle RadioInitialize(tRadioInitialization ini /*! Data structure to initialize radio API */);
 
-/*! \details Send a packet using the radio's built in packet engine.
- *  \return 1=success, 0=error with radio
+/*! \details Send a packet using the radio's built in packet engine.  Frames too big for the FIFO are streamed from txBuffer
+ *  while they are sent, so txBuffer must stay untouched until NotifyRadioPacketSent or NotifyRadioPacketSendError.
+ *  \return 1=success, 0=error with radio or frame too long
  */
 U8 RadioSendPacket(
+		tRadioHandle radio /*! Radio handle */,
 		UU32 destAddress	/*! Destination MAC address */ ,
 		tPacketTypes packetType	/*! Packet type */,
 		U8 length			/*! Length of packet SDU (service data unit or payload) */,
@@ -135,6 +292,7 @@ U8 RadioSendPacket(
 /*! \details Put radio in receive mode and start listening for an incoming packet
  */
 void RadioReceivePacket(
+		tRadioHandle radio /*! Radio handle */,
 		tListenModes listenMode	/*! Listen mode */,
 		U16 period				/*! Listen period in mSec */
 	);
@@ -142,60 +300,214 @@ void RadioReceivePacket(
 /*! \details Change the data rate, Frequency deviation, Rx bandwidth, AFC bandwidth, and low beta afc offset
  *
  */
-void RadioSetDataRate(tDataRates dataRate/*!Data rate for TX and RX*/);
+void RadioSetDataRate(tRadioHandle radio /*! Radio handle */, tDataRates dataRate/*!Data rate for TX and RX*/);
 
 /*! \details Set the radio to sleep mode.  This is the lowest power mode of the radio.  In this mode, the radio is completely shut down. .1uA typical in this mode
- *
+ *  The mode change completes in the background and is finished by the ModeReady interrupt.
+ *  \return 1
  */
-U8 RadioSleepMode(void);
+U8 RadioSleepMode(tRadioHandle radio /*! Radio handle */);
 
 /*! \details Set the radio to standby mode.  This is the second lowest power mode of the radio.  In this mode, the oscillator is running. 1.25mA typical in this mode
- *
+ *  The mode change completes in the background and is finished by the ModeReady interrupt.
+ *  \return 1
  */
-U8 RadioStandbyMode(void);
+U8 RadioStandbyMode(tRadioHandle radio /*! Radio handle */);
 
 /*! \details Sets the radio channel.
  */
-void RadioSetChannel(U8 channel /*! Desired channel.  Valid channels are 0-24*/);
+void RadioSetChannel(tRadioHandle radio /*! Radio handle */, U8 channel /*! Desired channel.  Valid channels are 0 to FHSSCHANNELS-1*/);
+
+/*! \details Turns FS mode pre-tuning on or off.  When on, the radio parks in FS mode on the next hop channel after each
+ *  transmission instead of going to sleep, so the next hop only has to switch the PA on.  Costs FS mode current while idle.
+ */
+void RadioSetFSPretune(tRadioHandle radio /*! Radio handle */, U8 enable /*! Non zero to pre-tune */);
 
 /*! \details Sets the radio transmit power.  If the RFIC is a 1231H, the PA Boost will automatically be used for the high power setting.
  */
-void RadioSetTxPower(U8 power /*! Desired power level.  Bits 6,7,8 turn on PA0,PA1,PA2 respectively.  Bits 0-4 set power level in 1dB increments.  See 3.4.6 in SX1231 datasheet */);
+void RadioSetTxPower(tRadioHandle radio /*! Radio handle */, U8 power /*! Desired power level.  Bits 6,7,8 turn on PA0,PA1,PA2 respectively.  Bits 0-4 set power level in 1dB increments.  See 3.4.6 in SX1231 datasheet */);
 
 /*! \details Sets the RSSI threshold.  This threshold must be exceeded for a packet reception to happen.
  *
  */
-void RadioSetRSSIThreshold(U8 threshold /*! RSSI threshold.  See SX1231 documentation (Section 6.4) for information about this value.*/);
+void RadioSetRSSIThreshold(tRadioHandle radio /*! Radio handle */, U8 threshold /*! RSSI threshold.  See SX1231 documentation (Section 6.4) for information about this value.*/);
 
-/*! \details Reads RSSI from the SX1231.  This call disables interrupts globally while it executes.
+/*! \details Reads RSSI from the SX1231.  Interrupts are only disabled for each register access while it waits.
  *  \return RSSI value.   See section 3.4.9 in SX1231 manual for relationship between this value and RSSI.
  */
-U8 RadioReadRSSIValue(void);
+U8 RadioReadRSSIValue(tRadioHandle radio /*! Radio handle */);
+
+/*! \details Reads RSSI for a clear channel assessment.  It never waits, so it can be called from the radio callbacks.  The
+ *  reading is taken by the 1mSec tick: the first call asks for it and returns 0, and a call once it has been taken returns
+ *  it.  Each reading is only returned once.  Nothing is read while the receiver is not settled in receive mode.
+ *  \return 1 if 'rssi' was read, 0 if there is no reading yet
+ */
+U8 RadioReadChannelRSSI(tRadioHandle radio /*! Radio handle */, U8 *rssi /*! Receives the RSSI value.  See section 3.4.9 in SX1231 manual. */);
+
+/*! \details Starts taking an RSSI sample every interval mSec from the 1mSec tick.  Samples are only taken while the receiver
+ *  is on and are kept in a ring of kRssiSampleCount.  While the sampler runs, RadioReadRSSIValue returns the latest sample.
+ */
+void RadioStartRSSISampler(tRadioHandle radio /*! Radio handle */, U16 interval /*! mSec between samples */);
+
+/*! \details Stops the RSSI sampler.  Samples already taken can still be read.
+ */
+void RadioStopRSSISampler(tRadioHandle radio /*! Radio handle */);
+
+/*! \details Takes the oldest sample out of the RSSI sampler's ring.
+ *  \return 1 if a sample was returned, 0 if there are none
+ */
+U8 RadioReadRSSISample(tRadioHandle radio /*! Radio handle */, U8 *rssi /*! Receives the sample.  See section 3.4.9 in SX1231 manual. */);
+
+/*! \details Sweeps all FHSSCHANNELS channels, taking samples RSSI readings on each, and builds a table of noise floors.  The
+ *  sweep runs in the background from the 1mSec tick and leaves the radio asleep on the current hop channel.
+ */
+void RadioStartRSSIScan(tRadioHandle radio /*! Radio handle */, U8 samples /*! Readings per channel */);
+
+/*! \details Checks if the RSSI scan has finished.
+ *  \return 1 if no scan is running
+ */
+U8 RadioIsRSSIScanDone(tRadioHandle radio /*! Radio handle */);
+
+/*! \details Gets the noise floor the last RSSI scan measured on a channel.  This is the weakest reading seen there.
+ *  \return RSSI value.  See section 3.4.9 in SX1231 manual.
+ */
+U8 RadioGetNoiseFloor(tRadioHandle radio /*! Radio handle */, U8 channel /*! Channel, 0 to FHSSCHANNELS-1 */);
+
+/*! \details Gets the frequency offset measured for a peer, the one frames from it are received with.
+ *  \return 1 if 'offset' was set, 0 if the peer is not one of the kPeerOffsetCount heard most recently
+ */
+U8 RadioGetPeerOffset(tRadioHandle radio /*! Radio handle */, UU32 peer /*! MAC address of the peer */,
+						S16 *offset /*! Receives the offset, in 61Hz steps */);
 /*! \details Sets the encryption key
  *
  */
-void RadioSetEncryptionKey(U8 *key /*! Pointer to key in memory */,
+void RadioSetEncryptionKey(tRadioHandle radio /*! Radio handle */, U8 *key /*! Pointer to key in memory */,
 							U8 length /*! Length of key. MAKE SURE THIS IS NOT LONGER THAN THE KEY ARRAY*/);
 
-/*! \details Sets the sync code (should typically be the network id);
- *
+/*! \details Sets the sync code (should typically be the network id).  It goes on the air most significant byte first,
+ *  which is how RadioInitialize sets NetworkId.
+ */
+void RadioSetSyncCode(tRadioHandle radio /*! Radio handle */, UU32 syncCode /*! Sync code */);
+
+/*! \details Turns AES encryption on or off.  Encryption is on after RadioInitialize.  Frames bigger than kMaxAesFrameLength
+ *  can only be sent and received with encryption off.
+ */
+void RadioSetEncryption(tRadioHandle radio /*! Radio handle */, U8 enable /*! Non zero to encrypt */);
+
+/*! \details Turns hardware address filtering on or off.  When on, every frame carries the first byte of the destination
+ *  MAC where the radio can compare it with our own, so frames for other nodes are dropped without waking the MCU.  Every
+ *  node on the network must use the same setting.
+ */
+void RadioSetAddressFiltering(tRadioHandle radio /*! Radio handle */, U8 enable /*! Non zero to filter */);
+
+/*! \details Gets the address filtering statistics.
+ */
+void RadioGetFilterStatistics(tRadioHandle radio /*! Radio handle */, tFilterStatistics *statistics /*! Receives a copy of the statistics */);
+
+/*! \details Clears the address filtering statistics.
+ */
+void RadioClearFilterStatistics(tRadioHandle radio /*! Radio handle */);
+
+/*! \details Sets our short address.  Once set, frames to peers with a known short address and ACKs carry one byte
+ *  addresses instead of full MACs.  Multicasts only go short from kCoordinatorShortAddress, since other nodes do not know
+ *  each other's short addresses.  kNoShortAddress goes back to full MACs.
+ */
+void RadioSetShortAddress(tRadioHandle radio /*! Radio handle */, U8 shortAddress /*! Our short address */);
+
+/*! \details Gets our short address.
+ *  \return Short address, kNoShortAddress if none is set
+ */
+U8 RadioGetShortAddress(tRadioHandle radio /*! Radio handle */);
+
+/*! \details Remembers the short address of a peer, replacing any it had.  kNoShortAddress forgets the peer.
+ *  \return 1 if done, 0 if all kShortPeerCount entries are in use
+ */
+U8 RadioSetShortPeer(tRadioHandle radio /*! Radio handle */,
+					UU32 peer /*! MAC address of the peer */,
+					U8 shortAddress /*! Short address of the peer */);
+
+/*! \details Looks up the short address of a peer.
+ *  \return Short address, kNoShortAddress if it is not known
  */
-void RadioSetSyncCode(UU32 syncCode /*! Sync code */);
+U8 RadioGetShortPeer(tRadioHandle radio /*! Radio handle */, UU32 peer /*! MAC address of the peer */);
+
+/*! \details Gets the short address header statistics of one packet type.
+ */
+void RadioGetHeaderStatistics(tRadioHandle radio /*! Radio handle */,
+							tPacketTypes packetType /*! kUniAckPacketType through kAckPacketType */,
+							tHeaderStatistics *statistics /*! Receives a copy of the statistics */);
+
+/*! \details Clears the short address header statistics of every packet type.
+ */
+void RadioClearHeaderStatistics(tRadioHandle radio /*! Radio handle */);
+
+/*! \details Sets the sequence bytes sent in UniAck frames.  Only kUniAckPacketType | kBlockAckFlag frames carry the
+ *  second one.  RadioAPI does not look at them.
+ */
+void RadioSetSequence(tRadioHandle radio /*! Radio handle */, U8 sequence /*! First byte */, U8 base /*! Second byte */);
+
+/*! \details Turns automatic ACKs on or off.  When on, every UniAck frame for us without kBlockAckFlag is acknowledged from the PayloadReady
+ *  interrupt before NotifyRadioPacketReceived is called, which happens once the ACK has gone out.
+ */
+void RadioSetAutoAck(tRadioHandle radio /*! Radio handle */, U8 enable /*! Non zero to acknowledge UniAck frames */);
+
+/*! \details Gets ready for a frame from the peer we expect to hear from next.  The ACK is built ahead of time for it, and
+ *  if it has been heard before, the receiver is moved by its measured frequency offset and AFC uses a narrower
+ *  bandwidth.  ACKs to any other peer cost a rebuild of the frame.  A peer that has not been heard gets no correction and
+ *  the full AFC bandwidth.  The correction only applies while receiving: frames and ACKs are always sent on the nominal
+ *  channel frequency, so when both ends correct for each other the offset is not applied twice.
+ */
+void RadioExpectPeer(tRadioHandle radio /*! Radio handle */, UU32 peer /*! MAC address of the expected sender */);
+
+/*! \details Gets the turnaround statistics for automatic ACKs.
+ */
+void RadioGetAckTurnaround(tRadioHandle radio /*! Radio handle */, tAckTurnaround *turnaround /*! Receives a copy of the statistics */);
+
+/*! \details Clears the turnaround statistics for automatic ACKs.
+ */
+void RadioClearAckTurnaround(tRadioHandle radio /*! Radio handle */);
+
+/*! \details Gets the largest frame RadioSendPacket will accept with the current encryption setting.
+ *  \return Largest length byte (packet type, addresses and payload)
+ */
+U8 RadioGetMaxFrameLength(tRadioHandle radio /*! Radio handle */);
+
+/*! \details Works out how long a frame takes on the air at the current data rate, allowing for the largest header.
+ *  \return Airtime in uSec
+ */
+U32 RadioGetAirtime(tRadioHandle radio /*! Radio handle */, U8 length /*! Length of SDU */,
+					U16 preambleCount /*! Preamble count as passed to RadioSendPacket */);
+
+/*! \details Gets the time the sync word of the last frame RadioSendPacket sent ended, worked back from PacketSent at the
+ *  current data rate.  Compare it with SyncTimestamp in the receiver's tPacketMetadata for the same frame.
+ *  \return GetMicroseconds() value
+ */
+U32 RadioGetTxTimestamp(tRadioHandle radio /*! Radio handle */);
 
 /*! \details Gets the temperature from the radio.
  * \return Temperature value. See 3.4.17 in SX1231 manual for information on this value.
  *
  */
-U8 RadioGetTemperature(void);
-U8 RadioGetRFICMode(void);
+U8 RadioGetTemperature(tRadioHandle radio /*! Radio handle */);
+U8 RadioGetRFICMode(tRadioHandle radio /*! Radio handle */);
+
+/*! \details Gets the latency statistics collected for transitions into an operating mode.
+ */
+void RadioGetModeLatency(tRadioHandle radio /*! Radio handle */, tOperatingModes mode /*! kSleepMode through kReceiveMode */,
+						tModeLatency *latency /*! Receives a copy of the statistics */);
+
+/*! \details Clears the latency statistics for all operating modes.
+ */
+void RadioClearModeLatency(tRadioHandle radio /*! Radio handle */);
 
 // ******************************************************************************************************
 // External event handler declarations
 
-extern void NotifyRadioPacketReceived(tPacketTypes packetType, U8 length, U8 xdata *txBuffer);
-extern void NotifyRadioPacketSent(void);
-extern void NotifyRadioPacketSendError(void);
-extern void NotifyRadioReceiveError(void);
+// The radio the event happened on is passed first
+extern void NotifyRadioPacketReceived(tRadioHandle radio, tPacketTypes packetType, UU32 source, U8 length, U8 xdata *SDU, tPacketMetadata *metadata);
+extern void NotifyRadioPacketSent(tRadioHandle radio);
+extern void NotifyRadioPacketSendError(tRadioHandle radio);
+extern void NotifyRadioReceiveError(tRadioHandle radio);
 extern void NotifyRadio1Second(void);
 extern void NotifyRadio1MilliSecond(void);
 
@@ -224,6 +536,9 @@ extern void HandleRxPacket(void);
 #define pinRSSI		pinDIO4
 #define pinMODERDY	pinDIO5
 
+#define intSYNCADDR	kInterruptP3
+#define intMODERDY	kInterruptP5
+
 #endif
 /*!
  * @}